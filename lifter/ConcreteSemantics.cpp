@@ -0,0 +1,368 @@
+#define MERGEN_LOG_CATEGORY debugging::LOG_SEMANTICS
+#include "GEPTracker.h"
+#include "includes.h"
+#include "lifterClass.h"
+#include "utils.h"
+#include <llvm/ADT/bit.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/Support/MathExtras.h>
+
+// flags here have to match what the semantics in Semantics.cpp would fold
+// to, otherwise a path looks different depending on whether it went
+// through here
+
+namespace {
+  uint64_t maskFor(const unsigned bits) {
+    return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+  }
+
+  bool signOf(const uint64_t value, const unsigned bits) {
+    return (value >> (bits - 1)) & 1;
+  }
+
+  // 1 if even parity on the low byte
+  bool parityOf(const uint64_t value) {
+    return !(llvm::popcount(value & 0xFF) & 1);
+  }
+
+  bool isHighByteRegister(const ZydisRegister reg) {
+    return reg == ZYDIS_REGISTER_AH || reg == ZYDIS_REGISTER_CH ||
+           reg == ZYDIS_REGISTER_DH || reg == ZYDIS_REGISTER_BH;
+  }
+
+  bool isGeneralPurpose(const ZydisRegister reg) {
+    switch (ZydisRegisterGetClass(reg)) {
+    case ZYDIS_REGCLASS_GPR8:
+    case ZYDIS_REGCLASS_GPR16:
+    case ZYDIS_REGCLASS_GPR32:
+    case ZYDIS_REGCLASS_GPR64:
+      return true;
+    default:
+      return false;
+    }
+  }
+} // namespace
+
+// full register, not masked to the operand size. effective addresses use
+// the whole thing too.
+std::optional<uint64_t>
+lifterClass::getConcreteRegister(const ZydisRegister reg) {
+  if (reg == ZYDIS_REGISTER_RIP)
+    return blockInfo.runtime_address;
+  if (!isGeneralPurpose(reg))
+    return std::nullopt;
+
+  auto fullReg =
+      ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, reg);
+  auto value = Registers.constantValue(Registers.getRegisterIndex(fullReg));
+  if (!value)
+    return std::nullopt;
+
+  uint64_t result = *value;
+  if (isHighByteRegister(reg))
+    result >>= 8;
+  return result;
+}
+
+std::optional<uint64_t>
+lifterClass::getConcreteAddress(const ZydisDecodedOperand& op) {
+  // teb isnt in the buffer
+  if (op.mem.segment == ZYDIS_REGISTER_GS ||
+      op.mem.segment == ZYDIS_REGISTER_FS)
+    return std::nullopt;
+
+  uint64_t address = 0;
+  if (op.mem.base != ZYDIS_REGISTER_NONE) {
+    auto base = getConcreteRegister(op.mem.base);
+    if (!base)
+      return std::nullopt;
+    address += *base;
+  }
+  if (op.mem.index != ZYDIS_REGISTER_NONE) {
+    auto index = getConcreteRegister(op.mem.index);
+    if (!index)
+      return std::nullopt;
+    address += *index * (op.mem.scale > 1 ? op.mem.scale : 1);
+  }
+  // 0x67 makes it a 32 bit address, the sum wraps at that width
+  return (address + op.mem.disp.value) & maskFor(instruction.address_width);
+}
+
+// same sources retrieveCombinedValue uses, but every byte has to be known
+std::optional<uint64_t>
+lifterClass::readConcreteMemory(const uint64_t address,
+                                const unsigned byteCount) {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < byteCount; ++i) {
+    const uint64_t current = address + i;
+    uint64_t byte;
+
+    auto it = buffer.find(current);
+    if (it != buffer.end()) {
+      auto value = dyn_cast_or_null<ConstantInt>(it->second.value);
+      if (!value || (it->second.byteOffset + 1) * 8 > value->getBitWidth())
+        return std::nullopt;
+      byte = value->getValue().extractBitsAsZExtValue(
+          8, it->second.byteOffset * 8);
+    } else {
+      // written through an address we couldnt pin down
+      if (writes.isWritten(current))
+        return std::nullopt;
+      APInt memValue(1, 0);
+      if (!BinaryOperations::readMemory(current, 1, memValue))
+        return std::nullopt;
+      byte = memValue.getZExtValue() & 0xFF;
+    }
+    result |= byte << (i * 8);
+  }
+  return result;
+}
+
+std::optional<uint64_t>
+lifterClass::getConcreteOperand(const ZydisDecodedOperand& op,
+                                const unsigned size) {
+  switch (op.type) {
+  case ZYDIS_OPERAND_TYPE_REGISTER: {
+    auto value = getConcreteRegister(op.reg.value);
+    if (!value)
+      return std::nullopt;
+    return *value & maskFor(size);
+  }
+  case ZYDIS_OPERAND_TYPE_IMMEDIATE: {
+    const uint64_t value =
+        op.imm.is_signed ? static_cast<uint64_t>(op.imm.value.s)
+                         : op.imm.value.u;
+    return value & maskFor(size);
+  }
+  case ZYDIS_OPERAND_TYPE_MEMORY: {
+    auto address = getConcreteAddress(op);
+    if (!address)
+      return std::nullopt;
+    return readConcreteMemory(*address, size / 8);
+  }
+  default:
+    return std::nullopt;
+  }
+}
+
+bool lifterClass::tryConcreteExecution() {
+  const auto mnemonic = instruction.mnemonic;
+  switch (mnemonic) {
+  case ZYDIS_MNEMONIC_MOV:
+  case ZYDIS_MNEMONIC_MOVZX:
+  case ZYDIS_MNEMONIC_MOVSX:
+  case ZYDIS_MNEMONIC_MOVSXD:
+  case ZYDIS_MNEMONIC_LEA:
+  case ZYDIS_MNEMONIC_ADD:
+  case ZYDIS_MNEMONIC_SUB:
+  case ZYDIS_MNEMONIC_CMP:
+  case ZYDIS_MNEMONIC_AND:
+  case ZYDIS_MNEMONIC_OR:
+  case ZYDIS_MNEMONIC_XOR:
+  case ZYDIS_MNEMONIC_TEST:
+  case ZYDIS_MNEMONIC_INC:
+  case ZYDIS_MNEMONIC_DEC:
+  case ZYDIS_MNEMONIC_NOT:
+  case ZYDIS_MNEMONIC_NEG:
+  case ZYDIS_MNEMONIC_SHL:
+  case ZYDIS_MNEMONIC_SHR:
+  case ZYDIS_MNEMONIC_SAR:
+    break;
+  default:
+    return false;
+  }
+
+  const unsigned operandCount = instruction.operand_count_visible;
+  if (operandCount == 0 || operandCount > 2)
+    return false;
+
+  const auto& dest = operands[0];
+  const auto& src = operands[1];
+  const unsigned bits = dest.size;
+  if (bits == 0 || bits > 64 || bits % 8)
+    return false;
+  if (dest.type == ZYDIS_OPERAND_TYPE_REGISTER &&
+      !isGeneralPurpose(dest.reg.value))
+    return false;
+  if (dest.type == ZYDIS_OPERAND_TYPE_MEMORY && !getConcreteAddress(dest))
+    return false;
+  if (operandCount == 2 && src.size > 64)
+    return false;
+  const uint64_t mask = maskFor(bits);
+
+  // reads first, nothing is written unless the whole instruction is concrete
+  std::optional<uint64_t> Lvalue, Rvalue;
+  switch (mnemonic) {
+  case ZYDIS_MNEMONIC_MOV:
+  case ZYDIS_MNEMONIC_MOVZX:
+  case ZYDIS_MNEMONIC_MOVSX:
+  case ZYDIS_MNEMONIC_MOVSXD:
+    Rvalue = getConcreteOperand(
+        src, src.type == ZYDIS_OPERAND_TYPE_IMMEDIATE ? bits : src.size);
+    if (!Rvalue)
+      return false;
+    break;
+  case ZYDIS_MNEMONIC_LEA:
+    Rvalue = getConcreteAddress(src);
+    if (!Rvalue)
+      return false;
+    break;
+  case ZYDIS_MNEMONIC_INC:
+  case ZYDIS_MNEMONIC_DEC:
+  case ZYDIS_MNEMONIC_NOT:
+  case ZYDIS_MNEMONIC_NEG:
+    Lvalue = getConcreteOperand(dest, bits);
+    if (!Lvalue)
+      return false;
+    break;
+  default:
+    if (operandCount != 2)
+      return false;
+    Lvalue = getConcreteOperand(dest, bits);
+    Rvalue = getConcreteOperand(src, bits);
+    if (!Lvalue || !Rvalue)
+      return false;
+    break;
+  }
+
+  auto setFlagTo = [this](const Flag flag, const bool value) {
+    setFlag(flag, builder.getInt1(value));
+  };
+  auto setResultFlags = [&](const uint64_t result) {
+    setFlagTo(FLAG_SF, signOf(result, bits));
+    setFlagTo(FLAG_ZF, result == 0);
+    setFlagTo(FLAG_PF, parityOf(result));
+  };
+  auto write = [&](const uint64_t result) {
+    SetOperandValue(dest, builder.getIntN(bits, result & mask));
+  };
+
+  switch (mnemonic) {
+  case ZYDIS_MNEMONIC_MOV:
+  case ZYDIS_MNEMONIC_MOVZX: {
+    write(*Rvalue);
+    break;
+  }
+  case ZYDIS_MNEMONIC_MOVSX:
+  case ZYDIS_MNEMONIC_MOVSXD: {
+    write(llvm::SignExtend64(*Rvalue, src.size));
+    break;
+  }
+  case ZYDIS_MNEMONIC_LEA: {
+    write(*Rvalue);
+    break;
+  }
+  case ZYDIS_MNEMONIC_ADD: {
+    const uint64_t L = *Lvalue, R = *Rvalue;
+    const uint64_t result = (L + R) & mask;
+    setFlagTo(FLAG_AF, (L & 0xF) + (R & 0xF) > 0xF);
+    setFlagTo(FLAG_CF, result < L || result < R);
+    setFlagTo(FLAG_OF, signOf((L ^ result) & (R ^ result), bits));
+    setResultFlags(result);
+    write(result);
+    break;
+  }
+  case ZYDIS_MNEMONIC_SUB:
+  case ZYDIS_MNEMONIC_CMP: {
+    const uint64_t L = *Lvalue, R = *Rvalue;
+    const uint64_t result = (L - R) & mask;
+    setFlagTo(FLAG_AF, (L & 0xF) < (R & 0xF));
+    setFlagTo(FLAG_CF, R > L);
+    setFlagTo(FLAG_OF, signOf((L ^ R) & (L ^ result), bits));
+    setResultFlags(result);
+    if (mnemonic == ZYDIS_MNEMONIC_SUB)
+      write(result);
+    break;
+  }
+  case ZYDIS_MNEMONIC_AND:
+  case ZYDIS_MNEMONIC_OR:
+  case ZYDIS_MNEMONIC_XOR:
+  case ZYDIS_MNEMONIC_TEST: {
+    uint64_t result;
+    if (mnemonic == ZYDIS_MNEMONIC_OR)
+      result = *Lvalue | *Rvalue;
+    else if (mnemonic == ZYDIS_MNEMONIC_XOR)
+      result = *Lvalue ^ *Rvalue;
+    else
+      result = *Lvalue & *Rvalue;
+    setFlagTo(FLAG_OF, false);
+    setFlagTo(FLAG_CF, false);
+    setResultFlags(result);
+    if (mnemonic != ZYDIS_MNEMONIC_TEST)
+      write(result);
+    break;
+  }
+  case ZYDIS_MNEMONIC_INC: {
+    // CF is not affected
+    const uint64_t L = *Lvalue;
+    const uint64_t result = (L + 1) & mask;
+    setFlagTo(FLAG_OF, signOf((L ^ result) & (1 ^ result), bits));
+    setFlagTo(FLAG_AF, (L & 0xF) + 1 > 0xF);
+    setResultFlags(result);
+    write(result);
+    break;
+  }
+  case ZYDIS_MNEMONIC_DEC: {
+    const uint64_t L = *Lvalue;
+    const uint64_t result = (L - 1) & mask;
+    setFlagTo(FLAG_OF, signOf((L ^ 1) & (L ^ result), bits));
+    setFlagTo(FLAG_AF, (L & 0xF) < 1);
+    setResultFlags(result);
+    write(result);
+    break;
+  }
+  case ZYDIS_MNEMONIC_NOT: {
+    write(~*Lvalue);
+    break;
+  }
+  case ZYDIS_MNEMONIC_NEG: {
+    const uint64_t L = *Lvalue;
+    const uint64_t result = (0 - L) & mask;
+    setFlagTo(FLAG_CF, L != 0);
+    setFlagTo(FLAG_AF, (L & 0xF) != 0);
+    setFlagTo(FLAG_OF, L != 0 && result == L);
+    setResultFlags(result);
+    write(result);
+    break;
+  }
+  case ZYDIS_MNEMONIC_SHL:
+  case ZYDIS_MNEMONIC_SHR:
+  case ZYDIS_MNEMONIC_SAR: {
+    const uint64_t L = *Lvalue;
+    const unsigned count = *Rvalue & (bits == 64 ? 0x3f : 0x1f);
+    // zero keeps the old flags, past the width the semantics clamp; leave
+    // both to the lifter
+    if (count == 0 || count > bits - 1)
+      return false;
+
+    uint64_t result;
+    bool cf;
+    if (mnemonic == ZYDIS_MNEMONIC_SHL) {
+      result = (L << count) & mask;
+      cf = (L >> (bits - count)) & 1;
+      if (count == 1)
+        setFlagTo(FLAG_OF, signOf(result, bits) != signOf(L, bits));
+    } else if (mnemonic == ZYDIS_MNEMONIC_SHR) {
+      result = L >> count;
+      cf = (L >> (count - 1)) & 1;
+      if (count == 1)
+        setFlagTo(FLAG_OF, signOf(L, bits));
+    } else {
+      const int64_t signedL = llvm::SignExtend64(L, bits);
+      result = static_cast<uint64_t>(signedL >> count) & mask;
+      cf = (signedL >> (count - 1)) & 1;
+      setFlagTo(FLAG_OF, false);
+    }
+    // OF is left alone for counts other than 1
+    setFlagTo(FLAG_CF, cf);
+    setResultFlags(result);
+    write(result);
+    break;
+  }
+  default:
+    return false;
+  }
+
+  printvalue2(blockInfo.runtime_address);
+  return true;
+}
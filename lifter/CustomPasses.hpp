@@ -7,6 +7,9 @@
 #include "utils.h"
 #include "llvm/IR/PassManager.h"
 #include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/ConstantRange.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Metadata.h>
 #include <llvm/IR/CFG.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/Support/KnownBits.h>
@@ -14,78 +17,251 @@
 
 #include <algorithm>
 #include <map>
+#include <optional>
 #include <string>
 
 using namespace llvm;
 
-class PromotePseudoStackPass
-    : public llvm::PassInfoMixin<PromotePseudoStackPass> {
+// Recovers the frame below the initial stack pointer from the GEPs on
+// %memory. Every access gets an offset interval, overlapping intervals are
+// merged into one slot and each slot becomes its own alloca. A slot that is
+// only accessed with one integer type at its start gets that type,
+// anything else becomes [N x i8], so SROA/mem2reg can promote them.
+//
+// runs inside the final_optpass fixpoint, slots from previous rounds are
+// found again through !mergen.stackslot so newly solved offsets land in the
+// same alloca, or in a wider one replacing it when they only partially
+// overlap. A frame with a pointer we cant follow, or with an access
+// straddling the initial stack pointer, is left in %memory as a whole.
+class StackFrameRecoveryPass
+    : public llvm::PassInfoMixin<StackFrameRecoveryPass> {
 public:
-  llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager&) {
+  struct StackAccess {
+    llvm::GetElementPtrInst* GEP;
+    uint64_t start; // lowest byte touched
+    uint64_t end;   // one past the highest byte touched
+    llvm::Type* type; // single access type at a constant offset, or null
+  };
+
+  struct StackSlot {
+    uint64_t start;
+    uint64_t end;
+    llvm::AllocaInst* alloca = nullptr;
+    std::vector<StackAccess*> accesses;
+    // slots from earlier rounds that this one replaces
+    std::vector<StackSlot*> replaced;
+  };
+
+  // lowest/highest value V can take, nullopt if we cant bound it
+  static std::optional<std::pair<uint64_t, uint64_t>>
+  offsetRange(llvm::Value* V, const llvm::DataLayout& DL, unsigned depth = 0) {
+    if (auto* CI = llvm::dyn_cast<llvm::ConstantInt>(V)) {
+      if (CI->getBitWidth() > 64)
+        return std::nullopt;
+      return std::make_pair(CI->getZExtValue(), CI->getZExtValue());
+    }
+
+    if (auto* SI = llvm::dyn_cast<llvm::SelectInst>(V); SI && depth < 8) {
+      auto T = offsetRange(SI->getTrueValue(), DL, depth + 1);
+      auto F = offsetRange(SI->getFalseValue(), DL, depth + 1);
+      if (!T || !F)
+        return std::nullopt;
+      return std::make_pair(std::min(T->first, F->first),
+                            std::max(T->second, F->second));
+    }
+
+    auto KB = llvm::computeKnownBits(V, DL);
+    auto range = llvm::ConstantRange::fromKnownBits(KB, false).intersectWith(
+        llvm::computeConstantRange(V, false));
+    if (range.isFullSet() || range.isEmptySet() || range.isWrappedSet() ||
+        range.getBitWidth() > 64)
+      return std::nullopt;
+    return std::make_pair(range.getUnsignedMin().getZExtValue(),
+                          range.getUnsignedMax().getZExtValue());
+  }
 
+  // size of the widest load/store through GEP, 0 if the pointer escapes
+  static uint64_t accessSize(llvm::GetElementPtrInst* GEP,
+                             const llvm::DataLayout& DL, llvm::Type*& type) {
+    uint64_t size = 0;
+    type = nullptr;
+    bool mixed = false;
+    for (auto* U : GEP->users()) {
+      llvm::Type* T = nullptr;
+      if (auto* LI = llvm::dyn_cast<llvm::LoadInst>(U))
+        T = LI->getType();
+      else if (auto* SI = llvm::dyn_cast<llvm::StoreInst>(U);
+               SI && SI->getPointerOperand() == GEP)
+        T = SI->getValueOperand()->getType();
+      else
+        return 0;
+
+      size = std::max<uint64_t>(size, DL.getTypeStoreSize(T));
+      if (type && type != T)
+        mixed = true;
+      type = T;
+    }
+    if (mixed || (type && !type->isIntegerTy()))
+      type = nullptr;
+    return size;
+  }
+
+  llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager&) {
     llvm::Value* memory = getMemory();
+    const auto& DL = M.getDataLayout();
+    auto& context = M.getContext();
+    const unsigned slotKind = context.getMDKindID("mergen.stackslot");
 
     bool hasChanged = false;
-    llvm::Value* stackMemory = NULL;
     for (auto& F : M) {
-      if (!stackMemory) {
-        llvm::IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
-        stackMemory = Builder.CreateAlloca(
-            llvm::Type::getInt128Ty(M.getContext()),
-            llvm::ConstantInt::get(llvm::Type::getInt128Ty(M.getContext()),
-                                   STACKP_VALUE),
-            "stackmemory");
+      if (F.isDeclaration())
+        continue;
+
+      std::vector<StackSlot> oldSlots;
+      for (auto& I : F.getEntryBlock()) {
+        auto* AI = llvm::dyn_cast<llvm::AllocaInst>(&I);
+        if (!AI || !AI->getMetadata(slotKind))
+          continue;
+        auto* MD = llvm::cast<llvm::ConstantAsMetadata>(
+            AI->getMetadata(slotKind)->getOperand(0));
+        uint64_t start = llvm::cast<llvm::ConstantInt>(MD->getValue())
+                             ->getZExtValue();
+        oldSlots.push_back(
+            {start, start + DL.getTypeAllocSize(AI->getAllocatedType()), AI});
       }
+
+      std::vector<StackAccess> accesses;
+      bool unsafe = false;
       for (auto& BB : F) {
         for (auto& I : BB) {
-          if (auto* GEP = llvm::dyn_cast<llvm::GetElementPtrInst>(&I)) {
+          auto* GEP = llvm::dyn_cast<llvm::GetElementPtrInst>(&I);
+          if (!GEP || GEP->getPointerOperand() != memory ||
+              GEP->getNumIndices() != 1)
+            continue;
+
+          auto range = offsetRange(GEP->getOperand(1), DL);
+          // unbounded, it could be any byte of the frame
+          if (!range) {
+            unsafe = true;
+            break;
+          }
+          // [rsp] and above belongs to the caller, leave it in memory
+          if (range->first >= STACKP_VALUE)
+            continue;
+
+          llvm::Type* type = nullptr;
+          uint64_t size = accessSize(GEP, DL, type);
+          uint64_t end = range->second + size;
+          // an escaping pointer can reach any byte of the frame, and an
+          // access crossing [rsp] would be split between two objects
+          if (size == 0 || end > STACKP_VALUE || end < range->second) {
+            unsafe = true;
+            break;
+          }
+          accesses.push_back({GEP, range->first, end,
+                              range->first == range->second ? type : nullptr});
+        }
+        if (unsafe)
+          break;
+      }
 
-            // TODO: prettify here!!!
-            auto* MemoryOperand = GEP->getOperand(GEP->getNumOperands() - 2);
-            // printvalue(MemoryOperand)
-            // printvalue(memory)
+      if (unsafe) {
+        // slots from earlier rounds go back to memory so every byte has a
+        // single home again
+        for (auto& slot : oldSlots) {
+          llvm::IRBuilder<> builder(slot.alloca);
+          auto* base = builder.CreateGEP(builder.getInt8Ty(), memory,
+                                         {builder.getInt64(slot.start)},
+                                         slot.alloca->getName());
+          slot.alloca->replaceAllUsesWith(base);
+          slot.alloca->eraseFromParent();
+          hasChanged = true;
+        }
+        continue;
+      }
 
-            if (memory != MemoryOperand)
-              continue;
+      if (accesses.empty())
+        continue;
 
-            auto* OffsetOperand = GEP->getOperand(GEP->getNumOperands() - 1);
-            // printvalue(OffsetOperand)
-
-            if (isa<ConstantInt>(OffsetOperand)) {
-              if (auto* ConstInt =
-                      llvm::dyn_cast<llvm::ConstantInt>(OffsetOperand)) {
-                uint64_t constintvalue = (uint64_t)ConstInt->getZExtValue();
-                if (constintvalue < STACKP_VALUE) {
-                  GEP->setOperand((GEP->getNumOperands() - 2), stackMemory);
-                }
-              }
-              continue;
-            }
-            // if OffsetOperand is not a constant:
-            auto offsetKB = computeKnownBits(OffsetOperand, M.getDataLayout());
-            auto StackSize = APInt(64, STACKP_VALUE);
-
-            auto SSKB = KnownBits::makeConstant(StackSize);
-            printvalue2(offsetKB);
-            printvalue2(SSKB);
-            if (KnownBits::ult(offsetKB, SSKB)) {
-              // minimum of offsetKB
-              GEP->setOperand((GEP->getNumOperands() - 2), stackMemory);
-            } else if (auto select_inst = dyn_cast<SelectInst>(OffsetOperand)) {
-              if (isa<ConstantInt>(select_inst->getFalseValue()) &&
-                  isa<ConstantInt>(select_inst->getTrueValue())) {
-                if ((cast<ConstantInt>(select_inst->getTrueValue())
-                         ->getZExtValue() < STACKP_VALUE) &&
-                    (cast<ConstantInt>(select_inst->getFalseValue())
-                         ->getZExtValue() < STACKP_VALUE)) {
-                  GEP->setOperand((GEP->getNumOperands() - 2), stackMemory);
-                }
-              }
-            }
-            // endif
-          }
+      // old slots and accesses are merged by overlap, a group that is one
+      // old slot keeps it, anything else gets a new alloca spanning the
+      // group
+      std::vector<std::pair<uint64_t, uint64_t>> order;
+      for (size_t i = 0; i < oldSlots.size(); ++i)
+        order.push_back({oldSlots[i].start, i});
+      for (size_t i = 0; i < accesses.size(); ++i)
+        order.push_back({accesses[i].start, oldSlots.size() + i});
+      std::sort(order.begin(), order.end());
+
+      std::vector<StackSlot> slots;
+      for (auto [start, index] : order) {
+        const bool isOld = index < oldSlots.size();
+        const uint64_t end = isOld ? oldSlots[index].end
+                                   : accesses[index - oldSlots.size()].end;
+        if (slots.empty() || start >= slots.back().end)
+          slots.push_back({start, end});
+        auto& slot = slots.back();
+        slot.end = std::max(slot.end, end);
+        if (isOld)
+          slot.replaced.push_back(&oldSlots[index]);
+        else
+          slot.accesses.push_back(&accesses[index - oldSlots.size()]);
+      }
+
+      // erased at the end, the builder may be positioned on one of them
+      std::vector<llvm::AllocaInst*> retired;
+      for (auto& slot : slots) {
+        if (slot.accesses.empty())
+          continue;
+
+        // rewritten GEPs are erased, so dont keep a builder across slots
+        llvm::IRBuilder<> builder(
+            &*F.getEntryBlock().getFirstInsertionPt());
+
+        if (slot.replaced.size() == 1 &&
+            slot.replaced.front()->start == slot.start &&
+            slot.replaced.front()->end == slot.end) {
+          slot.alloca = slot.replaced.front()->alloca;
+          slot.replaced.clear();
+        } else {
+          llvm::Type* slotType = slot.accesses.front()->type;
+          for (auto* access : slot.accesses)
+            if (access->type != slotType || access->start != slot.start)
+              slotType = nullptr;
+          if (!slotType || !slot.replaced.empty() ||
+              DL.getTypeAllocSize(slotType) != slot.end - slot.start)
+            slotType = llvm::ArrayType::get(llvm::Type::getInt8Ty(context),
+                                            slot.end - slot.start);
+
+          slot.alloca = builder.CreateAlloca(slotType, nullptr, "stackslot");
+          slot.alloca->setMetadata(
+              slotKind, llvm::MDNode::get(
+                            context, llvm::ConstantAsMetadata::get(
+                                         builder.getInt64(slot.start))));
+        }
+
+        // narrower slots from earlier rounds become views into the new one
+        for (auto* old : slot.replaced) {
+          auto* view = builder.CreateConstGEP1_64(
+              builder.getInt8Ty(), slot.alloca, old->start - slot.start);
+          old->alloca->replaceAllUsesWith(view);
+          retired.push_back(old->alloca);
         }
+
+        for (auto* access : slot.accesses) {
+          auto* GEP = access->GEP;
+          llvm::IRBuilder<> rebase(GEP);
+          auto* offset = rebase.CreateSub(GEP->getOperand(1),
+                                          rebase.getInt64(slot.start));
+          auto* newGEP = rebase.CreateGEP(rebase.getInt8Ty(), slot.alloca,
+                                          {offset}, GEP->getName());
+          GEP->replaceAllUsesWith(newGEP);
+          GEP->eraseFromParent();
+        }
+        hasChanged = true;
       }
+      for (auto* AI : retired)
+        AI->eraseFromParent();
     }
     return hasChanged ? llvm::PreservedAnalyses::none()
                       : llvm::PreservedAnalyses::all();
@@ -228,87 +404,4 @@ public:
                       : llvm::PreservedAnalyses::all();
   }
 };
-class ResizeAllocatedStackPass
-    : public llvm::PassInfoMixin<ResizeAllocatedStackPass> {
-public:
-  bool chainEnd(Instruction* inst) {
-    return isa<CallInst>(inst) || isa<LoadInst>(inst) || isa<StoreInst>(inst);
-  }
-  void chainLook(llvm::Module& M, Instruction* GEP,
-                 uint64_t& smallest_val_of_chain) {
-    for (auto user : GEP->users()) {
-      auto inst = cast<Instruction>(user);
-      auto offset = GEP->getOperand(1);
-      auto offsetKB = computeKnownBits(offset, M.getDataLayout());
-      smallest_val_of_chain += offsetKB.getMinValue().getZExtValue();
-      if (chainEnd(inst)) {
-        return;
-      }
-      chainLook(M, inst, smallest_val_of_chain);
-    }
-  }
-  llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager&) {
-    std::vector<llvm::Instruction*> toResize;
-    uint64_t smallest = std::numeric_limits<uint64_t>::max();
-    bool hasChanged = false;
-
-    for (auto& F : M) {
-      if (F.isDeclaration())
-        continue;
-
-      Instruction* Allocated = &(F.getEntryBlock().front());
-      if (!isa<AllocaInst>(Allocated))
-        continue;
-
-      for (auto& BB : F) {
-        for (auto& I : BB) {
-          if (auto* GEP = llvm::dyn_cast<llvm::GetElementPtrInst>(&I)) {
-            if (GEP->getOperand(0) == Allocated) {
-              uint64_t smallest_val_of_chain = 0;
-              chainLook(M, GEP, smallest_val_of_chain);
-              smallest = std::min(smallest_val_of_chain, smallest);
-              toResize.push_back(GEP);
-            }
-          }
-        }
-      }
-
-      if (smallest != std::numeric_limits<uint64_t>::max()) {
-        IRBuilder<> builder(M.getContext());
-        auto allocainst = cast<AllocaInst>(Allocated);
-        auto allocaType = allocainst->getAllocatedType();
-
-        auto allocationSize =
-            M.getDataLayout().getTypeAllocSize(allocaType) / 16;
-        // / 16 because i128 is (i) 8 x 16
-        auto newSize = allocationSize - smallest;
-        Type* newType =
-            ArrayType::get(Type::getInt8Ty(allocainst->getContext()), newSize);
-
-        builder.SetInsertPoint(allocainst);
-        AllocaInst* newAlloca = builder.CreateAlloca(
-            newType, nullptr, allocainst->getName() + ".resized");
-
-        allocainst->replaceAllUsesWith(newAlloca);
-        allocainst->eraseFromParent();
-
-        for (llvm::Instruction* GEPInst : toResize) {
-
-          builder.SetInsertPoint(GEPInst);
-
-          auto val = GEPInst->getOperand(1);
-
-          Value* newval = builder.CreateSub(val, builder.getInt64(smallest));
-          GEPInst->setOperand(1, newval);
-        }
-
-        toResize.clear();
-        hasChanged = true;
-      }
-    }
-    return hasChanged ? llvm::PreservedAnalyses::none()
-                      : llvm::PreservedAnalyses::all();
-  }
-};
-
 #endif
@@ -0,0 +1,819 @@
+#define MERGEN_LOG_CATEGORY debugging::LOG_PATH
+#include "EGraph.h"
+#include "includes.h"
+#include "lifterClass.h"
+#include "utils.h"
+#include <chrono>
+#include <llvm/ADT/Hashing.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/MathExtras.h>
+
+namespace egraph {
+
+  Config& config() {
+    static Config cfg;
+    return cfg;
+  }
+
+  bool setMaxNodes(const std::string& value) {
+    return !llvm::StringRef(value).getAsInteger(10, config().maxNodes);
+  }
+
+  bool setTimeout(const std::string& value) {
+    return !llvm::StringRef(value).getAsInteger(10,
+                                                config().timeoutMilliseconds);
+  }
+
+  namespace {
+    constexpr unsigned INFINITE_COST = ~0u;
+
+    uint64_t maskFor(const unsigned width) {
+      return width >= 64 ? ~0ULL : (1ULL << width) - 1;
+    }
+
+    bool isCommutative(const Op op) {
+      return op == Op::Add || op == Op::Mul || op == Op::And ||
+             op == Op::Or || op == Op::Xor;
+    }
+
+    bool isBinary(const Op op) {
+      return op >= Op::Add && op <= Op::AShr;
+    }
+
+    bool isCast(const Op op) {
+      return op == Op::ZExt || op == Op::SExt || op == Op::Trunc;
+    }
+
+    // roughly what the op costs every later pass, constants and values we
+    // already have are free
+    unsigned opCost(const Op op) {
+      switch (op) {
+      case Op::Constant:
+      case Op::Leaf:
+        return 0;
+      case Op::Mul:
+        return 3;
+      case Op::Select:
+        return 2;
+      default:
+        return 1;
+      }
+    }
+
+    std::optional<bool> compare(const llvm::CmpInst::Predicate predicate,
+                                const uint64_t L, const uint64_t R,
+                                const unsigned width) {
+      const int64_t SL = llvm::SignExtend64(L, width);
+      const int64_t SR = llvm::SignExtend64(R, width);
+      switch (predicate) {
+      case llvm::CmpInst::ICMP_EQ:
+        return L == R;
+      case llvm::CmpInst::ICMP_NE:
+        return L != R;
+      case llvm::CmpInst::ICMP_UGT:
+        return L > R;
+      case llvm::CmpInst::ICMP_UGE:
+        return L >= R;
+      case llvm::CmpInst::ICMP_ULT:
+        return L < R;
+      case llvm::CmpInst::ICMP_ULE:
+        return L <= R;
+      case llvm::CmpInst::ICMP_SGT:
+        return SL > SR;
+      case llvm::CmpInst::ICMP_SGE:
+        return SL >= SR;
+      case llvm::CmpInst::ICMP_SLT:
+        return SL < SR;
+      case llvm::CmpInst::ICMP_SLE:
+        return SL <= SR;
+      default:
+        return std::nullopt;
+      }
+    }
+  } // namespace
+
+  size_t NodeHash::operator()(const Node& node) const {
+    return llvm::hash_combine(
+        node.op, node.predicate, node.width,
+        llvm::hash_combine_range(node.children.begin(), node.children.end()),
+        node.constant, node.leaf);
+  }
+
+  ClassId EGraph::find(ClassId id) {
+    while (parents[id] != id) {
+      parents[id] = parents[parents[id]];
+      id = parents[id];
+    }
+    return id;
+  }
+
+  Node EGraph::canonicalize(Node node) {
+    for (auto& child : node.children)
+      child = find(child);
+    return node;
+  }
+
+  unsigned EGraph::widthOf(ClassId id) {
+    return classes[find(id)].nodes.front().width;
+  }
+
+  std::optional<uint64_t> EGraph::constantOf(ClassId id) {
+    return classes[find(id)].constant;
+  }
+
+  std::optional<uint64_t> EGraph::evaluate(const Node& node) {
+    if (node.op == Op::Constant)
+      return node.constant;
+    if (node.op == Op::Leaf)
+      return std::nullopt;
+
+    llvm::SmallVector<uint64_t, 3> values;
+    for (auto child : node.children) {
+      auto value = constantOf(child);
+      if (!value)
+        return std::nullopt;
+      values.push_back(*value);
+    }
+
+    const uint64_t mask = maskFor(node.width);
+    switch (node.op) {
+    case Op::Add:
+      return (values[0] + values[1]) & mask;
+    case Op::Sub:
+      return (values[0] - values[1]) & mask;
+    case Op::Mul:
+      return (values[0] * values[1]) & mask;
+    case Op::And:
+      return values[0] & values[1];
+    case Op::Or:
+      return values[0] | values[1];
+    case Op::Xor:
+      return values[0] ^ values[1];
+    case Op::Shl:
+      return values[1] >= node.width ? 0 : (values[0] << values[1]) & mask;
+    case Op::LShr:
+      return values[1] >= node.width ? 0 : values[0] >> values[1];
+    case Op::AShr:
+      if (values[1] >= node.width)
+        return std::nullopt;
+      return static_cast<uint64_t>(
+                 llvm::SignExtend64(values[0], node.width) >> values[1]) &
+             mask;
+    case Op::ZExt:
+    case Op::Trunc:
+      return values[0] & mask;
+    case Op::SExt:
+      return static_cast<uint64_t>(llvm::SignExtend64(
+                 values[0], widthOf(node.children[0]))) &
+             mask;
+    case Op::Select:
+      return values[0] ? values[1] : values[2];
+    case Op::ICmp:
+      if (auto result = compare(
+              static_cast<llvm::CmpInst::Predicate>(node.predicate),
+              values[0], values[1], widthOf(node.children[0])))
+        return *result;
+      return std::nullopt;
+    default:
+      return std::nullopt;
+    }
+  }
+
+  ClassId EGraph::addConstant(const uint64_t value, const uint8_t width) {
+    Node node;
+    node.op = Op::Constant;
+    node.width = width;
+    node.constant = value & maskFor(width);
+    return add(node);
+  }
+
+  ClassId EGraph::add(Node node) {
+    node = canonicalize(node);
+    if (auto it = memo.find(node); it != memo.end())
+      return find(it->second);
+
+    const ClassId id = classes.size();
+    parents.push_back(id);
+    classes.emplace_back();
+    classes[id].constant = evaluate(node);
+    classes[id].nodes.push_back(node);
+    memo[node] = id;
+    ++nodeCount;
+    costsValid = false;
+
+    // known classes always carry the constant itself, extraction picks it
+    if (node.op != Op::Constant && classes[id].constant)
+      merge(id, addConstant(*classes[id].constant, node.width));
+    return find(id);
+  }
+
+  bool EGraph::merge(ClassId a, ClassId b) {
+    a = find(a);
+    b = find(b);
+    if (a == b)
+      return false;
+    if (classes[a].nodes.size() < classes[b].nodes.size())
+      std::swap(a, b);
+
+    parents[b] = a;
+    auto& into = classes[a];
+    auto& from = classes[b];
+    into.nodes.insert(into.nodes.end(), from.nodes.begin(), from.nodes.end());
+    from.nodes.clear();
+    // two different constants means the path cant happen, keep either
+    if (!into.constant)
+      into.constant = from.constant;
+    costsValid = false;
+    return true;
+  }
+
+  // merges classes whose nodes became equal after their children merged
+  void EGraph::rebuild() {
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      memo.clear();
+      nodeCount = 0;
+      std::vector<std::pair<ClassId, Node>> constants;
+
+      for (ClassId id = 0; id < classes.size(); ++id) {
+        if (find(id) != id)
+          continue;
+        std::vector<Node> nodes;
+        for (const auto& node : classes[id].nodes) {
+          auto canonical = canonicalize(node);
+          if (std::find(nodes.begin(), nodes.end(), canonical) != nodes.end())
+            continue;
+          nodes.push_back(canonical);
+        }
+        classes[id].nodes = nodes;
+
+        // merging moves nodes around, so walk the copy
+        for (const auto& node : nodes) {
+          auto [it, inserted] = memo.try_emplace(node, id);
+          if (!inserted && find(it->second) != find(id))
+            changed |= merge(it->second, id);
+          if (!classes[find(id)].constant)
+            if (auto value = evaluate(node)) {
+              classes[find(id)].constant = value;
+              Node constant;
+              constant.op = Op::Constant;
+              constant.width = node.width;
+              constant.constant = *value;
+              constants.push_back({id, constant});
+            }
+        }
+        nodeCount += classes[find(id)].nodes.size();
+      }
+
+      for (auto& [id, node] : constants) {
+        merge(id, add(node));
+        changed = true;
+      }
+    }
+  }
+
+  bool EGraph::applyRules(ClassId id, const Node& node) {
+    bool changed = false;
+    auto equal = [&](ClassId other) { changed |= merge(id, other); };
+    auto make = [&](Op op, llvm::ArrayRef<ClassId> children,
+                    const uint8_t width, const uint8_t predicate = 0) {
+      Node created;
+      created.op = op;
+      created.width = width;
+      created.predicate = predicate;
+      created.children.assign(children.begin(), children.end());
+      return add(created);
+    };
+    auto constant = [&](const uint64_t value) {
+      return addConstant(value, node.width);
+    };
+    // nodes of a class with the given op, copied since rules add to it
+    auto nodesOf = [&](ClassId cls, Op op) {
+      std::vector<Node> matching;
+      for (const auto& candidate : classes[find(cls)].nodes)
+        if (candidate.op == op)
+          matching.push_back(candidate);
+      return matching;
+    };
+
+    const uint64_t mask = maskFor(node.width);
+    const Op op = node.op;
+
+    if (op == Op::Select) {
+      ClassId cond = find(node.children[0]), T = find(node.children[1]),
+              F = find(node.children[2]);
+      if (auto known = constantOf(cond))
+        equal(*known ? T : F);
+      if (T == F)
+        equal(T);
+      auto ct = constantOf(T), cf = constantOf(F);
+      if (node.width == 1 && ct && cf && *ct != *cf)
+        equal(*ct ? cond : make(Op::Xor, {cond, constant(1)}, 1));
+      return changed;
+    }
+
+    if (isCast(op)) {
+      ClassId x = find(node.children[0]);
+      const unsigned fromWidth = widthOf(x);
+      if (fromWidth == node.width)
+        equal(x);
+
+      for (const auto& inner : nodesOf(x, Op::ZExt)) {
+        // zext then zext or sext is one zext
+        if (op == Op::ZExt || op == Op::SExt)
+          equal(make(Op::ZExt, {inner.children[0]}, node.width));
+      }
+      for (const auto& inner : nodesOf(x, Op::SExt))
+        if (op == Op::SExt)
+          equal(make(Op::SExt, {inner.children[0]}, node.width));
+      if (op == Op::Trunc) {
+        for (auto innerOp : {Op::ZExt, Op::SExt, Op::Trunc}) {
+          for (const auto& inner : nodesOf(x, innerOp)) {
+            ClassId y = find(inner.children[0]);
+            const unsigned innerWidth = widthOf(y);
+            if (innerWidth == node.width)
+              equal(y);
+            else if (innerWidth > node.width)
+              equal(make(Op::Trunc, {y}, node.width));
+            else
+              equal(make(innerOp, {y}, node.width));
+          }
+        }
+      }
+      // cast of select with known arms
+      for (const auto& select : nodesOf(x, Op::Select)) {
+        ClassId T = find(select.children[1]), F = find(select.children[2]);
+        if (constantOf(T) && constantOf(F))
+          equal(make(Op::Select,
+                     {select.children[0], make(op, {T}, node.width),
+                      make(op, {F}, node.width)},
+                     node.width));
+      }
+      return changed;
+    }
+
+    if (!isBinary(op) && op != Op::ICmp)
+      return changed;
+
+    ClassId a = find(node.children[0]), b = find(node.children[1]);
+    auto ca = constantOf(a), cb = constantOf(b);
+
+    // op(select(c, k1, k2), k) and op(select(c, k1, k2), select(c, k3, k4))
+    // both become a select of constants, this is what solvePath wants
+    for (const auto& select : nodesOf(a, Op::Select)) {
+      ClassId cond = find(select.children[0]);
+      ClassId T = find(select.children[1]), F = find(select.children[2]);
+      if (!constantOf(T) || !constantOf(F))
+        continue;
+      if (cb) {
+        equal(make(Op::Select,
+                   {cond, make(op, {T, b}, node.width, node.predicate),
+                    make(op, {F, b}, node.width, node.predicate)},
+                   node.width));
+        continue;
+      }
+      for (const auto& other : nodesOf(b, Op::Select)) {
+        ClassId T2 = find(other.children[1]), F2 = find(other.children[2]);
+        if (find(other.children[0]) != cond || !constantOf(T2) ||
+            !constantOf(F2))
+          continue;
+        equal(make(Op::Select,
+                   {cond, make(op, {T, T2}, node.width, node.predicate),
+                    make(op, {F, F2}, node.width, node.predicate)},
+                   node.width));
+      }
+    }
+    if (ca)
+      for (const auto& select : nodesOf(b, Op::Select)) {
+        ClassId T = find(select.children[1]), F = find(select.children[2]);
+        if (constantOf(T) && constantOf(F))
+          equal(make(Op::Select,
+                     {select.children[0],
+                      make(op, {a, T}, node.width, node.predicate),
+                      make(op, {a, F}, node.width, node.predicate)},
+                     node.width));
+      }
+
+    if (op == Op::ICmp) {
+      if (a == b) {
+        auto predicate = static_cast<llvm::CmpInst::Predicate>(node.predicate);
+        equal(constant(llvm::CmpInst::isTrueWhenEqual(predicate)));
+      }
+      return changed;
+    }
+
+    if (isCommutative(op)) {
+      equal(make(op, {b, a}, node.width));
+      // (x op k1) op k2 -> x op (k1 op k2)
+      if (cb)
+        for (const auto& inner : nodesOf(a, op)) {
+          ClassId x = find(inner.children[0]), y = find(inner.children[1]);
+          if (constantOf(y))
+            equal(make(op, {x, make(op, {y, b}, node.width)}, node.width));
+        }
+    }
+
+    switch (op) {
+    case Op::Add: {
+      if (cb == 0u)
+        equal(a);
+      if (a == b)
+        equal(make(Op::Mul, {a, constant(2)}, node.width));
+      // x * k + x, x * k1 + x * k2
+      for (const auto& mul : nodesOf(a, Op::Mul)) {
+        ClassId x = find(mul.children[0]);
+        auto k1 = constantOf(mul.children[1]);
+        if (!k1)
+          continue;
+        if (x == b)
+          equal(make(Op::Mul, {x, constant(*k1 + 1)}, node.width));
+        for (const auto& other : nodesOf(b, Op::Mul)) {
+          auto k2 = constantOf(other.children[1]);
+          if (find(other.children[0]) == x && k2)
+            equal(make(Op::Mul, {x, constant(*k1 + *k2)}, node.width));
+        }
+      }
+      // x + (y - x)
+      for (const auto& sub : nodesOf(b, Op::Sub))
+        if (find(sub.children[1]) == a)
+          equal(sub.children[0]);
+      break;
+    }
+    case Op::Sub: {
+      if (cb == 0u)
+        equal(a);
+      if (a == b)
+        equal(constant(0));
+      if (cb)
+        equal(make(Op::Add, {a, constant(0 - *cb)}, node.width));
+      // (x + y) - y, (x + y) - x
+      for (const auto& add : nodesOf(a, Op::Add)) {
+        if (find(add.children[1]) == b)
+          equal(add.children[0]);
+        else if (find(add.children[0]) == b)
+          equal(add.children[1]);
+      }
+      break;
+    }
+    case Op::Mul: {
+      if (cb == 1u)
+        equal(a);
+      if (cb == 0u)
+        equal(constant(0));
+      if (cb && llvm::isPowerOf2_64(*cb))
+        equal(make(Op::Shl, {a, constant(llvm::Log2_64(*cb))}, node.width));
+      break;
+    }
+    case Op::And: {
+      if (cb == mask)
+        equal(a);
+      if (cb == 0u)
+        equal(constant(0));
+      if (a == b)
+        equal(a);
+      for (const auto& xorNode : nodesOf(b, Op::Xor))
+        if (find(xorNode.children[0]) == a &&
+            constantOf(xorNode.children[1]) == mask)
+          equal(constant(0));
+      // masking a zext with its own width does nothing
+      if (cb)
+        for (const auto& zext : nodesOf(a, Op::ZExt))
+          if (*cb == maskFor(widthOf(zext.children[0])))
+            equal(a);
+      break;
+    }
+    case Op::Or: {
+      if (cb == 0u)
+        equal(a);
+      if (cb == mask)
+        equal(constant(mask));
+      if (a == b)
+        equal(a);
+      for (const auto& xorNode : nodesOf(b, Op::Xor))
+        if (find(xorNode.children[0]) == a &&
+            constantOf(xorNode.children[1]) == mask)
+          equal(constant(mask));
+      break;
+    }
+    case Op::Xor: {
+      if (cb == 0u)
+        equal(a);
+      if (a == b)
+        equal(constant(0));
+      // x ^ (x ^ y)
+      for (const auto& inner : nodesOf(b, Op::Xor)) {
+        if (find(inner.children[0]) == a)
+          equal(inner.children[1]);
+        else if (find(inner.children[1]) == a)
+          equal(inner.children[0]);
+      }
+      break;
+    }
+    case Op::Shl:
+    case Op::LShr:
+    case Op::AShr: {
+      if (cb == 0u || ca == 0u)
+        equal(a);
+      if (!cb)
+        break;
+      if (op != Op::AShr && *cb >= node.width) {
+        equal(constant(0));
+        break;
+      }
+      if (op == Op::Shl && *cb < node.width)
+        equal(make(Op::Mul, {a, constant(1ULL << *cb)}, node.width));
+      if (op == Op::AShr)
+        break;
+      // shifts in the same direction add up
+      for (const auto& inner : nodesOf(a, op)) {
+        auto k1 = constantOf(inner.children[1]);
+        if (!k1)
+          continue;
+        const uint64_t total = *k1 + *cb;
+        equal(total >= node.width
+                  ? constant(0)
+                  : make(op, {inner.children[0], constant(total)},
+                         node.width));
+      }
+      // shifting back and forth only clears bits
+      const Op reverse = op == Op::Shl ? Op::LShr : Op::Shl;
+      for (const auto& inner : nodesOf(a, reverse)) {
+        if (constantOf(inner.children[1]) != cb)
+          continue;
+        const uint64_t kept =
+            op == Op::Shl ? (mask << *cb) & mask : mask >> *cb;
+        equal(make(Op::And, {inner.children[0], constant(kept)}, node.width));
+      }
+      break;
+    }
+    default:
+      break;
+    }
+    return changed;
+  }
+
+  void EGraph::saturate() {
+    const auto deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(config().timeoutMilliseconds);
+    auto outOfBudget = [&]() {
+      return nodeCount >= config().maxNodes ||
+             (config().timeoutMilliseconds &&
+              std::chrono::steady_clock::now() > deadline);
+    };
+
+    for (unsigned iteration = 0; iteration < config().maxIterations;
+         ++iteration) {
+      bool changed = false;
+      const size_t classCount = classes.size();
+      for (ClassId id = 0; id < classCount && !outOfBudget(); ++id) {
+        if (find(id) != id)
+          continue;
+        auto nodes = classes[id].nodes;
+        for (const auto& node : nodes)
+          changed |= applyRules(id, node);
+      }
+      rebuild();
+      if (!changed || outOfBudget())
+        break;
+    }
+  }
+
+  void EGraph::computeCosts() {
+    if (costsValid)
+      return;
+    costs.assign(classes.size(), INFINITE_COST);
+    bestNodes.assign(classes.size(), Node());
+
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (ClassId id = 0; id < classes.size(); ++id) {
+        if (find(id) != id)
+          continue;
+        for (const auto& node : classes[id].nodes) {
+          unsigned total = opCost(node.op);
+          for (auto child : node.children) {
+            const unsigned childCost = costs[find(child)];
+            if (childCost == INFINITE_COST) {
+              total = INFINITE_COST;
+              break;
+            }
+            total += childCost;
+          }
+          if (total < costs[id]) {
+            costs[id] = total;
+            bestNodes[id] = canonicalize(node);
+            changed = true;
+          }
+        }
+      }
+    }
+    costsValid = true;
+  }
+
+  const Node& EGraph::best(const ClassId id) {
+    computeCosts();
+    return bestNodes[find(id)];
+  }
+
+  unsigned EGraph::cost(const ClassId id) {
+    computeCosts();
+    return costs[find(id)];
+  }
+
+} // namespace egraph
+
+namespace {
+  using namespace egraph;
+
+  // value to e-graph, anything we dont model becomes a leaf
+  struct EGraphBuilder {
+    lifterClass& lifter;
+    EGraph& graph;
+    llvm::DenseMap<Value*, ClassId> built;
+
+    static constexpr unsigned maxDepth = 24;
+
+    std::optional<Op> opFor(Instruction* I) {
+      switch (I->getOpcode()) {
+      case Instruction::Add:
+        return Op::Add;
+      case Instruction::Sub:
+        return Op::Sub;
+      case Instruction::Mul:
+        return Op::Mul;
+      case Instruction::And:
+        return Op::And;
+      case Instruction::Or:
+        return Op::Or;
+      case Instruction::Xor:
+        return Op::Xor;
+      case Instruction::Shl:
+        return Op::Shl;
+      case Instruction::LShr:
+        return Op::LShr;
+      case Instruction::AShr:
+        return Op::AShr;
+      case Instruction::ZExt:
+        return Op::ZExt;
+      case Instruction::SExt:
+        return Op::SExt;
+      case Instruction::Trunc:
+        return Op::Trunc;
+      case Instruction::Select:
+        return Op::Select;
+      case Instruction::ICmp:
+        return Op::ICmp;
+      default:
+        return std::nullopt;
+      }
+    }
+
+    ClassId build(Value* V, const unsigned depth) {
+      if (auto it = built.find(V); it != built.end())
+        return it->second;
+
+      const uint8_t width = V->getType()->getIntegerBitWidth();
+      Node node;
+      node.width = width;
+
+      std::optional<Op> op;
+      auto I = dyn_cast<Instruction>(V);
+      if (I && depth < maxDepth && graph.size() < config().maxNodes / 2)
+        op = opFor(I);
+      // every operand has to fit in 64 bits too
+      if (op && I)
+        for (auto& operand : I->operands())
+          if (!operand->getType()->isIntegerTy() ||
+              operand->getType()->getIntegerBitWidth() > 64)
+            op.reset();
+
+      if (auto C = dyn_cast<ConstantInt>(V)) {
+        node.op = Op::Constant;
+        node.constant = C->getZExtValue();
+      } else if (op) {
+        node.op = *op;
+        if (auto cmp = dyn_cast<ICmpInst>(I))
+          node.predicate = cmp->getPredicate();
+        for (auto& operand : I->operands())
+          node.children.push_back(build(operand, depth + 1));
+      } else {
+        // assumptions and path ranges can still pin a leaf down
+        auto known = lifter.analyzeValueKnownBits(V, lifter.currentContext());
+        if (known.isConstant() && !known.hasConflict()) {
+          node.op = Op::Constant;
+          node.constant = known.getConstant().getZExtValue();
+        } else {
+          node.op = Op::Leaf;
+          node.leaf = V;
+        }
+      }
+      return built[V] = graph.add(node);
+    }
+  };
+} // namespace
+
+Value* lifterClass::emitFromEGraph(
+    egraph::EGraph& graph, egraph::ClassId id,
+    llvm::DenseMap<egraph::ClassId, Value*>& emitted) {
+  using egraph::Op;
+  id = graph.find(id);
+  if (auto it = emitted.find(id); it != emitted.end())
+    return it->second;
+
+  const egraph::Node node = graph.best(id);
+  auto type = builder.getIntNTy(node.width);
+  llvm::SmallVector<Value*, 3> operands;
+  for (auto child : node.children)
+    operands.push_back(emitFromEGraph(graph, child, emitted));
+
+  Value* result = nullptr;
+  switch (node.op) {
+  case Op::Constant:
+    result = ConstantInt::get(type, node.constant);
+    break;
+  case Op::Leaf:
+    result = node.leaf;
+    break;
+  case Op::Add:
+    result = createAddFolder(operands[0], operands[1], "eg-add");
+    break;
+  case Op::Sub:
+    result = createSubFolder(operands[0], operands[1], "eg-sub");
+    break;
+  case Op::Mul:
+    result = createMulFolder(operands[0], operands[1], "eg-mul");
+    break;
+  case Op::And:
+    result = createAndFolder(operands[0], operands[1], "eg-and");
+    break;
+  case Op::Or:
+    result = createOrFolder(operands[0], operands[1], "eg-or");
+    break;
+  case Op::Xor:
+    result = createXorFolder(operands[0], operands[1], "eg-xor");
+    break;
+  case Op::Shl:
+    result = createShlFolder(operands[0], operands[1], "eg-shl");
+    break;
+  case Op::LShr:
+    result = createLShrFolder(operands[0], operands[1], "eg-lshr");
+    break;
+  case Op::AShr:
+    result = createAShrFolder(operands[0], operands[1], "eg-ashr");
+    break;
+  case Op::ZExt:
+    result = createZExtFolder(operands[0], type, "eg-zext");
+    break;
+  case Op::SExt:
+    result = createSExtFolder(operands[0], type, "eg-sext");
+    break;
+  case Op::Trunc:
+    result = createTruncFolder(operands[0], type, "eg-trunc");
+    break;
+  case Op::Select:
+    result = createSelectFolder(operands[0], operands[1], operands[2],
+                                "eg-select");
+    break;
+  case Op::ICmp:
+    result = createICMPFolder(
+        static_cast<CmpInst::Predicate>(node.predicate), operands[0],
+        operands[1], "eg-icmp");
+    break;
+  }
+  emitted[id] = result;
+  return result;
+}
+
+Value* lifterClass::simplifyWithEGraph(Value* value) {
+  if (!egraph::config().maxNodes || isa<Constant>(value) ||
+      !isa<Instruction>(value))
+    return value;
+  auto type = dyn_cast<IntegerType>(value->getType());
+  if (!type || type->getBitWidth() > 64)
+    return value;
+
+  egraph::EGraph graph;
+  EGraphBuilder builderState{*this, graph};
+  const auto root = builderState.build(value, 0);
+  const unsigned originalCost = graph.cost(root);
+
+  graph.saturate();
+
+  if (auto known = graph.constantOf(root)) {
+    printvalue2(*known);
+    return ConstantInt::get(type, *known);
+  }
+  if (graph.cost(root) >= originalCost)
+    return value;
+
+  llvm::DenseMap<egraph::ClassId, Value*> emitted;
+  auto simplified = emitFromEGraph(graph, root, emitted);
+  printvalue(value);
+  printvalue(simplified);
+  return simplified;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Value.h>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// equality saturation over the integer expressions feeding branch targets and
+// memory addresses. rules only ever add equalities, so the order they run in
+// doesnt matter, the cheapest equivalent is picked at the end.
+namespace egraph {
+
+  struct Config {
+    unsigned maxNodes = 4096; // 0 turns it off
+    unsigned maxIterations = 12;
+    // 0 for none. anything else makes the output depend on how fast the
+    // machine is
+    unsigned timeoutMilliseconds = 0;
+  };
+
+  Config& config();
+
+  bool setMaxNodes(const std::string& value);
+  bool setTimeout(const std::string& value);
+
+  enum class Op : uint8_t {
+    Constant,
+    Leaf, // anything the rules dont look into
+    Add,
+    Sub,
+    Mul,
+    And,
+    Or,
+    Xor,
+    Shl,
+    LShr,
+    AShr,
+    ZExt,
+    SExt,
+    Trunc,
+    Select,
+    ICmp,
+  };
+
+  using ClassId = uint32_t;
+
+  struct Node {
+    Op op = Op::Leaf;
+    uint8_t predicate = 0; // CmpInst::Predicate for ICmp
+    uint8_t width = 0;     // of the result, at most 64
+    llvm::SmallVector<ClassId, 3> children;
+    uint64_t constant = 0;
+    llvm::Value* leaf = nullptr;
+
+    bool operator==(const Node& other) const {
+      return op == other.op && predicate == other.predicate &&
+             width == other.width && children == other.children &&
+             constant == other.constant && leaf == other.leaf;
+    }
+  };
+
+  struct NodeHash {
+    size_t operator()(const Node& node) const;
+  };
+
+  class EGraph {
+  public:
+    ClassId add(Node node);
+    ClassId find(ClassId id);
+    // false if they already were the same class
+    bool merge(ClassId a, ClassId b);
+
+    // runs the rules until nothing changes or a budget runs out
+    void saturate();
+
+    std::optional<uint64_t> constantOf(ClassId id);
+
+    // cheapest node of the class, children are class ids
+    const Node& best(ClassId id);
+    unsigned cost(ClassId id);
+
+    size_t size() const { return nodeCount; }
+
+  private:
+    struct EClass {
+      std::vector<Node> nodes;
+      std::optional<uint64_t> constant;
+    };
+
+    std::vector<ClassId> parents;
+    std::vector<EClass> classes;
+    std::unordered_map<Node, ClassId, NodeHash> memo;
+    size_t nodeCount = 0;
+
+    // extraction, filled by computeCosts
+    std::vector<unsigned> costs;
+    std::vector<Node> bestNodes;
+    bool costsValid = false;
+
+    Node canonicalize(Node node);
+    unsigned widthOf(ClassId id);
+    // folds a node whose children are all known
+    std::optional<uint64_t> evaluate(const Node& node);
+    void rebuild();
+    void computeCosts();
+    bool applyRules(ClassId id, const Node& node);
+    ClassId addConstant(uint64_t value, uint8_t width);
+  };
+
+} // namespace egraph
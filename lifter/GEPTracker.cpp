@@ -1,10 +1,14 @@
+#define MERGEN_LOG_CATEGORY debugging::LOG_MEMORY
 #include "GEPTracker.h"
+#include "LiftCache.h"
 #include "OperandUtils.h"
 #include "lifterClass.h"
 #include "nt/nt_headers.hpp"
 #include "utils.h"
+#include <algorithm>
 #include <iostream>
 #include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/Analysis/AliasAnalysis.h>
 #include <llvm/Analysis/AssumptionCache.h>
 #include <llvm/Analysis/BasicAliasAnalysis.h>
@@ -60,19 +64,13 @@ namespace BinaryOperations {
     return readMemory(imageBase + addr, 1, tmp);
   }
 
-  DenseSet<uint64_t> MemWrites;
-
-  bool isWrittenTo(uint64_t addr) {
-    return MemWrites.find(addr) != MemWrites.end();
-  }
-  void WriteTo(uint64_t addr) { MemWrites.insert(addr); }
-
   // sections
   bool readMemory(uint64_t addr, unsigned byteSize, APInt& value) {
 
     uint64_t mappedAddr = address_to_mapped_address(addr);
     uint64_t tempValue;
     if (mappedAddr > 0) {
+      liftcache::recordRead(addr, byteSize);
       std::memcpy(&tempValue,
                   reinterpret_cast<const void*>(data_g + mappedAddr), byteSize);
 
@@ -184,18 +182,329 @@ namespace BinaryOperations {
 
 }; // namespace BinaryOperations
 
+void MemoryRegionIndex::add(uint64_t start, uint64_t end,
+                            MemoryRegionType type) {
+  if (start >= end)
+    return;
+
+  std::vector<MemoryRegion> updated;
+  updated.reserve(regions.size() + 2);
+  for (const auto& region : regions) {
+    if (region.end <= start || region.start >= end) {
+      updated.push_back(region);
+      continue;
+    }
+    if (region.start < start)
+      updated.push_back({region.start, start, region.type});
+    if (region.end > end)
+      updated.push_back({end, region.end, region.type});
+  }
+  updated.push_back({start, end, type});
+  std::sort(updated.begin(), updated.end(),
+            [](const MemoryRegion& a, const MemoryRegion& b) {
+              return a.start < b.start;
+            });
+  regions = std::move(updated);
+}
+
+const MemoryRegion* MemoryRegionIndex::find(uint64_t address) const {
+  // first region that ends after address, regions dont overlap so ends are
+  // sorted too
+  auto it = std::upper_bound(
+      regions.begin(), regions.end(), address,
+      [](uint64_t addr, const MemoryRegion& r) { return addr < r.end; });
+  if (it == regions.end() || address < it->start)
+    return nullptr;
+  return &*it;
+}
+
+isPaged MemoryRegionIndex::classify(uint64_t min, uint64_t max) const {
+  auto it = std::upper_bound(
+      regions.begin(), regions.end(), min,
+      [](uint64_t addr, const MemoryRegion& r) { return addr < r.end; });
+  if (it == regions.end() || max < it->start)
+    return MEMORY_NOT_PAGED;
+
+  if (min >= it->start && max < it->end)
+    return MEMORY_PAGED;
+  return MEMORY_MIGHT_BE_PAGED;
+}
+
+void WriteTracker::init(uint64_t base, uint64_t size) {
+  imageBase = base;
+  pageCount = (size + pageSize - 1) / pageSize;
+  summary.assign((pageCount + 63) / 64, 0);
+  pages.assign(pageCount, nullptr);
+}
+
+void WriteTracker::write(uint64_t address, uint64_t size) {
+  // counted in bytes, address + size can wrap past the top
+  for (uint64_t i = 0; i < size; ++i) {
+    const uint64_t current = address + i;
+    if (current < imageBase)
+      continue;
+    const uint64_t page = (current - imageBase) / pageSize;
+    if (page >= pageCount)
+      continue;
+
+    auto& bits = pages[page];
+    if (!bits)
+      bits = std::make_shared<PageBits>();
+    else if (bits.use_count() > 1) // shared with another path, copy on write
+      bits = std::make_shared<PageBits>(*bits);
+    bits->set((current - imageBase) % pageSize);
+    summary[page / 64] |= 1ULL << (page % 64);
+  }
+}
+
+void WriteTracker::merge(const WriteTracker& other) {
+  if (pageCount == 0) {
+    *this = other;
+    return;
+  }
+  for (uint64_t page = 0; page < pageCount && page < other.pageCount;
+       ++page) {
+    if (!other.isPageWritten(page) || pages[page] == other.pages[page])
+      continue;
+    if (!isPageWritten(page)) {
+      pages[page] = other.pages[page];
+    } else {
+      pages[page] = std::make_shared<PageBits>(*pages[page] |
+                                               *other.pages[page]);
+    }
+    summary[page / 64] |= 1ULL << (page % 64);
+  }
+}
+
+static uint64_t hashByte(uint64_t address, const ValueByteReference& ref) {
+  return llvm::hash_combine(address, ref.value, ref.byteOffset);
+}
+
 void lifterClass::addValueReference(Value* value, uint64_t address) {
   unsigned valueSizeInBytes = value->getType()->getIntegerBitWidth() / 8;
+  writes.write(address, valueSizeInBytes);
   for (unsigned i = 0; i < valueSizeInBytes; i++) {
-
-    BinaryOperations::WriteTo(address + i);
     printvalue2(address + i);
-    buffer[address + i] = ValueByteReference(value, i);
+    if (trailing()) {
+      auto it = buffer.find(address + i);
+      trail.push_back(BufferUndo{address + i, it != buffer.end()
+                                                  ? std::optional(it->second)
+                                                  : std::nullopt});
+    }
+    // keep bufferHash the xor of every byte so it never needs a full walk
+    auto& ref = buffer[address + i];
+    if (ref.value)
+      bufferHash ^= hashByte(address + i, ref);
+    ref = ValueByteReference(value, i);
+    bufferHash ^= hashByte(address + i, ref);
     printvalue(value);
     printvalue2((uint64_t)address + i);
   }
 }
 
+// full walk, only for when the buffer was put together wholesale
+void lifterClass::rehashBuffer() {
+  bufferHash = 0;
+  for (const auto& [address, ref] : buffer)
+    if (ref.value)
+      bufferHash ^= hashByte(address, ref);
+}
+
+// peels constant adds/subs, [rcx+8] becomes (rcx, 8)
+std::pair<Value*, int64_t> lifterClass::splitBaseOffset(Value* address) {
+  int64_t offset = 0;
+  while (auto binOp = dyn_cast<BinaryOperator>(address)) {
+    auto constOp = dyn_cast<ConstantInt>(binOp->getOperand(1));
+    Value* other = binOp->getOperand(0);
+    if (!constOp && binOp->getOpcode() == Instruction::Add) {
+      constOp = dyn_cast<ConstantInt>(binOp->getOperand(0));
+      other = binOp->getOperand(1);
+    }
+    if (!constOp || constOp->getBitWidth() > 64)
+      break;
+
+    if (binOp->getOpcode() == Instruction::Add)
+      offset += constOp->getSExtValue();
+    else if (binOp->getOpcode() == Instruction::Sub)
+      offset -= constOp->getSExtValue();
+    else
+      break;
+    address = other;
+  }
+  return {address, offset};
+}
+
+// drops whatever a store of size bytes at base+offset might overwrite
+void lifterClass::clobberSymbolicStores(Value* base, const int64_t offset,
+                                        const uint8_t size) {
+  const int64_t end = offset + size;
+
+  // we cant tell where other bases point to, assume they might alias
+  SmallVector<Value*, 4> others;
+  for (auto& [key, stores] : symbolicStores)
+    if (key != base)
+      others.push_back(key);
+  for (auto key : others)
+    symbolicStores.erase(key);
+
+  auto found = symbolicStores.find(base);
+  if (found == symbolicStores.end())
+    return;
+  auto& stores = found->second;
+
+  // cut whatever overlaps [offset, end), keep the parts sticking out
+  auto it = stores.upper_bound(offset);
+  if (it != stores.begin())
+    --it;
+  while (it != stores.end() && it->first < end) {
+    const int64_t oldStart = it->first;
+    const SymbolicStore old = it->second;
+    const int64_t oldEnd = oldStart + old.size;
+    if (oldEnd <= offset) {
+      ++it;
+      continue;
+    }
+    it = stores.erase(it);
+    if (oldStart < offset)
+      stores[oldStart] = {old.value, old.byteOffset,
+                          (uint8_t)(offset - oldStart)};
+    if (oldEnd > end)
+      it = stores
+               .insert({end,
+                        {old.value, (uint8_t)(old.byteOffset + end - oldStart),
+                         (uint8_t)(oldEnd - end)}})
+               .first;
+  }
+}
+
+void lifterClass::addSymbolicStore(Value* base, const int64_t offset,
+                                   Value* value) {
+  const uint8_t size = value->getType()->getIntegerBitWidth() / 8;
+  clobberSymbolicStores(base, offset, size);
+  symbolicStores[base][offset] = {value, 0, size};
+}
+
+// merges every overlapping store into the loaded value with masks, see the
+// partial overlap examples at the end of this file. orgLoad is only
+// materialized when the stores dont cover the whole load.
+Value* lifterClass::retrieveSymbolicValue(Value* base, const int64_t offset,
+                                          const uint8_t byteCount,
+                                          LazyValue orgLoad) {
+  auto storesIt = symbolicStores.find(base);
+  if (storesIt == symbolicStores.end())
+    return nullptr;
+  auto& stores = storesIt->second;
+  const int64_t end = offset + byteCount;
+
+  SmallVector<std::pair<int64_t, SymbolicStore>, 8> pieces;
+  unsigned covered = 0;
+  auto it = stores.upper_bound(offset);
+  if (it != stores.begin())
+    --it;
+  for (; it != stores.end() && it->first < end; ++it) {
+    const int64_t start = std::max(it->first, offset);
+    const int64_t stop = std::min<int64_t>(it->first + it->second.size, end);
+    if (start >= stop)
+      continue;
+    pieces.push_back(
+        {start,
+         {it->second.value,
+          (uint8_t)(it->second.byteOffset + start - it->first),
+          (uint8_t)(stop - start)}});
+    covered += stop - start;
+  }
+
+  if (pieces.empty())
+    return nullptr;
+
+  if (pieces.size() == 1 && covered == byteCount)
+    return extractBytes(pieces[0].second.value, pieces[0].second.byteOffset,
+                        pieces[0].second.byteOffset + byteCount);
+
+  auto loadType = Type::getIntNTy(builder.getContext(), byteCount * 8);
+  Value* result = covered == byteCount ? ConstantInt::get(loadType, 0)
+                                       : orgLoad.get();
+  for (const auto& [start, piece] : pieces) {
+    const unsigned lo = (start - offset) * 8;
+    Value* bytes = extractBytes(piece.value, piece.byteOffset,
+                                piece.byteOffset + piece.size);
+    Value* shifted = createShlFolder(createZExtFolder(bytes, loadType),
+                                     APInt(byteCount * 8, lo));
+    auto clearMask = ~APInt::getBitsSet(byteCount * 8, lo, lo + piece.size * 8);
+    result = createOrFolder(
+        createAndFolder(result, ConstantInt::get(loadType, clearMask)),
+        shifted, "symbolicload");
+  }
+  return result;
+}
+
+// rsp is concrete, so an address computed from it has a stack constant
+// either in the peeled offset or somewhere inside the base
+static bool isStackDerived(const MemoryRegionIndex& regions, Value* base,
+                           const int64_t offset) {
+  auto isStack = [&](const uint64_t address) {
+    auto region = regions.find(address);
+    return region && region->type == MemoryRegionType::STACK;
+  };
+  if (isStack(offset))
+    return true;
+
+  SmallVector<Value*, 8> worklist = {base};
+  SmallPtrSet<Value*, 16> seen;
+  while (!worklist.empty() && seen.size() < 32) {
+    auto V = worklist.pop_back_val();
+    if (!seen.insert(V).second)
+      continue;
+    if (auto CI = dyn_cast<ConstantInt>(V)) {
+      if (CI->getBitWidth() <= 64 && isStack(CI->getZExtValue()))
+        return true;
+      continue;
+    }
+    // a pointer loaded from the stack doesnt point into it
+    if (isa<LoadInst>(V))
+      continue;
+    if (auto I = dyn_cast<Instruction>(V))
+      for (auto& operand : I->operands())
+        worklist.push_back(operand);
+  }
+  // ran out of budget, assume the worst
+  return !worklist.empty();
+}
+
+// the stack below STACKP_VALUE is private to the function, same as the stack
+// passes assume, so a store there only hits bases that were computed from
+// rsp. anywhere else, every base whose range can reach the store is dropped.
+void lifterClass::invalidateSymbolicStores(const uint64_t address,
+                                           const uint8_t size) {
+  if (symbolicStores.empty())
+    return;
+
+  const bool intoFrame =
+      address <= STACKP_VALUE && size <= STACKP_VALUE - address;
+  const ConstantRange stored(APInt(64, address), APInt(64, address + size));
+  SmallVector<Value*, 4> stale;
+  for (auto& [base, stores] : symbolicStores) {
+    if (stores.empty())
+      continue;
+    const int64_t first = stores.begin()->first;
+    if (intoFrame && !isStackDerived(memoryRegions, base, first))
+      continue;
+    auto baseRange = ConstantRange::fromKnownBits(
+        analyzeValueKnownBits(base, nullptr), false);
+    if (baseRange.getBitWidth() != 64) {
+      stale.push_back(base);
+      continue;
+    }
+    const auto& last = *stores.rbegin();
+    auto accessed = baseRange.add(ConstantRange(
+        APInt(64, first, true), APInt(64, last.first + last.second.size, true)));
+    if (!accessed.intersectWith(stored).isEmptySet())
+      stale.push_back(base);
+  }
+  for (auto base : stale)
+    symbolicStores.erase(base);
+}
+
 Value* lifterClass::retrieveCombinedValue(uint64_t startAddress,
                                           uint8_t byteCount,
                                           LazyValue orgLoad) {
@@ -340,35 +649,24 @@ namespace SCCPSimplifier {
 // rename it to MemoryTracker ?
 
 isPaged lifterClass::isValuePaged(Value* address, Instruction* ctxI) {
-  if (isa<ConstantInt>(address)) {
+  if (isa<ConstantInt>(address))
     return isMemPaged(cast<ConstantInt>(address)->getZExtValue())
                ? MEMORY_PAGED
                : MEMORY_NOT_PAGED;
-  }
-  auto KBofAddress = analyzeValueKnownBits(address, ctxI);
-
-  for (const auto& page : pageMap) {
-    uint64_t start = page.first;
-    uint64_t end = page.second;
-    // KBofAddress >= start && KBofAddress < end
-    // paged
-    // but if we cant say otherwise, then it might be paged
-
-    auto KBstart = KnownBits::makeConstant(APInt(64, start));
-    auto KBend = KnownBits::makeConstant(APInt(64, end));
 
-    if (KnownBits::uge(KBofAddress, KBstart) &&
-        KnownBits::ult(KBofAddress, KBend)) {
-      return MEMORY_PAGED;
-    }
-
-    if (!(KnownBits::uge(KBofAddress, KBend) ||
-          KnownBits::ult(KBofAddress, KBstart))) {
-      return MEMORY_MIGHT_BE_PAGED;
-    }
+  auto range = ConstantRange::fromKnownBits(
+      analyzeValueKnownBits(address, ctxI), false);
+  if (address->getType()->isIntegerTy(64)) {
+    auto computed = computeConstantRange(address, false, true, nullptr, ctxI);
+    auto narrowed = range.intersectWith(computed, ConstantRange::Unsigned);
+    if (!narrowed.isEmptySet())
+      range = narrowed;
   }
+  if (range.getBitWidth() > 64)
+    return MEMORY_MIGHT_BE_PAGED;
 
-  return MEMORY_NOT_PAGED;
+  return memoryRegions.classify(range.getUnsignedMin().getZExtValue(),
+                                range.getUnsignedMax().getZExtValue());
 }
 
 void lifterClass::pagedCheck(Value* address, Instruction* ctxI) {
@@ -433,9 +731,31 @@ void lifterClass::insertMemoryOp(StoreInst* inst) {
 
   pagedCheck(gepOffset, inst);
 
-  if (!isa<ConstantInt>(gepOffset)) {
-    printvalue(gepOffset);
-    if (auto conditional_offset = dyn_cast<SelectInst>(gepOffset)) {
+  // same simplification as solveLoad, otherwise a load could find a constant
+  // address this store went past the buffer with
+  auto solvedOffset = simplifyWithEGraph(gepOffset);
+
+  if (!isa<ConstantInt>(solvedOffset)) {
+    printvalue(solvedOffset);
+    if (auto conditional_offset = dyn_cast<SelectInst>(solvedOffset);
+        !conditional_offset) {
+      auto [base, offset] = splitBaseOffset(gepOffset);
+      addSymbolicStore(base, offset, inst->getValueOperand());
+      storeToPossibleAddresses(inst, solvedOffset);
+    } else {
+      const uint8_t size =
+          inst->getValueOperand()->getType()->getIntegerBitWidth() / 8;
+      for (auto arm : {conditional_offset->getTrueValue(),
+                       conditional_offset->getFalseValue()}) {
+        if (auto constArm = dyn_cast<ConstantInt>(arm)) {
+          invalidateSymbolicStores(constArm->getZExtValue(), size);
+          continue;
+        }
+        // the arm isnt tracked anywhere, but it may still overwrite
+        // symbolic stores
+        auto [base, offset] = splitBaseOffset(arm);
+        clobberSymbolicStores(base, offset, size);
+      }
       printvalue(conditional_offset->getFalseValue());
       printvalue(conditional_offset->getCondition());
       if (auto truev =
@@ -463,10 +783,43 @@ void lifterClass::insertMemoryOp(StoreInst* inst) {
     return;
   }
 
-  auto gepOffsetCI = cast<ConstantInt>(gepOffset);
+  auto gepOffsetCI = cast<ConstantInt>(solvedOffset);
 
+  invalidateSymbolicStores(
+      gepOffsetCI->getZExtValue(),
+      inst->getValueOperand()->getType()->getIntegerBitWidth() / 8);
   addValueReference(inst->getValueOperand(), gepOffsetCI->getZExtValue());
-  BinaryOperations::WriteTo(gepOffsetCI->getZExtValue());
+}
+
+// offset can only be one of a few addresses, so every one of them gets
+// select(offset == addr, value, old). conditions are exclusive, so updating
+// overlapping candidates one after another is still correct.
+void lifterClass::storeToPossibleAddresses(StoreInst* inst, Value* offset) {
+  auto addresses = tryComputePossibleValues(offset, MAX_POSSIBLE_VALUES);
+  if (!addresses)
+    return;
+
+  auto value = inst->getValueOperand();
+  auto valueType = value->getType();
+  const uint8_t size = valueType->getIntegerBitWidth() / 8;
+  for (const auto& addr : *addresses) {
+    const uint64_t address = addr.getZExtValue();
+    invalidateSymbolicStores(address, size);
+
+    // whatever isnt in the buffer has to be read before the store happens
+    LazyValue oldValue([this, inst, valueType, address]() -> Value* {
+      IRBuilder<> preStore(inst);
+      auto ptr = preStore.CreateGEP(preStore.getInt8Ty(), getMemory(),
+                                    preStore.getInt64(address));
+      return preStore.CreateLoad(valueType, ptr);
+    });
+    auto isAddress = createICMPFolder(
+        CmpInst::ICMP_EQ, offset,
+        ConstantInt::get(offset->getType(), address));
+    auto newValue = createSelectFolder(
+        isAddress, value, retrieveCombinedValue(address, size, oldValue));
+    addValueReference(newValue, address);
+  }
 }
 
 bool overlaps(uint64_t addr1, uint64_t size1, uint64_t addr2, uint64_t size2) {
@@ -542,7 +895,7 @@ set<APInt, APIntComparator>
 lifterClass::getPossibleValues(const llvm::KnownBits& known,
                                unsigned max_unknown) {
 
-  if ((max_unknown == 0) || (max_unknown >= 4)) {
+  if ((max_unknown == 0) || (max_unknown >= MAX_UNKNOWN_BITS)) {
     debugging::doIfDebug([&]() {
       std::string Filename = "output_too_many_unk.ll";
       std::error_code EC;
@@ -576,7 +929,7 @@ lifterClass::getPossibleValues(const llvm::KnownBits& known,
   return values;
 }
 
-std::set<APInt, APIntComparator>
+std::optional<std::set<APInt, APIntComparator>>
 calculatePossibleValues(std::set<APInt, APIntComparator> v1,
                         std::set<APInt, APIntComparator> v2,
                         Instruction* inst) {
@@ -685,20 +1038,15 @@ calculatePossibleValues(std::set<APInt, APIntComparator> v1,
           break;
         }
         default: {
-          outs() << "\n : " << cast<ICmpInst>(inst)->getPredicate();
-          outs().flush();
-          UNREACHABLE(
-              "Unsupported operation in calculatePossibleValues ICMP.\n");
-          break;
+          printvalue2((int)cast<ICmpInst>(inst)->getPredicate());
+          return std::nullopt;
         }
         }
         break;
       }
       default:
-        outs() << "\n : " << inst->getOpcode();
-        outs().flush();
-        UNREACHABLE("Unsupported operation in calculatePossibleValues.\n");
-        break;
+        printvalue2(inst->getOpcode());
+        return std::nullopt;
       }
     }
   }
@@ -707,106 +1055,179 @@ calculatePossibleValues(std::set<APInt, APIntComparator> v1,
 
 set<APInt, APIntComparator> lifterClass::computePossibleValues(Value* V,
                                                                uint8_t Depth) {
-  printvalue2(Depth);
-  if (Depth > 16) {
+  PossibleValuesMemo memo;
+  bool opaque = false;
+  // like before, whatever comes from outside the function has no candidates
+  auto values = possibleValues(V, MAX_POSSIBLE_VALUES, Depth, memo, opaque);
+  if (!values) {
     debugging::doIfDebug([&]() {
-      std::string Filename = "output_depth_exceeded.ll";
+      std::string Filename = "output_too_many_unk.ll";
       std::error_code EC;
       raw_fd_ostream OS(Filename, EC);
       builder.GetInsertBlock()->getParent()->getParent()->print(OS, nullptr);
     });
-    UNREACHABLE("Depth exceeded");
+    printvalueforce(V);
+    UNREACHABLE("We cant solve the value because too many potential values, "
+                "too deep or unsupported operation!");
   }
-  set<APInt, APIntComparator> res;
-  printvalue(V);
-  if (auto v_ci = dyn_cast<ConstantInt>(V)) {
-    res.insert(v_ci->getValue());
-    return res;
-  }
-  if (auto v_inst = dyn_cast<Instruction>(V)) {
+  return *values;
+}
 
-    if (v_inst->getNumOperands() == 1)
-      return computePossibleValues(v_inst->getOperand(0), Depth + 1);
+// nullopt if V can take more than limit values or we cant follow it
+std::optional<set<APInt, APIntComparator>>
+lifterClass::tryComputePossibleValues(Value* V, const unsigned limit,
+                                      const uint8_t Depth) {
+  PossibleValuesMemo memo;
+  bool opaque = false;
+  auto values = possibleValues(V, limit, Depth, memo, opaque);
+  // an argument or global somewhere below makes the set incomplete
+  if (opaque)
+    return std::nullopt;
+  return values;
+}
 
-    if (v_inst->getOpcode() == Instruction::Select) {
-      auto cond = v_inst->getOperand(0);
-      auto trueValue = v_inst->getOperand(1);
-      auto falseValue = v_inst->getOperand(2);
+// memo is per query, selects over selects share their arms so without it
+// this is exponential. opaque is set when a leaf isnt an instruction, those
+// leaves contribute nothing to the set.
+std::optional<set<APInt, APIntComparator>>
+lifterClass::possibleValues(Value* V, const unsigned limit,
+                            const uint8_t Depth, PossibleValuesMemo& memo,
+                            bool& opaque) {
+  printvalue2(Depth);
+  if (Depth > 16)
+    return std::nullopt;
+  if (!V->getType()->isIntegerTy() ||
+      V->getType()->getIntegerBitWidth() > 64)
+    return std::nullopt;
 
-      auto kb = analyzeValueKnownBits(cond, v_inst);
-      printvalue2(kb);
+  printvalue(V);
+  if (auto v_ci = dyn_cast<ConstantInt>(V))
+    return set<APInt, APIntComparator>{v_ci->getValue()};
 
-      if (kb.isZero()) {
-        auto falseValues = computePossibleValues(falseValue, Depth + 1);
+  auto v_inst = dyn_cast<Instruction>(V);
+  if (!v_inst) {
+    opaque = true;
+    return set<APInt, APIntComparator>{};
+  }
 
-        res.insert(falseValues.begin(), falseValues.end());
-        return res;
-      }
-      if (kb.isNonZero()) {
-        auto falseValues = computePossibleValues(falseValue, Depth + 1);
+  if (auto it = memo.find(V); it != memo.end())
+    return it->second;
+  auto result = possibleValuesOf(v_inst, limit, Depth, memo, opaque);
+  memo[V] = result;
+  return result;
+}
 
-        res.insert(falseValues.begin(), falseValues.end());
-        return res;
-      }
-      auto trueValues = computePossibleValues(trueValue, Depth + 1);
-      // Combine all possible values from both branches
-      res.insert(trueValues.begin(), trueValues.end());
+std::optional<set<APInt, APIntComparator>>
+lifterClass::possibleValuesOf(Instruction* v_inst, const unsigned limit,
+                              const uint8_t Depth, PossibleValuesMemo& memo,
+                              bool& opaque) {
+  set<APInt, APIntComparator> res;
+  const unsigned width = v_inst->getType()->getIntegerBitWidth();
+
+  switch (v_inst->getOpcode()) {
+  case Instruction::ZExt:
+  case Instruction::SExt:
+  case Instruction::Trunc:
+  case Instruction::Freeze: {
+    auto values =
+        possibleValues(v_inst->getOperand(0), limit, Depth + 1, memo, opaque);
+    if (!values)
+      return std::nullopt;
+    for (const auto& value : *values) {
+      if (v_inst->getOpcode() == Instruction::ZExt)
+        res.insert(value.zext(width));
+      else if (v_inst->getOpcode() == Instruction::SExt)
+        res.insert(value.sext(width));
+      else if (v_inst->getOpcode() == Instruction::Trunc)
+        res.insert(value.trunc(width));
+      else
+        res.insert(value);
+    }
+    return res;
+  }
+  case Instruction::Select: {
+    auto cond = v_inst->getOperand(0);
+    auto trueValue = v_inst->getOperand(1);
+    auto falseValue = v_inst->getOperand(2);
+
+    auto kb = analyzeValueKnownBits(cond, v_inst);
+    printvalue2(kb);
+
+    if (kb.isZero())
+      return possibleValues(falseValue, limit, Depth + 1, memo, opaque);
+    if (kb.isNonZero())
+      return possibleValues(trueValue, limit, Depth + 1, memo, opaque);
+
+    auto trueValues = possibleValues(trueValue, limit, Depth + 1, memo, opaque);
+    if (!trueValues)
+      return std::nullopt;
+    auto falseValues =
+        possibleValues(falseValue, limit, Depth + 1, memo, opaque);
+    if (!falseValues)
+      return std::nullopt;
+
+    // Combine all possible values from both branches
+    res.insert(trueValues->begin(), trueValues->end());
+    res.insert(falseValues->begin(), falseValues->end());
+    if (res.size() > limit)
+      return std::nullopt;
+    return res;
+  }
+  case Instruction::ICmp:
+    break;
+  default:
+    // loads, calls, phis and friends cant be followed
+    if (!isa<BinaryOperator>(v_inst))
+      return std::nullopt;
+  }
 
-      auto falseValues = computePossibleValues(falseValue, Depth + 1);
+  auto op1 = v_inst->getOperand(0);
+  auto op2 = v_inst->getOperand(1);
+  if (!op1->getType()->isIntegerTy() ||
+      op1->getType()->getIntegerBitWidth() > 64)
+    return std::nullopt;
+
+  auto op1_knownbits = analyzeValueKnownBits(op1, v_inst);
+  auto op2_knownbits = analyzeValueKnownBits(op2, v_inst);
+  auto v_knownbits = analyzeValueKnownBits(v_inst, v_inst);
+  unsigned int res_unknownbits_count =
+      llvm::popcount(~(v_knownbits.One | v_knownbits.Zero).getZExtValue()) -
+      64 + v_knownbits.getBitWidth();
+
+  auto total_unk = ~((op1_knownbits.One | op1_knownbits.Zero) &
+                     (op2_knownbits.One | op2_knownbits.Zero));
+
+  unsigned int total_unknownbits_count =
+      llvm::popcount(total_unk.getZExtValue()) - 64 + total_unk.getBitWidth();
+  printvalue2(v_knownbits);
+  printvalue2(op1_knownbits);
+  printvalue2(op2_knownbits);
+  printvalue2(res_unknownbits_count);
+  printvalue2(total_unknownbits_count);
+
+  if (res_unknownbits_count == 0) {
+    res.insert(v_knownbits.One);
+    return res;
+  }
 
-      res.insert(falseValues.begin(), falseValues.end());
-      return res;
-    }
-    auto op1 = v_inst->getOperand(0);
-    auto op2 = v_inst->getOperand(1);
-    auto op1_knownbits = analyzeValueKnownBits(op1, v_inst);
-    unsigned int op1_unknownbits_count = llvm::popcount(
-        ~(op1_knownbits.One | op1_knownbits.Zero).getZExtValue());
-
-    auto op2_knownbits = analyzeValueKnownBits(op2, v_inst);
-    unsigned int op2_unknownbits_count = llvm::popcount(
-        ~(op2_knownbits.One | op2_knownbits.Zero).getZExtValue());
-    printvalue2(analyzeValueKnownBits(V, v_inst));
-    auto v_knownbits = analyzeValueKnownBits(v_inst, v_inst);
-    unsigned int res_unknownbits_count =
-        llvm::popcount(~(v_knownbits.One | v_knownbits.Zero).getZExtValue()) -
-        64 + v_knownbits.getBitWidth();
-
-    auto total_unk = ~((op1_knownbits.One | op1_knownbits.Zero) &
-                       (op2_knownbits.One | op2_knownbits.Zero));
-
-    unsigned int total_unknownbits_count =
-        llvm::popcount(total_unk.getZExtValue()) - 64 + total_unk.getBitWidth();
-    printvalue2(v_knownbits);
-    printvalue2(op1_knownbits);
-    printvalue2(op2_knownbits);
-    printvalue2(res_unknownbits_count);
-    printvalue2(op1_unknownbits_count);
-    printvalue2(op2_unknownbits_count);
-    printvalue2(total_unknownbits_count);
-
-    if ((res_unknownbits_count >= total_unknownbits_count) &&
-        res_unknownbits_count != 1) {
-      auto v1 = computePossibleValues(op1, Depth + 1);
-      auto v2 = computePossibleValues(op2, Depth + 1);
-
-      printvalue(v_inst);
-      printvalue2(v_knownbits);
-      printvalue(op1);
-      for (auto& vv1 : v1) {
-        printvalue2(op1_knownbits);
-        printvalue2(vv1);
-      }
-      printvalue(op2);
-      for (auto& vv2 : v2) {
-        printvalue2(op2_knownbits);
-        printvalue2(vv2);
-      }
-      return calculatePossibleValues(v1, v2, v_inst);
-    }
-    return getPossibleValues(v_knownbits, res_unknownbits_count);
+  if ((res_unknownbits_count >= total_unknownbits_count) &&
+      res_unknownbits_count != 1) {
+    auto v1 = possibleValues(op1, limit, Depth + 1, memo, opaque);
+    if (!v1)
+      return std::nullopt;
+    auto v2 = possibleValues(op2, limit, Depth + 1, memo, opaque);
+    if (!v2 || v1->size() * v2->size() > limit * limit)
+      return std::nullopt;
+
+    auto combined = calculatePossibleValues(*v1, *v2, v_inst);
+    if (!combined || combined->size() > limit)
+      return std::nullopt;
+    return combined;
   }
-  return res;
+
+  if (res_unknownbits_count >= MAX_UNKNOWN_BITS)
+    return std::nullopt;
+  return getPossibleValues(v_knownbits, res_unknownbits_count);
 }
 
 Value* lifterClass::solveLoad(LazyValue load, Value* ptr, uint8_t size) {
@@ -819,12 +1240,17 @@ Value* lifterClass::solveLoad(LazyValue load, Value* ptr, uint8_t size) {
   Value* loadOffset = loadPtrGEP->getOperand(1);
 
   printvalue(loadOffset);
+  // the e-graph can fold an opaque offset down to a constant or a select.
+  // insertMemoryOp does the same for stores so both agree on the buffer,
+  // symbolic stores are keyed by the original offset on both sides
+  Value* solvedOffset = simplifyWithEGraph(loadOffset);
+  printvalue(solvedOffset);
   // if we know all the stores, we can use our buffer
   // however, if we dont know all the stores
   // we have to if check each store overlaps with our load
   // specifically for indirect stores
-  if (isa<ConstantInt>(loadOffset)) {
-    auto loadOffsetCI = cast<ConstantInt>(loadOffset);
+  if (isa<ConstantInt>(solvedOffset)) {
+    auto loadOffsetCI = cast<ConstantInt>(solvedOffset);
 
     auto loadOffsetCIval = loadOffsetCI->getZExtValue();
 
@@ -836,8 +1262,8 @@ Value* lifterClass::solveLoad(LazyValue load, Value* ptr, uint8_t size) {
   } else {
     // Get possible values from loadOffset
 
-    if (isa<SelectInst>(loadOffset)) { // dyn_cast
-      auto select_inst = cast<SelectInst>(loadOffset);
+    if (isa<SelectInst>(solvedOffset)) { // dyn_cast
+      auto select_inst = cast<SelectInst>(solvedOffset);
       if (isa<ConstantInt>(select_inst->getTrueValue()) &&
           isa<ConstantInt>(select_inst->getFalseValue()))
         // we should be able to do this whether
@@ -850,6 +1276,32 @@ Value* lifterClass::solveLoad(LazyValue load, Value* ptr, uint8_t size) {
             retrieveCombinedValue(
                 cast<ConstantInt>(select_inst->getFalseValue())->getZExtValue(),
                 cloadsize, load));
+    } else if (loadPointer == getMemory()) {
+      auto [base, offset] = splitBaseOffset(loadOffset);
+      if (auto forwarded =
+              retrieveSymbolicValue(base, offset, cloadsize, load))
+        return forwarded;
+    }
+
+    // small address set, pick the right one with a select chain
+    if (loadPointer == getMemory()) {
+      if (auto addresses =
+              tryComputePossibleValues(solvedOffset, MAX_POSSIBLE_VALUES)) {
+        Value* result = nullptr;
+        for (const auto& addr : *addresses) {
+          auto value =
+              retrieveCombinedValue(addr.getZExtValue(), cloadsize, load);
+          if (!result) {
+            result = value;
+            continue;
+          }
+          auto isAddress = createICMPFolder(
+              CmpInst::ICMP_EQ, solvedOffset,
+              ConstantInt::get(solvedOffset->getType(), addr));
+          result = createSelectFolder(isAddress, value, result);
+        }
+        return result;
+      }
     }
   }
 
@@ -4,6 +4,10 @@
 #include <Zycore/Types.h>
 #include <llvm/ADT/APInt.h>
 #include <llvm/IR/Value.h>
+#include <bitset>
+#include <map>
+#include <memory>
+#include <vector>
 
 enum Assumption { Real, Assumed }; // add None
 
@@ -11,6 +15,11 @@ enum arch_mode { X86 = 0, X64 = 1 };
 
 enum isPaged { MEMORY_PAGED, MEMORY_MIGHT_BE_PAGED, MEMORY_NOT_PAGED };
 
+// biggest value set we enumerate for addresses and jump targets
+constexpr unsigned MAX_POSSIBLE_VALUES = 16;
+// known bits enumeration only runs below this many unknown bits
+constexpr unsigned MAX_UNKNOWN_BITS = 4;
+
 struct APIntComparator {
   bool operator()(const llvm::APInt& lhs, const llvm::APInt& rhs) const {
     return lhs.ult(rhs); // unsigned less-than comparison
@@ -53,6 +62,75 @@ public:
       : memoryAddress(addr), start(startv), end(endv), isRef(false) {}
 };
 
+// bytes [byteOffset, byteOffset + size) of value, stored at base + offset
+// where base is a symbolic address
+struct SymbolicStore {
+  llvm::Value* value;
+  uint8_t byteOffset;
+  uint8_t size;
+};
+
+// non overlapping intervals keyed by their constant offset from the base
+using SymbolicStoreMap = std::map<int64_t, SymbolicStore>;
+
+// the teb isnt in the flat address space, it has its own pointer argument
+enum class MemoryRegionType : uint8_t { STACK, IMAGE };
+
+// [start, end)
+struct MemoryRegion {
+  uint64_t start;
+  uint64_t end;
+  MemoryRegionType type;
+};
+
+// sorted, non overlapping regions so lookups are binary searches
+class MemoryRegionIndex {
+  std::vector<MemoryRegion> regions;
+
+public:
+  // overlapping parts of an existing region are taken over by the new one
+  void add(uint64_t start, uint64_t end, MemoryRegionType type);
+
+  // region that contains address, or nullptr
+  const MemoryRegion* find(uint64_t address) const;
+
+  // [min, max] inclusive
+  isPaged classify(uint64_t min, uint64_t max) const;
+};
+
+// bytes of the image written on this path, used to catch self modifying code.
+// every page has a summary bit so unwritten code pages cost a single test,
+// page bitmaps are shared between forked paths until one of them writes.
+class WriteTracker {
+  static constexpr uint64_t pageSize = 0x1000;
+  using PageBits = std::bitset<pageSize>;
+
+  uint64_t imageBase = 0;
+  uint64_t pageCount = 0;
+  std::vector<uint64_t> summary;
+  std::vector<std::shared_ptr<PageBits>> pages;
+
+  bool isPageWritten(uint64_t page) const {
+    return (summary[page / 64] >> (page % 64)) & 1;
+  }
+
+public:
+  void init(uint64_t base, uint64_t size);
+
+  // writes outside of the image are ignored
+  void write(uint64_t address, uint64_t size = 1);
+
+  bool isWritten(uint64_t address) const {
+    const uint64_t page = (address - imageBase) / pageSize;
+    if (address < imageBase || page >= pageCount || !isPageWritten(page))
+      return false;
+    return pages[page]->test((address - imageBase) % pageSize);
+  }
+
+  // union of both, for paths that join back together
+  void merge(const WriteTracker& other);
+};
+
 namespace BinaryOperations {
 
   const char* getName(const uint64_t offset);
@@ -67,8 +145,6 @@ namespace BinaryOperations {
 
   bool readMemory(const uint64_t addr, unsigned byteSize, llvm::APInt& value);
 
-  bool isWrittenTo(const uint64_t addr);
-
   uint64_t RvaToFileOffset(const void* ntHeadersBase, uint32_t rva);
 
   uint64_t address_to_mapped_address(uint64_t rva);
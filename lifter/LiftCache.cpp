@@ -0,0 +1,351 @@
+#include "LiftCache.h"
+#include "GEPTracker.h"
+#include <Zydis/Zydis.h>
+#include <algorithm>
+#include <chrono>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <map>
+#include <set>
+#include <vector>
+
+// bump when lifting changes in a way that makes old entries wrong
+#define LIFT_CACHE_VERSION "2"
+
+namespace liftcache {
+
+  Config& config() {
+    static Config cfg;
+    return cfg;
+  }
+
+  bool setDirectory(const std::string& value) {
+    config().directory = value;
+    return !value.empty();
+  }
+
+  bool setMaxSize(const std::string& megabytes) {
+    uint64_t size;
+    if (llvm::StringRef(megabytes).getAsInteger(10, size))
+      return false;
+    config().maxBytes = size << 20;
+    return true;
+  }
+
+  namespace {
+    using Ranges = std::vector<std::pair<uint64_t, uint64_t>>;
+
+    Ranges recorded;
+    // most reads hit bytes read before, recorded is joined once it grows past
+    // this and the limit follows what is left
+    constexpr size_t minCompactAt = 1 << 12;
+    size_t compactAt = minCompactAt;
+
+    // static traversal stops here, the manifest covers the rest
+    constexpr size_t maxStaticInstructions = 1 << 16;
+
+    llvm::ArrayRef<uint8_t> bytesAt(llvm::ArrayRef<uint8_t> file,
+                                    uint64_t address, uint64_t size) {
+      const uint64_t offset =
+          BinaryOperations::address_to_mapped_address(address);
+      if (offset == 0 || offset >= file.size())
+        return {};
+      return file.slice(offset, std::min<uint64_t>(size, file.size() - offset));
+    }
+
+    // sorted, overlapping and touching ranges joined
+    Ranges normalize(Ranges ranges) {
+      std::sort(ranges.begin(), ranges.end());
+      Ranges joined;
+      for (auto [start, size] : ranges) {
+        if (!joined.empty() &&
+            start <= joined.back().first + joined.back().second) {
+          auto& last = joined.back();
+          last.second = std::max(last.first + last.second, start + size) -
+                        last.first;
+          continue;
+        }
+        joined.push_back({start, size});
+      }
+      return joined;
+    }
+
+    // false if some range isnt in the file anymore. ranges are relative to
+    // the entry, like the manifest
+    bool hashRanges(llvm::ArrayRef<uint8_t> file, uint64_t entry,
+                    const Ranges& ranges, uint64_t& hash) {
+      std::vector<uint8_t> contents;
+      for (auto [start, size] : ranges) {
+        auto bytes = bytesAt(file, entry + start, size);
+        if (bytes.size() != size)
+          return false;
+        contents.insert(contents.end(), bytes.begin(), bytes.end());
+      }
+      hash = llvm::xxh3_64bits(contents);
+      return true;
+    }
+
+    std::string entryPath(const std::string& key, llvm::StringRef extension) {
+      llvm::SmallString<256> path(config().directory);
+      llvm::sys::path::append(path, key + extension.str());
+      return std::string(path);
+    }
+
+    // lookups bump the time so eviction drops the least recently used
+    void touch(const std::string& path) {
+      int fd;
+      if (llvm::sys::fs::openFileForReadWrite(path, fd,
+                                              llvm::sys::fs::CD_OpenExisting,
+                                              llvm::sys::fs::OF_None))
+        return;
+      auto now = std::chrono::time_point_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now());
+      llvm::sys::fs::setLastAccessAndModificationTime(fd, now);
+      llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+    }
+
+    // written next to the final name and renamed, parallel workers never
+    // see half an entry
+    bool writeAtomically(const std::string& path,
+                         llvm::function_ref<void(llvm::raw_ostream&)> write) {
+      int fd;
+      llvm::SmallString<256> temp;
+      if (llvm::sys::fs::createUniqueFile(path + "-%%%%%%.tmp", fd, temp))
+        return false;
+      {
+        llvm::raw_fd_ostream OS(fd, true);
+        write(OS);
+        if (OS.has_error()) {
+          OS.clear_error();
+          llvm::sys::fs::remove(temp);
+          return false;
+        }
+      }
+      return !llvm::sys::fs::rename(temp, path);
+    }
+
+    void evict() {
+      struct Entry {
+        std::string key;
+        uint64_t size;
+        llvm::sys::TimePoint<> lastUsed;
+      };
+      std::vector<Entry> entries;
+      uint64_t total = 0;
+
+      std::error_code EC;
+      for (llvm::sys::fs::directory_iterator it(config().directory, EC), end;
+           it != end && !EC; it.increment(EC)) {
+        llvm::StringRef path = it->path();
+        if (llvm::sys::path::extension(path) != ".bc")
+          continue;
+        llvm::sys::fs::file_status bitcode, manifest;
+        if (llvm::sys::fs::status(path, bitcode))
+          continue;
+        auto key = llvm::sys::path::stem(path).str();
+        uint64_t size = bitcode.getSize();
+        if (!llvm::sys::fs::status(entryPath(key, ".manifest"), manifest))
+          size += manifest.getSize();
+        entries.push_back({key, size, bitcode.getLastModificationTime()});
+        total += size;
+      }
+
+      std::sort(entries.begin(), entries.end(),
+                [](const Entry& a, const Entry& b) {
+                  return a.lastUsed < b.lastUsed;
+                });
+      for (const auto& entry : entries) {
+        if (total <= config().maxBytes)
+          break;
+        llvm::sys::fs::remove(entryPath(entry.key, ".bc"));
+        llvm::sys::fs::remove(entryPath(entry.key, ".manifest"));
+        total -= entry.size;
+      }
+    }
+  } // namespace
+
+  std::string computeKey(llvm::ArrayRef<uint8_t> file, uint64_t entry,
+                         bool is64Bit, const std::string& options) {
+    ZydisDecoder decoder;
+    ZydisDecoderInit(&decoder,
+                     is64Bit ? ZYDIS_MACHINE_MODE_LONG_64
+                             : ZYDIS_MACHINE_MODE_LEGACY_32,
+                     is64Bit ? ZYDIS_STACK_WIDTH_64 : ZYDIS_STACK_WIDTH_32);
+
+    // follow direct jumps, conditional branches and calls
+    Ranges code;
+    // set when the output embeds where the code is, not just what it is
+    bool positionDependent = false;
+    std::set<uint64_t> seen;
+    std::vector<uint64_t> worklist = {entry};
+    while (!worklist.empty() && seen.size() < maxStaticInstructions) {
+      uint64_t address = worklist.back();
+      worklist.pop_back();
+
+      while (seen.size() < maxStaticInstructions &&
+             seen.insert(address).second) {
+        auto bytes = bytesAt(file, address, ZYDIS_MAX_INSTRUCTION_LENGTH);
+        ZydisDecodedInstruction instruction;
+        ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
+        if (bytes.empty() ||
+            !ZYAN_SUCCESS(ZydisDecoderDecodeFull(&decoder, bytes.data(),
+                                                 bytes.size(), &instruction,
+                                                 operands)))
+          break;
+        code.push_back({address, instruction.length});
+
+        const uint64_t next = address + instruction.length;
+        const auto category = instruction.meta.category;
+
+        // rip reads lift to absolute constants, so do operands the loader
+        // would relocate. relative branches dont, they only pick blocks
+        if (category == ZYDIS_CATEGORY_CALL)
+          positionDependent = true; // pushes the return address
+        for (unsigned i = 0; i < instruction.operand_count_visible; ++i) {
+          const auto& operand = operands[i];
+          if (operand.type == ZYDIS_OPERAND_TYPE_MEMORY &&
+              (operand.mem.base == ZYDIS_REGISTER_RIP ||
+               (operand.mem.base == ZYDIS_REGISTER_NONE &&
+                !bytesAt(file, operand.mem.disp.value, 1).empty())))
+            positionDependent = true;
+          if (operand.type == ZYDIS_OPERAND_TYPE_IMMEDIATE &&
+              !operand.imm.is_relative &&
+              !bytesAt(file, operand.imm.value.u, 1).empty())
+            positionDependent = true;
+        }
+        const bool isBranch = category == ZYDIS_CATEGORY_COND_BR ||
+                              category == ZYDIS_CATEGORY_UNCOND_BR ||
+                              category == ZYDIS_CATEGORY_CALL;
+        if (isBranch && operands[0].type == ZYDIS_OPERAND_TYPE_IMMEDIATE &&
+            operands[0].imm.is_relative)
+          worklist.push_back(next + operands[0].imm.value.s);
+
+        if (category == ZYDIS_CATEGORY_UNCOND_BR ||
+            category == ZYDIS_CATEGORY_RET ||
+            instruction.mnemonic == ZYDIS_MNEMONIC_UD2 ||
+            instruction.mnemonic == ZYDIS_MNEMONIC_INT3)
+          break;
+        address = next;
+      }
+    }
+
+    // the same function at another address hits unless its output
+    // depends on that address
+    std::string blob = LIFT_CACHE_VERSION "|" LLVM_VERSION_STRING "|" +
+                       options + "|" +
+                       (positionDependent ? std::to_string(entry) : "") + "|";
+    for (auto [start, size] : normalize(code)) {
+      blob += std::to_string(static_cast<int64_t>(start - entry)) + ":";
+      auto bytes = bytesAt(file, start, size);
+      blob.append(bytes.begin(), bytes.end());
+    }
+
+    // two different hashes so a collision has to hit both
+    return llvm::utohexstr(llvm::xxh3_64bits(llvm::arrayRefFromStringRef(blob)),
+                           true) +
+           llvm::utohexstr(llvm::xxHash64(blob), true);
+  }
+
+  void recordRead(uint64_t address, uint64_t size) {
+    if (config().directory.empty())
+      return;
+    recorded.push_back({address, size});
+    if (recorded.size() >= compactAt) {
+      recorded = normalize(std::move(recorded));
+      compactAt = std::max(minCompactAt, recorded.size() * 2);
+    }
+  }
+
+  std::unique_ptr<llvm::Module> lookup(const std::string& key,
+                                       llvm::ArrayRef<uint8_t> file,
+                                       uint64_t entry,
+                                       llvm::LLVMContext& context) {
+    if (config().directory.empty())
+      return nullptr;
+
+    auto manifest = llvm::MemoryBuffer::getFile(entryPath(key, ".manifest"));
+    if (!manifest)
+      return nullptr;
+
+    // "offset size" per line, offsets from the entry. last line is
+    // "hash <hex>"
+    Ranges ranges;
+    uint64_t expected = 0;
+    bool hasHash = false;
+    llvm::SmallVector<llvm::StringRef, 0> lines;
+    (*manifest)->getBuffer().split(lines, '\n', -1, false);
+    for (auto line : lines) {
+      auto [first, second] = line.split(' ');
+      if (first == "hash") {
+        hasHash = !second.getAsInteger(16, expected);
+        continue;
+      }
+      int64_t offset;
+      uint64_t size;
+      if (first.getAsInteger(10, offset) || second.getAsInteger(10, size))
+        return nullptr;
+      ranges.push_back({static_cast<uint64_t>(offset), size});
+    }
+
+    uint64_t actual;
+    if (!hasHash || !hashRanges(file, entry, ranges, actual) ||
+        actual != expected)
+      return nullptr;
+
+    auto bitcode = llvm::MemoryBuffer::getFile(entryPath(key, ".bc"));
+    if (!bitcode)
+      return nullptr;
+    auto parsed =
+        llvm::parseBitcodeFile((*bitcode)->getMemBufferRef(), context);
+    if (!parsed) {
+      llvm::consumeError(parsed.takeError());
+      return nullptr;
+    }
+
+    touch(entryPath(key, ".bc"));
+    return std::move(*parsed);
+  }
+
+  void store(const std::string& key, const llvm::Module& M,
+             llvm::ArrayRef<uint8_t> file, uint64_t entry) {
+    if (config().directory.empty())
+      return;
+    if (llvm::sys::fs::create_directories(config().directory)) {
+      llvm::errs() << "cant create lift cache directory "
+                   << config().directory << "\n";
+      return;
+    }
+
+    auto ranges = normalize(std::move(recorded));
+    recorded.clear();
+    compactAt = minCompactAt;
+    for (auto& range : ranges)
+      range.first -= entry;
+    uint64_t hash;
+    if (!hashRanges(file, entry, ranges, hash))
+      return;
+
+    // manifest goes last, an entry without one is never used
+    if (!writeAtomically(entryPath(key, ".bc"), [&](llvm::raw_ostream& OS) {
+          llvm::WriteBitcodeToFile(M, OS);
+        }))
+      return;
+    writeAtomically(entryPath(key, ".manifest"), [&](llvm::raw_ostream& OS) {
+      for (auto [offset, size] : ranges)
+        OS << static_cast<int64_t>(offset) << " " << size << "\n";
+      OS << "hash " << llvm::utohexstr(hash, true) << "\n";
+    });
+
+    evict();
+  }
+
+} // namespace liftcache
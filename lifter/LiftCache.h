@@ -0,0 +1,44 @@
+#pragma once
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <memory>
+#include <string>
+
+// content addressed cache of the optimized output, so the same protected
+// function in another sample doesnt have to be lifted again
+namespace liftcache {
+
+  struct Config {
+    std::string directory; // empty means the cache is off
+    uint64_t maxBytes = 1024ULL << 20;
+  };
+
+  Config& config();
+
+  bool setDirectory(const std::string& value);
+  bool setMaxSize(const std::string& megabytes);
+
+  // lifter version, options that change the output and every byte reachable
+  // from the entry through direct branches, at offsets from the entry. the
+  // entry itself only goes in when the output would embed it, through rip
+  // or operands that point into the image. file is the raw image.
+  std::string computeKey(llvm::ArrayRef<uint8_t> file, uint64_t entry,
+                         bool is64Bit, const std::string& options);
+
+  // bytes lifting decoded or read. indirect targets arent in the key, so a
+  // hit is only used if all of these are unchanged. kept relative to the
+  // entry on disk.
+  void recordRead(uint64_t address, uint64_t size);
+
+  // nullptr on a miss
+  std::unique_ptr<llvm::Module> lookup(const std::string& key,
+                                       llvm::ArrayRef<uint8_t> file,
+                                       uint64_t entry,
+                                       llvm::LLVMContext& context);
+
+  // also evicts the least recently used entries past maxBytes
+  void store(const std::string& key, const llvm::Module& M,
+             llvm::ArrayRef<uint8_t> file, uint64_t entry);
+
+} // namespace liftcache
@@ -0,0 +1,441 @@
+#define MERGEN_LOG_CATEGORY debugging::LOG_OPERANDS
+#include "MBASimplifier.h"
+#include "includes.h"
+#include "lifterClass.h"
+#include "utils.h"
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/bit.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/PatternMatch.h>
+#include <tuple>
+
+namespace mba {
+
+  namespace {
+    uint64_t maskFor(const unsigned width) {
+      return width >= 64 ? ~0ULL : (1ULL << width) - 1;
+    }
+
+    unsigned tableSize(const unsigned variableCount) {
+      return 1u << variableCount;
+    }
+
+    // x & y & ... over the variables in mask
+    TruthTable conjunction(const unsigned mask, const unsigned variableCount) {
+      TruthTable table = 0;
+      for (unsigned k = 0; k < tableSize(variableCount); ++k)
+        if ((k & mask) == mask)
+          table |= 1 << k;
+      return table;
+    }
+
+    bool bitOf(const TruthTable table, const unsigned k) {
+      return (table >> k) & 1;
+    }
+
+    // variables the function actually looks at
+    unsigned dependencies(const TruthTable function,
+                          const unsigned variableCount) {
+      unsigned mask = 0;
+      for (unsigned i = 0; i < variableCount; ++i)
+        for (unsigned k = 0; k < tableSize(variableCount); ++k)
+          if (bitOf(function, k) != bitOf(function, k ^ (1 << i)))
+            mask |= 1 << i;
+      return mask;
+    }
+
+    unsigned bitwiseCost(const TruthTable function,
+                         const unsigned variableCount) {
+      auto plan = decompose(function, variableCount);
+      if (plan.monomials.empty())
+        return 0;
+      unsigned cost = plan.monomials.size() - 1;
+      for (auto monomial : plan.monomials)
+        cost += llvm::popcount(monomial) - 1;
+      return cost;
+    }
+
+    unsigned formCost(const Form& form, const unsigned variableCount,
+                      const uint64_t mask) {
+      if (form.terms.empty())
+        return 0;
+      // ~f
+      if (form.terms.size() == 1 && form.constant == mask &&
+          form.terms[0].coefficient == mask)
+        return bitwiseCost(form.terms[0].function, variableCount) + 1;
+
+      unsigned cost = form.terms.size() - 1 + (form.constant != 0);
+      for (const auto& term : form.terms) {
+        cost += bitwiseCost(term.function, variableCount);
+        if (term.coefficient != 1 && term.coefficient != mask)
+          ++cost;
+      }
+      // leading -f needs a 0 - f
+      if (!form.constant && form.terms[0].coefficient == mask)
+        ++cost;
+      return cost;
+    }
+  } // namespace
+
+  Bitwise decompose(const TruthTable function, const unsigned variableCount) {
+    Bitwise plan;
+    if (!function)
+      return plan;
+
+    const unsigned used = dependencies(function, variableCount);
+    bool isOr = true, isAnd = true, isXor = true;
+    for (unsigned k = 0; k < tableSize(variableCount); ++k) {
+      const bool value = bitOf(function, k);
+      isOr &= value == ((k & used) != 0);
+      isAnd &= value == ((k & used) == used);
+      isXor &= value == (llvm::popcount(k & used) & 1);
+    }
+
+    if (isAnd) {
+      plan.monomials.push_back(used);
+      return plan;
+    }
+    if (isOr || isXor) {
+      plan.useOr = isOr;
+      for (unsigned i = 0; i < variableCount; ++i)
+        if (used & (1 << i))
+          plan.monomials.push_back(1 << i);
+      return plan;
+    }
+
+    // algebraic normal form, xor of ands
+    TruthTable anf = function;
+    for (unsigned i = 0; i < variableCount; ++i)
+      for (unsigned k = 0; k < tableSize(variableCount); ++k)
+        if (k & (1 << i))
+          anf ^= bitOf(anf, k ^ (1 << i)) << k;
+    for (unsigned k = 1; k < tableSize(variableCount); ++k)
+      if (bitOf(anf, k))
+        plan.monomials.push_back(k);
+    return plan;
+  }
+
+  std::optional<Form> reduce(llvm::ArrayRef<uint64_t> signature,
+                             const unsigned variableCount, const unsigned width,
+                             const unsigned originalCost) {
+    const uint64_t mask = maskFor(width);
+    const unsigned size = tableSize(variableCount);
+    const uint64_t base = signature[0];
+
+    std::optional<Form> best;
+    unsigned bestCost = originalCost;
+    auto consider = [&](Form form) {
+      unsigned cost = formCost(form, variableCount, mask);
+      if (cost < bestCost) {
+        bestCost = cost;
+        best = std::move(form);
+      }
+    };
+
+    // base + c * f when there are only two values
+    std::optional<uint64_t> other;
+    bool twoValued = true;
+    TruthTable function = 0;
+    for (unsigned k = 0; k < size && twoValued; ++k) {
+      if (signature[k] == base)
+        continue;
+      if (other && *other != signature[k])
+        twoValued = false;
+      other = signature[k];
+      function |= 1 << k;
+    }
+    if (twoValued) {
+      Form form;
+      form.constant = base;
+      if (other)
+        form.terms.push_back({(*other - base) & mask, function});
+      consider(std::move(form));
+    }
+
+    // conjunction basis, signature[k] is the sum of the coefficients of the
+    // subsets of k
+    llvm::SmallVector<uint64_t, 1 << MAX_VARIABLES> coefficients(
+        signature.begin(), signature.end());
+    for (unsigned i = 0; i < variableCount; ++i)
+      for (unsigned k = 0; k < size; ++k)
+        if (k & (1 << i))
+          coefficients[k] =
+              (coefficients[k] - coefficients[k ^ (1 << i)]) & mask;
+    Form form;
+    form.constant = coefficients[0];
+    for (unsigned k = 1; k < size; ++k)
+      if (coefficients[k])
+        form.terms.push_back({coefficients[k], conjunction(k, variableCount)});
+    consider(std::move(form));
+
+    return best;
+  }
+
+} // namespace mba
+
+using namespace llvm::PatternMatch;
+
+namespace {
+  enum class MBAKind { Constant, Variable, Bitwise, Linear };
+
+  struct MBANode {
+    unsigned opcode = 0; // 0 for constants and variables
+    int lhs = -1, rhs = -1;
+    uint64_t constant = 0;
+    int variable = -1;
+  };
+
+  bool isMBAOpcode(const unsigned opcode) {
+    switch (opcode) {
+    case Instruction::Add:
+    case Instruction::Sub:
+    case Instruction::Mul:
+    case Instruction::And:
+    case Instruction::Or:
+    case Instruction::Xor:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  bool isBitwiseOpcode(const unsigned opcode) {
+    return opcode == Instruction::And || opcode == Instruction::Or ||
+           opcode == Instruction::Xor;
+  }
+
+  struct MBAAnalysis {
+    unsigned width;
+    llvm::DenseMap<Value*, MBAKind> kinds;
+    unsigned visited = 0;
+
+    // 0 and -1 are the only constants a bitwise function can have
+    bool isBitwiseOperand(Value* V, const MBAKind kind) {
+      if (kind == MBAKind::Variable || kind == MBAKind::Bitwise)
+        return true;
+      if (kind != MBAKind::Constant)
+        return false;
+      auto C = cast<ConstantInt>(V);
+      return C->isZero() || C->isMinusOne();
+    }
+
+    MBAKind combine(const unsigned opcode, Value* LHS, const MBAKind lhs,
+                    Value* RHS, const MBAKind rhs) {
+      if (isBitwiseOpcode(opcode))
+        return isBitwiseOperand(LHS, lhs) && isBitwiseOperand(RHS, rhs)
+                   ? MBAKind::Bitwise
+                   : MBAKind::Variable;
+      if (opcode == Instruction::Mul)
+        return (lhs == MBAKind::Constant) != (rhs == MBAKind::Constant)
+                   ? MBAKind::Linear
+                   : MBAKind::Variable;
+      return MBAKind::Linear;
+    }
+
+    MBAKind kindOf(Value* V) {
+      if (auto it = kinds.find(V); it != kinds.end())
+        return it->second;
+
+      MBAKind kind = MBAKind::Variable;
+      if (isa<ConstantInt>(V)) {
+        kind = MBAKind::Constant;
+      } else if (auto BO = dyn_cast<BinaryOperator>(V);
+                 BO && isMBAOpcode(BO->getOpcode()) &&
+                 ++visited < mba::MAX_NODES) {
+        auto lhs = kindOf(BO->getOperand(0));
+        auto rhs = kindOf(BO->getOperand(1));
+        kind = combine(BO->getOpcode(), BO->getOperand(0), lhs,
+                       BO->getOperand(1), rhs);
+      }
+      kinds[V] = kind;
+      return kind;
+    }
+
+    // post order, so evaluating in index order sees operands first
+    llvm::SmallVector<MBANode, 32> nodes;
+    llvm::DenseMap<Value*, int> indices;
+    llvm::SmallVector<Value*, mba::MAX_VARIABLES> variables;
+    unsigned interiorNodes = 0;
+
+    // -1 if there are too many variables
+    int build(Value* V) {
+      if (auto it = indices.find(V); it != indices.end())
+        return it->second;
+
+      MBANode node;
+      switch (kinds.lookup(V)) {
+      case MBAKind::Constant:
+        node.constant = cast<ConstantInt>(V)->getZExtValue();
+        break;
+      case MBAKind::Variable:
+        if (variables.size() == mba::MAX_VARIABLES)
+          return -1;
+        node.variable = variables.size();
+        variables.push_back(V);
+        break;
+      default: {
+        auto BO = cast<BinaryOperator>(V);
+        node.opcode = BO->getOpcode();
+        node.lhs = build(BO->getOperand(0));
+        if (node.lhs < 0)
+          return -1;
+        node.rhs = build(BO->getOperand(1));
+        if (node.rhs < 0)
+          return -1;
+        ++interiorNodes;
+        break;
+      }
+      }
+      nodes.push_back(node);
+      return indices[V] = nodes.size() - 1;
+    }
+
+    uint64_t evaluate(const MBANode& node, llvm::ArrayRef<uint64_t> values,
+                      const unsigned k) {
+      const uint64_t mask = width >= 64 ? ~0ULL : (1ULL << width) - 1;
+      if (node.variable >= 0)
+        return (k >> node.variable) & 1;
+      const uint64_t L = node.lhs >= 0 ? values[node.lhs] : 0;
+      const uint64_t R = node.rhs >= 0 ? values[node.rhs] : 0;
+      switch (node.opcode) {
+      case Instruction::Add:
+        return (L + R) & mask;
+      case Instruction::Sub:
+        return (L - R) & mask;
+      case Instruction::Mul:
+        return (L * R) & mask;
+      case Instruction::And:
+        return L & R;
+      case Instruction::Or:
+        return L | R;
+      case Instruction::Xor:
+        return L ^ R;
+      default:
+        return node.constant & mask;
+      }
+    }
+  };
+} // namespace
+
+Value* lifterClass::emitBitwise(const mba::TruthTable function,
+                                llvm::ArrayRef<Value*> variables) {
+  auto plan = mba::decompose(function, variables.size());
+  auto type = variables.front()->getType();
+  Value* result = nullptr;
+  for (auto monomial : plan.monomials) {
+    Value* product = nullptr;
+    for (unsigned i = 0; i < variables.size(); ++i) {
+      if (!(monomial & (1 << i)))
+        continue;
+      product = product ? createAndFolder(product, variables[i], "mba-and")
+                        : variables[i];
+    }
+    if (!result)
+      result = product;
+    else if (plan.useOr)
+      result = createOrFolder(result, product, "mba-or");
+    else
+      result = createXorFolder(result, product, "mba-xor");
+  }
+  return result ? result : ConstantInt::get(type, 0);
+}
+
+// reduced form of LHS op RHS without emitting anything
+std::optional<mba::Result>
+lifterClass::analyzeMBA(Instruction::BinaryOps opcode, Value* LHS, Value* RHS) {
+  if (!isMBAOpcode(opcode))
+    return std::nullopt;
+  auto type = dyn_cast<IntegerType>(LHS->getType());
+  if (!type || type->getBitWidth() > 64)
+    return std::nullopt;
+
+  auto& results = mbaSimplifier.results;
+  mba::Simplifier::Key key{opcode, LHS, RHS};
+  auto cached = results.find(key);
+  if (cached == results.end()) {
+    MBAAnalysis analysis;
+    analysis.width = type->getBitWidth();
+
+    std::optional<mba::Result> result;
+    auto lhs = analysis.kindOf(LHS);
+    auto rhs = analysis.kindOf(RHS);
+    auto root = analysis.combine(opcode, LHS, lhs, RHS, rhs);
+    // x op y with nothing below it cant get any smaller
+    const bool nested = lhs == MBAKind::Bitwise || lhs == MBAKind::Linear ||
+                        rhs == MBAKind::Bitwise || rhs == MBAKind::Linear;
+    if (root != MBAKind::Variable && nested) {
+      int left = analysis.build(LHS);
+      int right = left < 0 ? -1 : analysis.build(RHS);
+      if (right >= 0) {
+        MBANode rootNode;
+        rootNode.opcode = opcode;
+        rootNode.lhs = left;
+        rootNode.rhs = right;
+        analysis.nodes.push_back(rootNode);
+
+        const unsigned variableCount = analysis.variables.size();
+        llvm::SmallVector<uint64_t, 1 << mba::MAX_VARIABLES> signature;
+        llvm::SmallVector<uint64_t, 32> values(analysis.nodes.size());
+        for (unsigned k = 0; k < (1u << variableCount); ++k) {
+          for (unsigned i = 0; i < analysis.nodes.size(); ++i)
+            values[i] = analysis.evaluate(analysis.nodes[i], values, k);
+          signature.push_back(values.back());
+        }
+
+        if (auto form =
+                mba::reduce(signature, variableCount, analysis.width,
+                            analysis.interiorNodes + 1))
+          result = mba::Result{analysis.variables, std::move(*form)};
+      }
+    }
+    cached = results.try_emplace(key, std::move(result)).first;
+  }
+  // copy, the folders can add to results while this is emitted
+  return cached->second;
+}
+
+Value* lifterClass::simplifyMBA(Instruction::BinaryOps opcode, Value* LHS,
+                                Value* RHS) {
+  if (mbaSimplifier.emitting)
+    return nullptr;
+  auto analyzed = analyzeMBA(opcode, LHS, RHS);
+  if (!analyzed)
+    return nullptr;
+
+  const mba::Result& result = *analyzed;
+  auto type = cast<IntegerType>(LHS->getType());
+  const uint64_t mask = type->getBitMask();
+  mba::Simplifier::EmitGuard guard(mbaSimplifier);
+
+  Value* simplified = nullptr;
+  const auto& form = result.form;
+  if (form.terms.size() == 1 && form.constant == mask &&
+      form.terms[0].coefficient == mask) {
+    simplified = createNotFolder(
+        emitBitwise(form.terms[0].function, result.variables), "mba-not");
+  } else {
+    if (form.constant)
+      simplified = ConstantInt::get(type, form.constant);
+    for (const auto& term : form.terms) {
+      Value* function = emitBitwise(term.function, result.variables);
+      if (term.coefficient == mask) {
+        simplified =
+            createSubFolder(simplified ? simplified : ConstantInt::get(type, 0),
+                            function, "mba-sub");
+        continue;
+      }
+      if (term.coefficient != 1)
+        function = createMulFolder(
+            function, ConstantInt::get(type, term.coefficient), "mba-mul");
+      simplified = simplified
+                       ? createAddFolder(simplified, function, "mba-add")
+                       : function;
+    }
+    if (!simplified)
+      simplified = ConstantInt::get(type, 0);
+  }
+
+  printvalue(simplified);
+  return simplified;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <cstdint>
+#include <optional>
+#include <tuple>
+
+namespace llvm {
+  class Value;
+}
+
+// linear mixed boolean-arithmetic reduction. an expression that only adds,
+// subtracts and scales bitwise functions of a few variables is decided by
+// its values with every variable set to 0 or 1, so it can be rebuilt from
+// those values in its simplest form.
+namespace mba {
+
+  constexpr unsigned MAX_VARIABLES = 4;
+  constexpr unsigned MAX_NODES = 64;
+
+  // bit k is the function with variable i set to bit i of k
+  using TruthTable = uint16_t;
+
+  struct Term {
+    uint64_t coefficient;
+    TruthTable function; // function of nothing but zeros is 0
+  };
+
+  // constant + sum of coefficient * function
+  struct Form {
+    uint64_t constant = 0;
+    llvm::SmallVector<Term, 4> terms;
+  };
+
+  // how to build a bitwise function: each monomial ands the variables in its
+  // mask, the monomials are then ored or xored together
+  struct Bitwise {
+    bool useOr = false;
+    llvm::SmallVector<uint8_t, 16> monomials;
+  };
+
+  Bitwise decompose(TruthTable function, unsigned variableCount);
+
+  // signature[k] is the expression with variable i = bit i of k. nullopt if
+  // nothing cheaper than originalCost operations exists.
+  std::optional<Form> reduce(llvm::ArrayRef<uint64_t> signature,
+                             unsigned variableCount, unsigned width,
+                             unsigned originalCost);
+
+  struct Result {
+    llvm::SmallVector<llvm::Value*, MAX_VARIABLES> variables;
+    Form form;
+  };
+
+  // one per lifter, results are keyed by the values they were found for so
+  // they go away with the lifter
+  struct Simplifier {
+    using Key = std::tuple<unsigned, llvm::Value*, llvm::Value*>;
+    llvm::DenseMap<Key, std::optional<Result>> results;
+
+    // emitting goes through the folders again, dont recurse into ourselves
+    bool emitting = false;
+    struct EmitGuard {
+      Simplifier& owner;
+      explicit EmitGuard(Simplifier& owner) : owner(owner) {
+        owner.emitting = true;
+      }
+      ~EmitGuard() { owner.emitting = false; }
+    };
+  };
+
+} // namespace mba
@@ -0,0 +1,394 @@
+#define MERGEN_LOG_CATEGORY debugging::LOG_PATH
+#include "includes.h"
+#include "lifterClass.h"
+#include "utils.h"
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/ConstantRange.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/MathExtras.h>
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// opaque predicates are branches whose condition always goes one way but
+// looks like it depends on the input, x * (x + 1) & 1 == 0 and friends.
+// obfuscators stamp the same few shapes everywhere, so whatever we decide
+// from the shape alone is remembered by the shape.
+
+namespace {
+  constexpr unsigned MAX_PREDICATE_NODES = 64;
+  // inputs are enumerated, 2^16 runs of a 64 node program at most
+  constexpr unsigned MAX_ENUMERATED_BITS = 16;
+
+  uint64_t maskFor(const unsigned width) {
+    return width >= 64 ? ~0ULL : (1ULL << width) - 1;
+  }
+
+  // the condition flattened, operands always come before their users
+  struct Step {
+    unsigned opcode = 0; // 0 for leaves and constants
+    CmpInst::Predicate predicate = CmpInst::BAD_ICMP_PREDICATE;
+    unsigned width = 0;
+    std::array<int, 3> operands{-1, -1, -1};
+    uint64_t constant = 0;
+    bool leaf = false;
+  };
+
+  struct PredicateProgram {
+    std::vector<Step> steps;
+    std::vector<unsigned> leaves; // step indices
+    llvm::DenseMap<Value*, int> indices;
+    std::string shape; // canonical form, the cache key
+    bool valid = true;
+
+    bool supported(Instruction* I) {
+      switch (I->getOpcode()) {
+      case Instruction::Add:
+      case Instruction::Sub:
+      case Instruction::Mul:
+      case Instruction::And:
+      case Instruction::Or:
+      case Instruction::Xor:
+      case Instruction::Shl:
+      case Instruction::LShr:
+      case Instruction::AShr:
+      case Instruction::ZExt:
+      case Instruction::SExt:
+      case Instruction::Trunc:
+      case Instruction::Select:
+      case Instruction::ICmp:
+        break;
+      default:
+        return false;
+      }
+      for (auto& operand : I->operands())
+        if (!operand->getType()->isIntegerTy() ||
+            operand->getType()->getIntegerBitWidth() > 64)
+          return false;
+      return true;
+    }
+
+    int add(Value* V) {
+      if (auto it = indices.find(V); it != indices.end()) {
+        shape += "@" + std::to_string(it->second);
+        return it->second;
+      }
+      if (steps.size() >= MAX_PREDICATE_NODES ||
+          V->getType()->getIntegerBitWidth() > 64) {
+        valid = false;
+        return -1;
+      }
+
+      Step step;
+      step.width = V->getType()->getIntegerBitWidth();
+      auto I = dyn_cast<Instruction>(V);
+      if (auto C = dyn_cast<ConstantInt>(V)) {
+        step.constant = C->getZExtValue();
+        shape += "k" + std::to_string(step.width) + ":" +
+                 std::to_string(step.constant);
+      } else if (I && supported(I)) {
+        step.opcode = I->getOpcode();
+        if (auto cmp = dyn_cast<ICmpInst>(I))
+          step.predicate = cmp->getPredicate();
+        shape += "(" + std::to_string(step.opcode) + "." +
+                 std::to_string(step.predicate) + "." +
+                 std::to_string(step.width);
+        for (unsigned i = 0; i < I->getNumOperands(); ++i) {
+          shape += " ";
+          step.operands[i] = add(I->getOperand(i));
+          if (!valid)
+            return -1;
+        }
+        shape += ")";
+      } else {
+        // leaves are named by order of appearance, so the same shape over
+        // different registers gets the same key
+        step.leaf = true;
+        shape += "v" + std::to_string(step.width) + ":" +
+                 std::to_string(leaves.size());
+        leaves.push_back(steps.size());
+      }
+      const int index = steps.size();
+      steps.push_back(step);
+      indices[V] = index;
+      return index;
+    }
+
+    // every value is only tracked in its low `bits` bits
+    uint64_t run(std::vector<uint64_t>& values, const unsigned bits) const {
+      for (unsigned i = 0; i < steps.size(); ++i) {
+        const auto& step = steps[i];
+        if (step.leaf)
+          continue;
+        const uint64_t mask = maskFor(std::min(step.width, bits));
+        if (!step.opcode) {
+          values[i] = step.constant & mask;
+          continue;
+        }
+        const uint64_t a = values[step.operands[0]];
+        uint64_t b = step.operands[1] >= 0 ? values[step.operands[1]] : 0;
+        // constants stay exact, a masked shift amount would be wrong
+        if (step.operands[1] >= 0 && !steps[step.operands[1]].leaf &&
+            !steps[step.operands[1]].opcode)
+          b = steps[step.operands[1]].constant;
+        const unsigned fromWidth =
+            step.operands[0] >= 0 ? steps[step.operands[0]].width : 0;
+        uint64_t result = 0;
+        switch (step.opcode) {
+        case Instruction::Add:
+          result = a + b;
+          break;
+        case Instruction::Sub:
+          result = a - b;
+          break;
+        case Instruction::Mul:
+          result = a * b;
+          break;
+        case Instruction::And:
+          result = a & b;
+          break;
+        case Instruction::Or:
+          result = a | b;
+          break;
+        case Instruction::Xor:
+          result = a ^ b;
+          break;
+        // oversized shifts are poison, the folders make that 0
+        case Instruction::Shl:
+          result = b >= step.width ? 0 : a << b;
+          break;
+        case Instruction::LShr:
+          result = b >= step.width ? 0 : a >> b;
+          break;
+        case Instruction::AShr:
+          result = b >= step.width
+                       ? 0
+                       : static_cast<uint64_t>(
+                             llvm::SignExtend64(a, step.width) >> b);
+          break;
+        case Instruction::ZExt:
+        case Instruction::Trunc:
+          result = a;
+          break;
+        case Instruction::SExt:
+          result = llvm::SignExtend64(a, std::min(fromWidth, bits));
+          break;
+        case Instruction::Select:
+          result = a ? b : values[step.operands[2]];
+          break;
+        case Instruction::ICmp: {
+          const int64_t sa = llvm::SignExtend64(a, fromWidth);
+          const int64_t sb = llvm::SignExtend64(b, fromWidth);
+          switch (step.predicate) {
+          case CmpInst::ICMP_EQ:
+            result = a == b;
+            break;
+          case CmpInst::ICMP_NE:
+            result = a != b;
+            break;
+          case CmpInst::ICMP_UGT:
+            result = a > b;
+            break;
+          case CmpInst::ICMP_UGE:
+            result = a >= b;
+            break;
+          case CmpInst::ICMP_ULT:
+            result = a < b;
+            break;
+          case CmpInst::ICMP_ULE:
+            result = a <= b;
+            break;
+          case CmpInst::ICMP_SGT:
+            result = sa > sb;
+            break;
+          case CmpInst::ICMP_SGE:
+            result = sa >= sb;
+            break;
+          case CmpInst::ICMP_SLT:
+            result = sa < sb;
+            break;
+          case CmpInst::ICMP_SLE:
+            result = sa <= sb;
+            break;
+          default:
+            break;
+          }
+          break;
+        }
+        }
+        values[i] = result & mask;
+      }
+      return values.back();
+    }
+
+    // low bits of the result only depend on low bits of the operands
+    bool lowBitsClosed(const unsigned index, const unsigned bits) const {
+      const auto& step = steps[index];
+      switch (step.opcode) {
+      case 0:
+      case Instruction::Add:
+      case Instruction::Sub:
+      case Instruction::Mul:
+      case Instruction::And:
+      case Instruction::Or:
+      case Instruction::Xor:
+      case Instruction::ZExt:
+      case Instruction::SExt:
+      case Instruction::Trunc:
+        return true;
+      case Instruction::Shl: {
+        // only a constant amount is known in full
+        const auto& amount = steps[step.operands[1]];
+        return !amount.leaf && !amount.opcode;
+      }
+      default:
+        // anything else needs its operands in full
+        if (step.width > bits)
+          return false;
+        for (auto operand : step.operands)
+          if (operand >= 0 && steps[operand].width > bits)
+            return false;
+        return true;
+      }
+    }
+
+    // how many low bits of the compared value the condition looks at
+    unsigned demandedBits() const {
+      const auto& root = steps.back();
+      if (root.opcode == Instruction::Trunc)
+        return root.width;
+      if (root.opcode != Instruction::ICmp ||
+          (root.predicate != CmpInst::ICMP_EQ &&
+           root.predicate != CmpInst::ICMP_NE))
+        return 64;
+      const auto& lhs = steps[root.operands[0]];
+      const auto& rhs = steps[root.operands[1]];
+      if (rhs.leaf || rhs.opcode)
+        return 64;
+      // bits the constant has above the mask have to stay visible
+      const unsigned compared = llvm::Log2_64(rhs.constant | 1) + 1;
+      if (lhs.opcode == Instruction::Trunc)
+        return std::max(lhs.width, compared);
+      if (lhs.opcode == Instruction::And) {
+        const auto& mask = steps[lhs.operands[1]];
+        if (!mask.leaf && !mask.opcode)
+          return std::max(llvm::Log2_64(mask.constant | 1) + 1, compared);
+      }
+      return 64;
+    }
+
+    // runs the program on every input, only when the inputs are small or
+    // the condition only looks at a few low bits of them
+    opaque_info enumerate() const {
+      const unsigned root = steps.size() - 1;
+      unsigned bits = demandedBits();
+      for (unsigned i = 0; i < root && bits < 64; ++i)
+        if (!lowBitsClosed(i, bits))
+          bits = 64;
+
+      unsigned total = 0;
+      for (auto leaf : leaves)
+        total += std::min(steps[leaf].width, bits);
+      if (total > MAX_ENUMERATED_BITS)
+        return NOT_OPAQUE;
+
+      // the root compare itself sees the masked value in full
+      std::vector<uint64_t> values(steps.size());
+      bool seenTrue = false, seenFalse = false;
+      for (uint64_t input = 0; input < (1ULL << total); ++input) {
+        uint64_t rest = input;
+        for (auto leaf : leaves) {
+          const unsigned width = std::min(steps[leaf].width, bits);
+          values[leaf] = rest & maskFor(width);
+          rest >>= width;
+        }
+        if (run(values, bits))
+          seenTrue = true;
+        else
+          seenFalse = true;
+        if (seenTrue && seenFalse)
+          return NOT_OPAQUE;
+      }
+      return seenTrue ? OPAQUE_TRUE : OPAQUE_FALSE;
+    }
+  };
+
+  // verdicts that only depend on the shape, shared by every path
+  std::unordered_map<std::string, opaque_info> opaqueVerdicts;
+
+  opaque_info verdictOf(Value* V) {
+    if (auto C = dyn_cast<ConstantInt>(V))
+      return C->isOne() ? OPAQUE_TRUE : OPAQUE_FALSE;
+    return NOT_OPAQUE;
+  }
+} // namespace
+
+opaque_info lifterClass::classifyPredicate(Value* condition) {
+  if (!condition->getType()->isIntegerTy(1))
+    return NOT_OPAQUE;
+  if (auto verdict = verdictOf(condition))
+    return verdict;
+
+  // facts about these exact values, assumptions and path ranges included
+  auto ctxI = currentContext();
+  auto known = analyzeValueKnownBits(condition, ctxI);
+  if (known.isConstant() && !known.hasConflict())
+    return known.getConstant().isOne() ? OPAQUE_TRUE : OPAQUE_FALSE;
+
+  // icmp can compare pointers too
+  auto cmp = dyn_cast<ICmpInst>(condition);
+  const bool integerCmp =
+      cmp && cmp->getOperand(0)->getType()->isIntegerTy() &&
+      cmp->getOperand(0)->getType()->getIntegerBitWidth() <= 64;
+  if (integerCmp) {
+    auto rangeOf = [&](Value* V) {
+      auto bits = analyzeValueKnownBits(V, ctxI);
+      // conflicting bits mean the path is dead, nothing to learn from them
+      auto range =
+          bits.hasConflict()
+              ? ConstantRange::getFull(bits.getBitWidth())
+              : ConstantRange::fromKnownBits(bits, false);
+      return range.intersectWith(
+          computeConstantRange(V, false, true, nullptr, ctxI, nullptr));
+    };
+    auto L = rangeOf(cmp->getOperand(0));
+    auto R = rangeOf(cmp->getOperand(1));
+    if (L.icmp(cmp->getPredicate(), R))
+      return OPAQUE_TRUE;
+    if (L.icmp(cmp->getInversePredicate(), R))
+      return OPAQUE_FALSE;
+  }
+
+  PredicateProgram program;
+  program.add(condition);
+  if (!program.valid)
+    return NOT_OPAQUE;
+  if (auto it = opaqueVerdicts.find(program.shape);
+      it != opaqueVerdicts.end()) {
+    printvalue2(static_cast<int32_t>(it->second));
+    return it->second;
+  }
+
+  opaque_info verdict = NOT_OPAQUE;
+  // a linear mba difference that reduces to a constant, only the form is
+  // looked at so nothing is emitted
+  if (integerCmp && cmp->isEquality()) {
+    auto difference =
+        analyzeMBA(Instruction::Sub, cmp->getOperand(0), cmp->getOperand(1));
+    if (difference && difference->form.terms.empty()) {
+      const bool equal = difference->form.constant == 0;
+      verdict = equal == (cmp->getPredicate() == CmpInst::ICMP_EQ)
+                    ? OPAQUE_TRUE
+                    : OPAQUE_FALSE;
+    }
+  }
+  if (!verdict)
+    verdict = program.enumerate();
+
+  opaqueVerdicts[program.shape] = verdict;
+  printvalue2(static_cast<int32_t>(verdict));
+  return verdict;
+}
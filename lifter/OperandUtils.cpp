@@ -1,3 +1,4 @@
+#define MERGEN_LOG_CATEGORY debugging::LOG_OPERANDS
 #include "OperandUtils.h"
 #include "lifterClass.h"
 #include "utils.h"
@@ -76,14 +77,13 @@ static void findAffectedValues(Value* Cond, SmallVectorImpl<Value*>& Affected) {
   }
 }
 SimplifyQuery lifterClass::createSimplifyQuery(Instruction* Inst) {
-  // updateDomTree(*fnc);
-  // auto DT = getDomTree();
+  auto DT = getDomTree();
   auto DL = fnc->getParent()->getDataLayout();
   static llvm::TargetLibraryInfoImpl TLIImpl(
       Triple(fnc->getParent()->getTargetTriple()));
   static llvm::TargetLibraryInfo TLI(TLIImpl);
 
-  SimplifyQuery SQ(DL, &TLI, DT, nullptr, Inst, true, true, nullptr);
+  SimplifyQuery SQ(DL, &TLI, DT, nullptr, Inst, true, true, DC);
 
   return SQ;
 }
@@ -104,229 +104,6 @@ bool comesBefore(Instruction* a, Instruction* b, DominatorTree& DT) {
 
 using namespace llvm::PatternMatch;
 
-Value* lifterClass::doPatternMatching(Instruction::BinaryOps const I,
-                                      Value* const op0, Value* const op1) {
-
-  switch (I) {
-  case Instruction::Add: {
-    auto and_by_power = [&](Value* op, ConstantInt*& power) {
-      Value* LHS;
-      return match(op, m_And(m_Value(LHS), m_ConstantInt(power))) &&
-             power->getValue().isPowerOf2();
-    };
-
-    auto shifted_by_power = [&](Value* op, ConstantInt*& ShiftAmount,
-                                Value*& LHS) {
-      return match(op, m_LShr(m_Value(LHS), m_ConstantInt(ShiftAmount)));
-    };
-
-    auto negative_constant_singlebit = [](Value* op, ConstantInt*& ci) {
-      return match(op, m_ConstantInt(ci)) && ci->getValue().isNegative() &&
-             ci->getValue().abs().isPowerOf2();
-    };
-
-    auto matchPattern = [&](Value* op0, Value* op1) -> Value* {
-      ConstantInt *power = nullptr, *ShiftAmount = nullptr, *ci = nullptr;
-      Value* LHS = nullptr;
-
-      if (negative_constant_singlebit(op0, ci)) {
-        if (shifted_by_power(op1, ShiftAmount, LHS)) {
-          if (and_by_power(LHS, power)) {
-            auto diff = power->getValue().logBase2() - ShiftAmount->getValue();
-            printvalue2(power->getValue());
-            printvalue2(ShiftAmount->getValue());
-            printvalue2(ci->getValue());
-            auto math_is_hard =
-                diff.getBoolValue() ? APInt(64, 2) << diff : APInt(64, 1);
-            printvalue2(math_is_hard);
-            printvalue2(ci->getValue() == -(math_is_hard));
-            if (ci->getValue() == -(math_is_hard)) {
-              auto zero =
-                  builder.getIntN(op1->getType()->getIntegerBitWidth(), 0);
-              auto cond = createICMPFolder(llvm::CmpInst::ICMP_EQ, op1, zero);
-              return createSelectFolder(cond, ci, zero);
-            }
-          }
-        }
-      }
-      return nullptr;
-    };
-
-    /*
-    %not-PConst2-9425 = and i64 %realnot-5369619277-, 64 ( 2 ** 6 = 64)
-        %shr-lshr-5368775124- = lshr i64 %not-PConst2-9425, 6
-        %realadd-5369433110- = add i64 -1, %shr-lshr-5368775124- ( - (2 ** 6-6)
-        ;  ( (a & (2**power) ) >> (power-lula) ) - (2**(lula))
-        ;  result = select trunc( (a & (2**power) ) >> (power-lula) ),  0 or
-        -(2**(lula))
-    */
-
-    // Check if the pattern matches with op0 and op1 in both configurations
-    if (auto aaaaa = matchPattern(op0, op1)) {
-      return aaaaa;
-    }
-
-    break;
-  }
-  case Instruction::Or: {
-    Value *A = nullptr, *B = nullptr, *C = nullptr;
-
-    // Match (~A & B) | (A & C)
-    auto handleAndNotPattern = [&](Value* op0, Value* op1) -> bool {
-      return (match(op0, m_And(m_Not(m_Value(A)), m_Value(B))) &&
-              match(op1, m_And(m_Value(A), m_Value(C))));
-    };
-
-    if (handleAndNotPattern(op0, op1) || handleAndNotPattern(op1, op0)) {
-      // This matches (~A & B) | (A & C)
-      // Simplify to A ? C : B
-
-      // if a is 0, select B
-      // if a is -1, select C
-      // then... ?
-      if (auto X_inst = dyn_cast<Instruction>(A)) {
-
-        auto possible_condition = analyzeValueKnownBits(X_inst, X_inst);
-        if (possible_condition.getMaxValue().isAllOnes() &&
-            possible_condition.getMinValue().isZero()) {
-          auto zero = ConstantInt::get(A->getType(), 0);
-          auto cond = createICMPFolder(CmpInst::ICMP_EQ, A, zero);
-          return createSelectFolder(cond, B, C, "selectEZ");
-        }
-      }
-    }
-    break;
-  }
-  case Instruction::And: {
-    // X & ~X
-    Value* X = nullptr;
-    static auto isXAndNotX = [](Value* op0, Value* op1, Value* X) {
-      return (match(op0, m_ZExtOrSelf(m_Not(m_Value(X)))) &&
-              match(op1, m_ZExtOrSelf(m_Specific(X)))) ||
-             (match(op0, m_Trunc(m_Not(m_Value(X)))) &&
-              match(op1, m_Trunc(m_Specific(X))));
-    };
-
-    if (isXAndNotX(op0, op1, X) || isXAndNotX(op1, op0, X)) {
-      auto possibleSimplifyand = ConstantInt::get(op1->getType(), 0);
-      return possibleSimplifyand;
-    }
-    // ~X & ~X
-
-    if (match(op0, m_Not(m_Value(X))) && X == op1)
-      return op0;
-
-    break;
-  }
-  case Instruction::Xor: {
-    // X ^ ~X
-    Value* X = nullptr;
-    static auto isXorNotX = [](Value* op0, Value* op1, Value* X) {
-      return (match(op0, m_ZExtOrSelf(m_Not(m_Value(X)))) &&
-              match(op1, m_ZExtOrSelf(m_Specific(X)))) ||
-             (match(op0, m_Trunc(m_Not(m_Value(X)))) &&
-              match(op1, m_Trunc(m_Specific(X))));
-    };
-
-    if (isXorNotX(op0, op1, X) || isXorNotX(op1, op0, X)) {
-      auto possibleSimplify = ConstantInt::get(op1->getType(), -1);
-      return possibleSimplify;
-    }
-
-    if (match(op0, m_Specific(op1))) {
-      auto possibleSimplify = ConstantInt::get(op1->getType(), 0);
-      return possibleSimplify;
-    }
-
-    Value* A = nullptr;
-    Value* B = nullptr;
-    Value* C = nullptr;
-    Value* D = nullptr;
-    // not
-    auto handleNegXorOr = [&](Value* op0, Value* op1) -> Value* {
-      if (match(op1, m_SpecificInt(-1)) &&
-          match(op0, m_Or(m_Value(A), m_Value(B)))) {
-        Constant* constant_v = nullptr;
-
-        auto createAndNot = [&](Value* C, Constant* constant_v,
-                                const char* suffix) -> Value* {
-          return createAndFolder(
-              C,
-              createXorFolder(constant_v,
-                              Constant::getAllOnesValue(constant_v->getType())),
-              suffix);
-        };
-
-        auto handleNotAOrB = [&](Value* A, Value* B) -> Value* {
-          if (match(A, m_Not(m_Value(C))) && match(B, m_Constant(constant_v))) {
-            // ~(~a | b) -> a & ~b
-            return createAndNot(C, constant_v, "not-PConst-");
-          }
-          return nullptr;
-        };
-
-        auto handleAOrBci = [&](Value* A, Value* B) -> Value* {
-          if (match(A, m_Value(C)) && match(B, m_Constant(constant_v))) {
-            // ~(a | b(ci)) -> ~a & ~b
-            return createAndFolder(
-
-                createXorFolder(C, Constant::getAllOnesValue(C->getType()),
-                                "not_v"),
-                createXorFolder(constant_v, Constant::getAllOnesValue(
-                                                constant_v->getType())),
-                "not-PConst2-");
-          }
-          return nullptr;
-        };
-
-        auto handleNotAOrNotB = [&](Value* A, Value* B) -> Value* {
-          if (match(A, m_Not(m_Value(C))) && match(B, m_Not(m_Value(D)))) {
-            // ~(~a | ~b) -> a & b
-            return createAndFolder(C, D, "not-P1-");
-          }
-          return nullptr;
-        };
-
-        auto matchAndSimplify = [&](Value* A, Value* B) -> Value* {
-          if (Value* result = handleNotAOrB(A, B))
-            return result;
-          if (Value* result = handleAOrBci(A, B))
-            return result;
-          if (Value* result = handleAOrBci(B, A))
-            return result;
-          if (Value* result = handleNotAOrNotB(A, B))
-            return result;
-          if (Value* result = handleNotAOrB(A, B))
-            return result;
-          if (Value* result = handleNotAOrB(B, A))
-            return result;
-          return nullptr;
-        };
-
-        if (Value* result = matchAndSimplify(A, B)) {
-          return result;
-        } else if (Value* result_swap = matchAndSimplify(B, A)) {
-          return result_swap;
-        }
-      }
-
-      return nullptr;
-    };
-
-    if (auto result = handleNegXorOr(op0, op1))
-      return result;
-
-    break;
-  }
-
-  default: {
-    return nullptr;
-  }
-  }
-
-  return nullptr;
-}
-
 KnownBits lifterClass::analyzeValueKnownBits(Value* value, Instruction* ctxI) {
   KnownBits knownBits(64);
   knownBits.resetAll();
@@ -352,7 +129,15 @@ KnownBits lifterClass::analyzeValueKnownBits(Value* value, Instruction* ctxI) {
   auto SQ = createSimplifyQuery(ctxI);
 
   computeKnownBits(value, knownBits, 0, SQ);
-  return knownBits.trunc(value->getType()->getIntegerBitWidth());
+  knownBits = knownBits.trunc(value->getType()->getIntegerBitWidth());
+
+  // ranges the branches taken on this path put on the value
+  if (auto it = pathRanges.find(value); it != pathRanges.end()) {
+    auto fromPath = knownBits.unionWith(it->second.toKnownBits());
+    if (!fromPath.hasConflict())
+      knownBits = fromPath;
+  }
+  return knownBits;
 }
 
 Value* simplifyValue(Value* v, const DataLayout& DL) {
@@ -389,6 +174,18 @@ Value* simplifyValue(Value* v, const DataLayout& DL) {
   return v;
 }
 
+// instruction right before the insert point, analyses that would run on a
+// new instruction run here instead so nothing is created just to be folded.
+// nullptr in an empty block, callers fall back to creating first there so
+// conditions from the incoming branch still apply.
+Instruction* lifterClass::currentContext() {
+  auto block = builder.GetInsertBlock();
+  auto point = builder.GetInsertPoint();
+  if (!block || point == block->begin())
+    return nullptr;
+  return &*std::prev(point);
+}
+
 inline bool isCast(uint8_t opcode) {
   return Instruction::Trunc <= opcode && opcode <= Instruction::AddrSpaceCast;
 };
@@ -516,6 +313,8 @@ Value* lifterClass::getOrCreate(const InstructionKey& key, uint8_t opcode,
     }
   }
 
+  if (trailing())
+    trail.push_back(CacheUndo{opcode, key, cache.lookup(opcode, key)});
   cache.insert(opcode, key, newInstruction);
   return newInstruction;
 }
@@ -558,6 +357,16 @@ Value* lifterClass::createInstruction(unsigned opcode, Value* operand1,
     }
   }
 
+  // constants and the simplifier first, the cache and the builder only if
+  // that doesnt decide it. poison and undef are left to the builder, they
+  // arent a value we can pick for the instruction
+  auto SQ = createSimplifyQuery(currentContext());
+  Value* folded =
+      destType ? simplifyCastInst(opcode, operand1, destType, SQ)
+               : simplifyBinOp(opcode, operand1, operand2, SQ);
+  if (folded && !isa<UndefValue>(folded))
+    return folded;
+
   InstructionKey key;
   if (destType)
     key = InstructionKey(operand1, destType);
@@ -585,19 +394,35 @@ Value* lifterClass::createSelectFolder(Value* C, Value* True, Value* False,
   if (True == False)
     return True;
 
-  auto inst = builder.CreateSelect(C, True, False, Name);
-
-  auto RHSKBSELECT_C = analyzeValueKnownBits(C, dyn_cast<Instruction>(inst));
+  auto knownCondition = [&](Instruction* ctxI) -> Value* {
+    auto RHSKBSELECT_C = analyzeValueKnownBits(C, ctxI);
+    printvalue2(RHSKBSELECT_C);
+    if (!(RHSKBSELECT_C.isUnknown())) {
+      auto constant_cond = RHSKBSELECT_C.getConstant();
+      if (constant_cond.isOne())
+        return True;
+      if (constant_cond.isZero())
+        return False;
+    }
+    return nullptr;
+  };
 
-  printvalue2(RHSKBSELECT_C);
-  if (!(RHSKBSELECT_C.isUnknown())) {
-    auto constant_cond = RHSKBSELECT_C.getConstant();
-    if (constant_cond.isOne())
-      return True;
-    if (constant_cond.isZero())
-      return False;
+  auto ctxI = currentContext();
+  if (ctxI) {
+    if (auto known = knownCondition(ctxI))
+      return known;
+    auto simplified =
+        simplifySelectInst(C, True, False, createSimplifyQuery(ctxI));
+    if (simplified && !isa<UndefValue>(simplified))
+      return simplified;
   }
 
+  auto inst = builder.CreateSelect(C, True, False, Name);
+
+  if (!ctxI)
+    if (auto known = knownCondition(dyn_cast<Instruction>(inst)))
+      return known;
+
   return inst;
 }
 
@@ -873,26 +698,42 @@ Value* lifterClass::folderBinOps(Value* LHS, Value* RHS, const Twine& Name,
     break;
   }
   }
-  // this part analyses if we can simplify the instruction
-  Value* inst;
-  inst = doPatternMatching(opcode, LHS, RHS);
-  if (!inst)
-    inst = createInstruction(opcode, LHS, RHS, nullptr, Name);
-
   // knownbits is recursive, and goes back 5 instructions, ideally it would be
   // not recursive and store the info for all values
   // until then, we just calculate it ourselves
 
   // we can just swap analyzeValueKnownBits with something else later down the
   // road
-  auto LHSKB = analyzeValueKnownBits(LHS, dyn_cast<Instruction>(inst));
-  auto RHSKB = analyzeValueKnownBits(RHS, dyn_cast<Instruction>(inst));
+  auto knownResult = [&](Instruction* ctxI) -> Value* {
+    auto LHSKB = analyzeValueKnownBits(LHS, ctxI);
+    auto RHSKB = analyzeValueKnownBits(RHS, ctxI);
+
+    auto computedBits = computeKnownBitsFromOperation(LHSKB, RHSKB, opcode);
+    if (computedBits.isConstant() && !computedBits.hasConflict())
+      return builder.getIntN(LHS->getType()->getIntegerBitWidth(),
+                             computedBits.getConstant().getZExtValue());
+    return nullptr;
+  };
 
-  auto computedBits = computeKnownBitsFromOperation(LHSKB, RHSKB, opcode);
-  if (computedBits.isConstant() && !computedBits.hasConflict()) {
-    return builder.getIntN(LHS->getType()->getIntegerBitWidth(),
-                           computedBits.getConstant().getZExtValue());
-  }
+  // decided before anything is emitted, otherwise the instruction is left
+  // dead for final_optpass
+  auto ctxI = currentContext();
+  if (ctxI)
+    if (auto known = knownResult(ctxI))
+      return known;
+
+  if (auto simplified = simplifyMBA(opcode, LHS, RHS))
+    return simplified;
+
+  // this part analyses if we can simplify the instruction
+  Value* inst;
+  inst = doPatternMatching(opcode, LHS, RHS);
+  if (!inst)
+    inst = createInstruction(opcode, LHS, RHS, nullptr, Name);
+
+  if (!ctxI)
+    if (auto known = knownResult(dyn_cast<Instruction>(inst)))
+      return known;
 
   return inst;
 }
@@ -908,7 +749,8 @@ Value* lifterClass::createGEPFolder(Type* Type, Value* Base, Value* Address,
   std::vector<Value*> indices;
   indices.push_back(Address);
   auto v = builder.CreateGEP(Type, Base, indices);
-  GEPcache.insert({key, v});
+  if (GEPcache.insert({key, v}).second && trailing())
+    trail.push_back(GEPcacheUndo{key});
   return v;
 }
 
@@ -1049,10 +891,7 @@ Value* lifterClass::createICMPFolder(CmpInst::Predicate P, Value* LHS,
     return patternCheck;
   }
 
-  auto result = builder.CreateICmp(P, LHS, RHS, Name);
-
-  if (auto ctxI = dyn_cast<Instruction>(result)) {
-
+  auto knownResult = [&](Instruction* ctxI) -> Value* {
     KnownBits KnownLHS = analyzeValueKnownBits(LHS, ctxI);
     KnownBits KnownRHS = analyzeValueKnownBits(RHS, ctxI);
 
@@ -1060,14 +899,42 @@ Value* lifterClass::createICMPFolder(CmpInst::Predicate P, Value* LHS,
       return ConstantInt::get(Type::getInt1Ty(builder.getContext()), v.value());
     }
     printvalue2(KnownLHS) printvalue2(KnownRHS);
+    return nullptr;
+  };
+
+  auto ctxI = currentContext();
+  if (ctxI) {
+    auto simplified = simplifyICmpInst(P, LHS, RHS, createSimplifyQuery(ctxI));
+    if (simplified && !isa<UndefValue>(simplified))
+      return simplified;
+    if (auto known = knownResult(ctxI))
+      return known;
   }
 
+  auto result = builder.CreateICmp(P, LHS, RHS, Name);
+
+  if (!ctxI)
+    if (auto resultI = dyn_cast<Instruction>(result))
+      if (auto known = knownResult(resultI))
+        return known;
+
   return result;
 }
 
 // - probably not needed anymore
 Value* lifterClass::createTruncFolder(Value* V, Type* DestTy,
                                       const Twine& Name) {
+  // the low bits of V might be known even if V isnt
+  if (auto ctxI = currentContext()) {
+    KnownBits KnownV = analyzeValueKnownBits(V, ctxI);
+    if (!KnownV.hasConflict() && DestTy->getIntegerBitWidth() > 1 &&
+        KnownV.getBitWidth() >= DestTy->getIntegerBitWidth()) {
+      KnownBits KnownTrunc = KnownV.trunc(DestTy->getIntegerBitWidth());
+      if (KnownTrunc.isConstant())
+        return ConstantInt::get(DestTy, KnownTrunc.getConstant());
+    }
+  }
+
   Value* result =
       createInstruction(Instruction::Trunc, V, nullptr, DestTy, Name);
 
@@ -1148,6 +1015,11 @@ Value* lifterClass::createSExtOrTruncFolder(Value* V, Type* DestTy,
 %extendedValue13 = zext i8 %trunc11 to i64
 %maskedreg14 = and i64 %newreg9, -256
 */
+static uint64_t hashFlag(const Flag flag, const LazyValue& value) {
+  auto [id, v] = value.identity();
+  return llvm::hash_combine(flag, id, v);
+}
+
 void lifterClass::Init_Flags() {
   LLVMContext& context = builder.getContext();
   auto zero = ConstantInt::getSigned(Type::getInt1Ty(context), 0);
@@ -1165,7 +1037,11 @@ void lifterClass::Init_Flags() {
   FlagList[FLAG_OF].set(zero);
 
   FlagList[FLAG_RESERVED1].set(one);
-  Registers[ZYDIS_REGISTER_RFLAGS] = two;
+  Registers.set(ZYDIS_REGISTER_RFLAGS, two);
+
+  flagsHash = 0;
+  for (int flag = FLAG_CF; flag < FLAGS_END; flag++)
+    flagsHash ^= hashFlag((Flag)flag, FlagList[flag]);
 }
 
 Value* lifterClass::setFlag(const Flag flag, Value* newValue) {
@@ -1176,7 +1052,9 @@ Value* lifterClass::setFlag(const Flag flag, Value* newValue) {
       flag == FLAG_DF)
     return nullptr;
 
+  flagsHash ^= hashFlag(flag, FlagList[flag]);
   FlagList[flag].set(newValue); // Set the new value directly
+  flagsHash ^= hashFlag(flag, FlagList[flag]);
   return newValue;
 }
 
@@ -1188,7 +1066,9 @@ void lifterClass::setFlag(const Flag flag,
     return;
 
   // lazy calculation
+  flagsHash ^= hashFlag(flag, FlagList[flag]);
   FlagList[flag].setCalculation(calculation);
+  flagsHash ^= hashFlag(flag, FlagList[flag]);
 }
 
 LazyValue lifterClass::getLazyFlag(const Flag flag) {
@@ -1211,6 +1091,21 @@ Value* TEB;
 void initMemoryAlloc(Value* allocArg) { memoryAlloc = allocArg; }
 Value* getMemory() { return memoryAlloc; }
 
+// no-op while the context discards names, call again after re-enabling them
+void nameRegisterArguments(Function* function) {
+  int zydisRegister = ZYDIS_REGISTER_RAX;
+
+  auto argEnd = function->arg_end();
+  for (auto argIt = function->arg_begin(); argIt != argEnd; ++argIt) {
+    if (std::next(argIt) == argEnd)
+      argIt->setName("memory");
+    else if (std::next(argIt, 2) == argEnd)
+      argIt->setName("TEB");
+    else
+      argIt->setName(ZydisRegisterGetString((ZydisRegister)zydisRegister++));
+  }
+}
+
 void lifterClass::InitRegisters(Function* function, const ZyanU64 rip) {
 
   // rsp
@@ -1219,21 +1114,19 @@ void lifterClass::InitRegisters(Function* function, const ZyanU64 rip) {
   int zydisRegister =
       ZYDIS_REGISTER_RAX; // int because we cant increment ZydisRegister
 
+  nameRegisterArguments(function);
+
   auto argEnd = function->arg_end();
   for (auto argIt = function->arg_begin(); argIt != argEnd; ++argIt) {
 
     Argument* arg = &*argIt;
-    arg->setName(ZydisRegisterGetString((ZydisRegister)zydisRegister));
 
     if (std::next(argIt) == argEnd) {
-      arg->setName("memory");
       memoryAlloc = arg;
     } else if (std::next(argIt, 2) == argEnd) {
-      arg->setName("TEB");
       TEB = arg;
     } else {
-      arg->setName(ZydisRegisterGetString((ZydisRegister)zydisRegister));
-      Registers[(ZydisRegister)zydisRegister] = arg;
+      Registers.set((ZydisRegister)zydisRegister, arg);
       zydisRegister++;
     }
   }
@@ -1248,28 +1141,81 @@ void lifterClass::InitRegisters(Function* function, const ZyanU64 rip) {
 
   auto new_rip = createAddFolder(zero, value);
 
-  Registers[ZYDIS_REGISTER_RIP] = new_rip;
+  Registers.set(ZYDIS_REGISTER_RIP, new_rip);
 
   auto stackvalue = cast<Value>(
       ConstantInt::getSigned(Type::getInt64Ty(context), STACKP_VALUE));
   auto new_stack_pointer = createAddFolder(stackvalue, zero);
 
-  Registers[ZYDIS_REGISTER_RSP] = new_stack_pointer;
+  Registers.set(ZYDIS_REGISTER_RSP, new_stack_pointer);
 
   return;
 }
 
-Value* lifterClass::GetValueFromHighByteRegister(const ZydisRegister reg) {
-
-  Value* fullRegisterValue = Registers[ZydisRegisterGetLargestEnclosing(
-      ZYDIS_MACHINE_MODE_LONG_64, reg)];
-
-  Value* shiftedValue = createLShrFolder(fullRegisterValue, 8, "highreg");
+// bits [start, start + width) of the register, no IR when one slice holds
+// exactly them
+Value* lifterClass::readRegisterSlice(const int index, const unsigned start,
+                                     const unsigned width) {
+  auto type = builder.getIntNTy(width);
+  for (const auto& slice : Registers.vec[index]) {
+    if (slice.start > start || slice.start + slice.width < start + width)
+      continue;
+    Value* value = slice.value;
+    const unsigned shift = slice.shift + start - slice.start;
+    if (shift)
+      value = createLShrFolder(value, shift, "slice");
+    return createZExtOrTruncFolder(value, type, "slice");
+  }
+  // spans slices, the register is put together once and kept that way.
+  // nothing to read from a register that was never set, same as reading
+  // the whole of it
+  Value* whole = materializeRegister(index);
+  if (!whole)
+    return nullptr;
+  if (start)
+    whole = createLShrFolder(whole, start, "slice");
+  return createZExtOrTruncFolder(whole, type, "slice");
+}
 
-  Value* FF = ConstantInt::get(shiftedValue->getType(), 0xff);
-  Value* highByteValue = createAndFolder(shiftedValue, FF, "highByte");
+Value* lifterClass::materializeRegister(const int index) {
+  if (Registers.vec[index].empty())
+    return nullptr;
+  if (auto whole = Registers.whole(index))
+    return whole;
+
+  const unsigned width = Registers.width(index);
+  auto type = builder.getIntNTy(width);
+  Value* result = nullptr;
+  for (const auto& slice : Registers.vec[index]) {
+    Value* part;
+    if (slice.shift == slice.start &&
+        slice.value->getType()->getIntegerBitWidth() == width) {
+      // bits already where they belong, just mask the rest away
+      part = createAndFolder(
+          slice.value,
+          ConstantInt::get(type, APInt::getBitsSet(width, slice.start,
+                                                   slice.start + slice.width)),
+          "slice");
+    } else {
+      part = slice.value;
+      if (slice.shift)
+        part = createLShrFolder(part, slice.shift, "slice");
+      part = createZExtOrTruncFolder(part, builder.getIntNTy(slice.width));
+      part = createZExtFolder(part, type);
+      if (slice.start)
+        part = createShlFolder(part, slice.start, "slice");
+    }
+    result = result ? createOrFolder(result, part, "slices") : part;
+  }
+  Registers.set(index, result);
+  return result;
+}
 
-  return highByteValue;
+Value* lifterClass::GetValueFromHighByteRegister(const ZydisRegister reg) {
+  return readRegisterSlice(
+      Registers.getRegisterIndex(
+          ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, reg)),
+      8, 8);
 }
 
 void lifterClass::SetRFLAGSValue(Value* value) {
@@ -1316,122 +1262,75 @@ Value* lifterClass::GetRegisterValue(const ZydisRegister key) {
     return GetValueFromHighByteRegister(key);
   }
 
-  ZydisRegister newKey =
-      (key != ZYDIS_REGISTER_RFLAGS) && (key != ZYDIS_REGISTER_RIP)
-          ? ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, key)
-          : key;
-
   if (key == ZYDIS_REGISTER_RFLAGS || key == ZYDIS_REGISTER_EFLAGS) {
     return GetRFLAGSValue();
   }
-  /*
-  if (Registers.find(newKey) == Registers.end()) {
-          UNREACHABLE("register not found"); exit(-1);
-  }
-  */
 
-  return Registers[newKey];
+  ZydisRegister newKey =
+      ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, key);
+  const int index = Registers.getRegisterIndex(newKey);
+  if (key == newKey)
+    return materializeRegister(index);
+
+  // sub registers come at their own size, callers resize it anyway
+  return readRegisterSlice(
+      index, 0, ZydisRegisterGetWidth(ZYDIS_MACHINE_MODE_LONG_64, key));
 }
 
 Value* lifterClass::SetValueToHighByteRegister(const ZydisRegister reg,
                                                Value* value) {
-  LLVMContext& context = builder.getContext();
-  int shiftValue = 8;
-
   ZydisRegister fullRegKey =
       ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, reg);
-  Value* fullRegisterValue = Registers[fullRegKey];
-
-  Value* eightBitValue = createAndFolder(
-      value, ConstantInt::get(value->getType(), 0xFF), "eight-bit");
-  Value* shiftedValue = createShlFolder(
-      eightBitValue, ConstantInt::get(value->getType(), shiftValue), "shl");
-
-  Value* mask =
-      ConstantInt::get(Type::getInt64Ty(context), ~(0xFF << shiftValue));
-  Value* clearedRegister =
-      createAndFolder(fullRegisterValue, mask, "clear-reg");
-
-  shiftedValue = createZExtFolder(shiftedValue, fullRegisterValue->getType());
-
-  Value* newRegisterValue =
-      createOrFolder(clearedRegister, shiftedValue, "high_byte");
-
-  return newRegisterValue;
+  value = createZExtOrTruncFolder(value, builder.getInt8Ty(), "high_byte");
+  Registers.setSlice(Registers.getRegisterIndex(fullRegKey), 8, value);
+  return value;
 }
 
 Value* lifterClass::SetValueToSubRegister_8b(const ZydisRegister reg,
                                              Value* value) {
-  LLVMContext& context = builder.getContext();
-  ZydisRegister fullRegKey = ZydisRegisterGetLargestEnclosing(
-      ZYDIS_MACHINE_MODE_LONG_64, static_cast<ZydisRegister>(reg));
-  Value* fullRegisterValue = Registers[fullRegKey];
-  fullRegisterValue =
-      createZExtOrTruncFolder(fullRegisterValue, Type::getInt64Ty(context));
-
-  Value* extendedValue =
-      createZExtFolder(value, Type::getInt64Ty(context), "extendedValue");
-
-  bool isHighByteReg = (reg == ZYDIS_REGISTER_AH || reg == ZYDIS_REGISTER_CH ||
-                        reg == ZYDIS_REGISTER_DH || reg == ZYDIS_REGISTER_BH);
-
-  uint64_t mask = isHighByteReg ? 0xFFFFFFFFFFFF00FFULL : 0xFFFFFFFFFFFFFF00ULL;
-
-  Value* maskValue = ConstantInt::get(Type::getInt64Ty(context), mask);
-  Value* maskedFullReg =
-      createAndFolder(fullRegisterValue, maskValue, "maskedreg");
-
-  if (isHighByteReg) {
-    extendedValue = createShlFolder(extendedValue, 8, "shiftedValue");
-  }
-
-  Value* updatedReg = createOrFolder(maskedFullReg, extendedValue, "newreg");
-
-  printvalue(fullRegisterValue) printvalue(maskValue) printvalue(maskedFullReg)
-      printvalue(extendedValue) printvalue(updatedReg);
+  if (reg == ZYDIS_REGISTER_AH || reg == ZYDIS_REGISTER_CH ||
+      reg == ZYDIS_REGISTER_DH || reg == ZYDIS_REGISTER_BH)
+    return SetValueToHighByteRegister(reg, value);
 
-  Registers[fullRegKey] = updatedReg;
-
-  return updatedReg;
+  ZydisRegister fullRegKey =
+      ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, reg);
+  value = createZExtOrTruncFolder(value, builder.getInt8Ty(), "low_byte");
+  printvalue(value);
+  Registers.setSlice(Registers.getRegisterIndex(fullRegKey), 0, value);
+  return value;
 }
 
 Value* lifterClass::SetValueToSubRegister_16b(const ZydisRegister reg,
                                               Value* value) {
-
-  ZydisRegister fullRegKey = ZydisRegisterGetLargestEnclosing(
-      ZYDIS_MACHINE_MODE_LONG_64, (ZydisRegister)reg);
-  Value* fullRegisterValue = Registers[fullRegKey];
-
-  Value* last4cleared =
-      ConstantInt::get(fullRegisterValue->getType(), 0xFFFFFFFFFFFF0000);
-  Value* maskedFullReg =
-      createAndFolder(fullRegisterValue, last4cleared, "maskedreg");
-  value = createZExtFolder(value, fullRegisterValue->getType());
-
-  Value* updatedReg = createOrFolder(maskedFullReg, value, "newreg");
-  printvalue(updatedReg);
-  return updatedReg;
+  ZydisRegister fullRegKey =
+      ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, reg);
+  value = createZExtOrTruncFolder(value, builder.getInt16Ty(), "word");
+  printvalue(value);
+  Registers.setSlice(Registers.getRegisterIndex(fullRegKey), 0, value);
+  return value;
 }
 
 void lifterClass::SetRegisterValue(const ZydisRegister key, Value* value) {
-  if ((key >= ZYDIS_REGISTER_AL) && (key <= ZYDIS_REGISTER_R15B)) {
-    value = SetValueToSubRegister_8b(key, value);
+  if (key == ZYDIS_REGISTER_RFLAGS) {
+    SetRFLAGSValue(value);
+    return;
   }
 
-  if (((key >= ZYDIS_REGISTER_AX) && (key <= ZYDIS_REGISTER_R15W))) {
-    value = SetValueToSubRegister_16b(key, value);
+  if ((key >= ZYDIS_REGISTER_AL) && (key <= ZYDIS_REGISTER_R15B)) {
+    SetValueToSubRegister_8b(key, value);
+    return;
   }
 
-  if (key == ZYDIS_REGISTER_RFLAGS) {
-    SetRFLAGSValue(value);
+  if (((key >= ZYDIS_REGISTER_AX) && (key <= ZYDIS_REGISTER_R15W))) {
+    SetValueToSubRegister_16b(key, value);
     return;
   }
 
   ZydisRegister newKey =
-      (key != ZYDIS_REGISTER_RFLAGS) && (key != ZYDIS_REGISTER_RIP)
+      (key != ZYDIS_REGISTER_RIP)
           ? ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, key)
           : key;
-  Registers[newKey] = value;
+  Registers.set(newKey, value);
 }
 
 Value* lifterClass::GetEffectiveAddress(const ZydisDecodedOperand& op,
@@ -1498,7 +1397,7 @@ Value* ConvertIntToPTR(IRBuilder<>& builder, Value* effectiveAddress) {
 }
 
 Value* lifterClass::GetOperandValue(const ZydisDecodedOperand& op,
-                                    int possiblesize, const string& address) {
+                                    int possiblesize, const Twine& address) {
   LLVMContext& context = builder.getContext();
   auto type = Type::getIntNTy(context, possiblesize);
 
@@ -1601,7 +1500,7 @@ Value* lifterClass::GetOperandValue(const ZydisDecodedOperand& op,
 }
 
 Value* lifterClass::SetOperandValue(const ZydisDecodedOperand& op, Value* value,
-                                    const string& address) {
+                                    const Twine& address) {
   LLVMContext& context = builder.getContext();
   value = simplifyValue(
       value,
@@ -1706,7 +1605,7 @@ vector<Value*> lifterClass::GetRFLAGS() {
 }
 
 void lifterClass::pushFlags(const vector<Value*>& value,
-                            const string& address) {
+                            const Twine& address) {
   LLVMContext& context = builder.getContext();
 
   auto rsp = GetRegisterValue(ZYDIS_REGISTER_RSP);
@@ -1,5 +1,6 @@
 #pragma once
 #include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Value.h>
@@ -9,6 +10,8 @@ llvm::Value* simplifyValue(llvm::Value* v, const llvm::DataLayout& DL);
 
 llvm::Value* getMemory();
 
+void nameRegisterArguments(llvm::Function* function);
+
 llvm::Value* ConvertIntToPTR(llvm::IRBuilder<>& builder,
                              llvm::Value* effectiveAddress);
 
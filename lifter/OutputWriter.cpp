@@ -0,0 +1,171 @@
+#include "OutputWriter.h"
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/Compression.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace outputwriter {
+
+  Config& config() {
+    static Config cfg;
+    return cfg;
+  }
+
+  bool setEmit(const std::string& value) {
+    if (value == "ll")
+      config().emit = EmitKind::LL;
+    else if (value == "bc")
+      config().emit = EmitKind::BC;
+    else if (value == "none")
+      config().emit = EmitKind::None;
+    else
+      return false;
+    return true;
+  }
+
+  bool setCompression(const std::string& value) {
+    if (value == "none")
+      config().compression = Compression::None;
+    else if (value == "zlib")
+      config().compression = Compression::Zlib;
+    else if (value == "zstd")
+      config().compression = Compression::Zstd;
+    else
+      return false;
+
+    if (config().compression == Compression::None)
+      return true;
+
+    const auto format = config().compression == Compression::Zstd
+                            ? llvm::compression::Format::Zstd
+                            : llvm::compression::Format::Zlib;
+    if (const char* reason =
+            llvm::compression::getReasonIfUnsupported(format)) {
+      llvm::errs() << "compression unavailable: " << reason
+                   << ", writing uncompressed output\n";
+      config().compression = Compression::None;
+    }
+    return true;
+  }
+
+  namespace {
+    std::vector<std::thread> pendingWrites;
+    std::mutex errorLock;
+
+    std::string fileName(const std::string& baseName) {
+      std::string name =
+          baseName + (config().emit == EmitKind::BC ? ".bc" : ".ll");
+      switch (config().compression) {
+      case Compression::Zlib:
+        return name + ".zz";
+      case Compression::Zstd:
+        return name + ".zst";
+      default:
+        return name;
+      }
+    }
+
+    // any failed write makes waitForWrites report failure
+    std::atomic<bool> writeFailed{false};
+
+    void reportFailure(const std::string& name, const std::string& reason) {
+      std::lock_guard<std::mutex> lock(errorLock);
+      llvm::errs() << "Error writing " << name << ": " << reason << "\n";
+      writeFailed = true;
+    }
+
+    // compress() has no error result, it asserts or reports a bad alloc.
+    // decoding it again to check would double the peak memory on big
+    // modules, so whatever it gives back is written.
+    void compress(llvm::ArrayRef<uint8_t> bytes,
+                  llvm::SmallVectorImpl<uint8_t>& compressed) {
+      const auto format = config().compression == Compression::Zstd
+                              ? llvm::compression::Format::Zstd
+                              : llvm::compression::Format::Zlib;
+      llvm::compression::compress(llvm::compression::Params(format), bytes,
+                                  compressed);
+    }
+
+    void writeBytes(const std::string& name, llvm::ArrayRef<uint8_t> bytes) {
+      llvm::SmallVector<uint8_t, 0> compressed;
+      if (config().compression != Compression::None) {
+        compress(bytes, compressed);
+        bytes = compressed;
+      }
+
+      std::error_code EC;
+      llvm::raw_fd_ostream OS(name, EC);
+      if (EC) {
+        reportFailure(name, EC.message());
+        return;
+      }
+      OS.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+      OS.close();
+      if (OS.has_error()) {
+        reportFailure(name, OS.error().message());
+        OS.clear_error();
+        // dont leave a truncated file that looks like valid output
+        llvm::sys::fs::remove(name);
+      }
+    }
+
+    // runs on the writer thread, owns everything it touches
+    void finishWrite(std::string name,
+                     std::unique_ptr<llvm::SmallVector<char, 0>> bitcode) {
+      if (config().emit == EmitKind::BC) {
+        writeBytes(name, llvm::arrayRefFromStringRef(llvm::StringRef(
+                             bitcode->data(), bitcode->size())));
+        return;
+      }
+
+      // textual IR is printed from a private context so the lifter can keep
+      // mutating the original module meanwhile
+      llvm::LLVMContext context;
+      auto buffer = llvm::MemoryBufferRef(
+          llvm::StringRef(bitcode->data(), bitcode->size()), name);
+      auto parsed = llvm::parseBitcodeFile(buffer, context);
+      if (!parsed) {
+        reportFailure(name, "reading back bitcode: " +
+                                llvm::toString(parsed.takeError()));
+        return;
+      }
+
+      std::string text;
+      llvm::raw_string_ostream OS(text);
+      (*parsed)->print(OS, nullptr);
+      OS.flush();
+      writeBytes(name, llvm::arrayRefFromStringRef(text));
+    }
+  } // namespace
+
+  void writeModuleAsync(const llvm::Module& M, const std::string& baseName) {
+    if (config().emit == EmitKind::None)
+      return;
+
+    auto bitcode = std::make_unique<llvm::SmallVector<char, 0>>();
+    {
+      llvm::raw_svector_ostream OS(*bitcode);
+      llvm::WriteBitcodeToFile(M, OS);
+    }
+
+    pendingWrites.emplace_back(finishWrite, fileName(baseName),
+                               std::move(bitcode));
+  }
+
+  bool waitForWrites() {
+    for (auto& writer : pendingWrites)
+      writer.join();
+    pendingWrites.clear();
+    return !writeFailed.exchange(false);
+  }
+
+} // namespace outputwriter
@@ -0,0 +1,30 @@
+#pragma once
+#include <llvm/IR/Module.h>
+#include <string>
+
+namespace outputwriter {
+
+  enum class EmitKind { LL, BC, None };
+  enum class Compression { None, Zlib, Zstd };
+
+  struct Config {
+    EmitKind emit = EmitKind::LL;
+    Compression compression = Compression::None;
+    bool dumpUnoptimized = true;
+  };
+
+  Config& config();
+
+  bool setEmit(const std::string& value);
+  bool setCompression(const std::string& value);
+
+  // serializes the module to bitcode on the calling thread, printing /
+  // compressing / writing happens on a background thread. baseName is the
+  // file name without extension, extension is picked from the config.
+  void writeModuleAsync(const llvm::Module& M, const std::string& baseName);
+
+  // blocks until every pending write is on disk, false if any of them failed
+  // to compress or write
+  bool waitForWrites();
+
+} // namespace outputwriter
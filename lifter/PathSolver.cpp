@@ -1,17 +1,23 @@
+#define MERGEN_LOG_CATEGORY debugging::LOG_PATH
 #include "CustomPasses.hpp"
 #include "OperandUtils.h"
 #include "lifterClass.h"
 #include "utils.h"
 #include <iostream>
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/PatternMatch.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/Casting.h>
 
+using namespace llvm::PatternMatch;
+
 // simplify Users with BFS
 // because =>
 // x = add a, b
@@ -40,6 +46,511 @@ PATH_info getConstraintVal(llvm::Function* function, Value* constraint,
   return result;
 }
 
+// remember what the branch we just took says about its condition, and what
+// that implies for the values compared in it
+void lifterClass::recordPathCondition(Value* condition, bool taken) {
+  auto inst = dyn_cast<Instruction>(condition);
+  if (!inst)
+    return;
+  setAssumption(inst, APInt(1, taken));
+  pathConditions.push_back({condition, taken});
+
+  // a && b taken means both hold, a || b not taken means neither does
+  Value *A, *B;
+  if ((taken && match(condition, m_LogicalAnd(m_Value(A), m_Value(B)))) ||
+      (!taken && match(condition, m_LogicalOr(m_Value(A), m_Value(B))))) {
+    recordPathCondition(A, taken);
+    recordPathCondition(B, taken);
+    return;
+  }
+
+  ICmpInst::Predicate pred;
+  Value* X;
+  ConstantInt* C;
+  if (!match(condition, m_ICmp(pred, m_Value(X), m_ConstantInt(C))))
+    return;
+  if (!taken)
+    pred = ICmpInst::getInversePredicate(pred);
+
+  auto range = ConstantRange::makeExactICmpRegion(pred, C->getValue());
+  if (trailing()) {
+    auto old = pathRanges.find(X);
+    trail.push_back(RangeUndo{X, old != pathRanges.end()
+                                     ? std::optional(old->second)
+                                     : std::nullopt});
+  }
+  auto [it, inserted] = pathRanges.try_emplace(X, range);
+  if (!inserted)
+    it->second = it->second.intersectWith(range);
+
+  auto XInst = dyn_cast<Instruction>(X);
+  if (const APInt* single = it->second.getSingleElement(); single && XInst)
+    setAssumption(XInst, *single);
+}
+
+void lifterClass::setAssumption(Instruction* inst, const APInt& value) {
+  if (trailing()) {
+    auto it = assumptions.find(inst);
+    trail.push_back(AssumptionUndo{inst, it != assumptions.end()
+                                             ? std::optional(it->second)
+                                             : std::nullopt});
+  }
+  assumptions[inst] = value;
+}
+
+// the path splits on condition: a new path takes forked with it true, this
+// one keeps blockInfo with it false. with --backtrack there is no new path,
+// this one takes forked first and the other side waits as a fork point
+void lifterClass::forkPath(const BBInfo& forked, Value* condition) {
+  if (forksByBacktracking()) {
+    pushForkPoint(blockInfo, condition, false);
+    blockInfo = forked;
+    recordPathCondition(condition, true);
+    return;
+  }
+
+  lifterClass* newlifter = new lifterClass(*this);
+  newlifter->blockInfo = forked;
+  newlifter->recordPathCondition(condition, true);
+  lifters.push_back(newlifter);
+
+  recordPathCondition(condition, false);
+}
+
+// a path per case with its condition true, this one keeps blockInfo with
+// every condition false. with --backtrack the cases all wait on the state
+// from before the split, so none of them sees another case's condition
+void lifterClass::forkCases(
+    llvm::ArrayRef<std::pair<BBInfo, Value*>> cases) {
+  if (!forksByBacktracking()) {
+    for (const auto& [forked, condition] : cases)
+      forkPath(forked, condition);
+    return;
+  }
+  for (const auto& [forked, condition] : cases)
+    pushForkPoint(forked, condition, true);
+  for (const auto& [forked, condition] : cases)
+    recordPathCondition(condition, false);
+}
+
+bool lifterClass::forksByBacktracking() const {
+  const auto& cfg = explorer::config();
+  return cfg.backtrack && cfg.strategy == explorer::Strategy::DFS &&
+         !cfg.mergeStates;
+}
+
+void lifterClass::pushForkPoint(const BBInfo& resume, Value* condition,
+                                const bool taken) {
+  forkPoints.push_back({resume, condition, taken, trail.size(),
+                        pathConditions.size(), memInfos.size(), counter,
+                        bufferHash, flagsHash, FlagList, Registers,
+                        symbolicStores, writes});
+}
+
+// undoes everything since the newest fork point and takes its other side
+bool lifterClass::backtrack() {
+  if (forkPoints.empty())
+    return false;
+  ForkPoint point = std::move(forkPoints.back());
+  forkPoints.pop_back();
+
+  while (trail.size() > point.trailSize) {
+    auto& entry = trail.back();
+    if (auto undo = std::get_if<BufferUndo>(&entry)) {
+      if (undo->old)
+        buffer[undo->address] = *undo->old;
+      else
+        buffer.erase(undo->address);
+    } else if (auto undo = std::get_if<AssumptionUndo>(&entry)) {
+      if (undo->old)
+        assumptions[undo->inst] = *undo->old;
+      else
+        assumptions.erase(undo->inst);
+    } else if (auto undo = std::get_if<RangeUndo>(&entry)) {
+      if (undo->old)
+        pathRanges.insert_or_assign(undo->value, *undo->old);
+      else
+        pathRanges.erase(undo->value);
+    } else if (auto undo = std::get_if<CacheUndo>(&entry)) {
+      if (undo->old)
+        cache.insert(undo->opcode, undo->key, undo->old);
+      else
+        cache.erase(undo->opcode, undo->key);
+    } else {
+      GEPcache.erase(std::get<GEPcacheUndo>(entry).key);
+    }
+    trail.pop_back();
+  }
+
+  pathConditions.resize(point.pathConditionCount);
+  if (solverAsserted > pathConditions.size())
+    solverBackend.reset();
+  if (sliceAsserted.size() > pathConditions.size()) {
+    sliceSolver.reset();
+    sliceAsserted.clear();
+  }
+  memInfos.resize(point.memInfoCount);
+  counter = point.counter;
+  bufferHash = point.bufferHash;
+  flagsHash = point.flagsHash;
+  FlagList = std::move(point.flags);
+  Registers = point.registers;
+  symbolicStores = std::move(point.symbolicStores);
+  writes = std::move(point.writes);
+
+  run = 0;
+  finished = 0;
+  isUnreachable = 0;
+  blockInfo = point.resume;
+  recordPathCondition(point.condition, point.taken);
+  return true;
+}
+
+// true/false if the conditions of the branches we took decide it
+std::optional<bool> lifterClass::evaluateUnderPathConditions(Value* condition) {
+  if (auto inst = dyn_cast<Instruction>(condition)) {
+    if (auto it = assumptions.find(inst); it != assumptions.end())
+      return !it->second.isZero();
+  }
+
+  ICmpInst::Predicate pred;
+  Value* X;
+  ConstantInt* C;
+  if (match(condition, m_ICmp(pred, m_Value(X), m_ConstantInt(C)))) {
+    if (auto it = pathRanges.find(X); it != pathRanges.end()) {
+      ConstantRange other(C->getValue());
+      if (it->second.icmp(pred, other))
+        return true;
+      if (it->second.icmp(ICmpInst::getInversePredicate(pred), other))
+        return false;
+    }
+  }
+
+  // newest conditions are the most likely to be related, dont look too far
+  const auto& DL = fnc->getParent()->getDataLayout();
+  unsigned checked = 0;
+  for (auto it = pathConditions.rbegin();
+       it != pathConditions.rend() && checked < 64; ++it, ++checked) {
+    if (auto implied =
+            isImpliedCondition(it->first, condition, DL, it->second))
+      return implied;
+  }
+  return std::nullopt;
+}
+
+namespace explorer {
+
+  Config& config() {
+    static Config cfg;
+    return cfg;
+  }
+
+  bool setStrategy(const std::string& value) {
+    if (value == "dfs")
+      config().strategy = Strategy::DFS;
+    else if (value == "bfs")
+      config().strategy = Strategy::BFS;
+    else if (value == "return-first")
+      config().strategy = Strategy::ReturnFirst;
+    else if (value == "novelty")
+      config().strategy = Strategy::Novelty;
+    else
+      return false;
+    return true;
+  }
+
+  static bool parseLimit(const std::string& value, uint64_t& limit) {
+    return !StringRef(value).getAsInteger(10, limit);
+  }
+
+  bool setMaxPathInstructions(const std::string& value) {
+    return parseLimit(value, config().maxPathInstructions);
+  }
+
+  bool setMaxPaths(const std::string& value) {
+    return parseLimit(value, config().maxPaths);
+  }
+
+  bool setTimeout(const std::string& value) {
+    return parseLimit(value, config().timeoutSeconds);
+  }
+
+} // namespace explorer
+
+// ends the path where it is, the address we would have continued from is
+// passed along so the output shows where lifting stopped
+void lifterClass::closeUnresolved() {
+  Function* unresolved = cast<Function>(
+      fnc->getParent()
+          ->getOrInsertFunction("unresolved_path", fnc->getReturnType(),
+                                builder.getInt64Ty())
+          .getCallee());
+  builder.CreateRet(builder.CreateCall(
+      unresolved, {builder.getInt64(blockInfo.runtime_address)}));
+  run = 0;
+  finished = 1;
+}
+
+// both paths wait at the start of an empty block for the same address and
+// agree on rsp, so their memory lines up byte by byte
+bool lifterClass::canMergeWith(const lifterClass& other) const {
+  if (finished || other.finished ||
+      blockInfo.runtime_address != other.blockInfo.runtime_address ||
+      blockInfo.block == other.blockInfo.block ||
+      !blockInfo.block->empty() || !other.blockInfo.block->empty())
+    return false;
+
+  for (size_t i = 0; i < Registers.vec.size(); ++i)
+    if (Registers.vec[i].empty() != other.Registers.vec[i].empty())
+      return false;
+  auto rsp = Registers.whole(RegisterManager::RSP_);
+  return rsp && rsp == other.Registers.whole(RegisterManager::RSP_);
+}
+
+// other branches into a new block together with this path, every register,
+// flag and memory byte that differs becomes a phi. other can be deleted after.
+// returns false without touching the IR when the states cant be joined.
+bool lifterClass::mergeWith(lifterClass& other) {
+  // registers must agree on their type before anything is emitted, flags are
+  // i1 and memory runs are sized the same on both sides
+  for (size_t i = 0; i < Registers.vec.size(); ++i) {
+    auto typeOf = [&](const lifterClass& side) -> Type* {
+      if (side.Registers.vec[i].empty())
+        return nullptr;
+      if (auto whole = side.Registers.whole(i))
+        return whole->getType();
+      return builder.getIntNTy(side.Registers.width(i));
+    };
+    if (typeOf(*this) != typeOf(other))
+      return false;
+  }
+
+  // bytes that differ, grouped in runs of at most 8
+  std::set<uint64_t> differing;
+  for (const auto& [address, ref] : buffer) {
+    auto it = other.buffer.find(address);
+    if (it == other.buffer.end() || it->second.value != ref.value ||
+        it->second.byteOffset != ref.byteOffset)
+      differing.insert(address);
+  }
+  for (const auto& [address, ref] : other.buffer)
+    if (!buffer.contains(address))
+      differing.insert(address);
+
+  std::vector<std::pair<uint64_t, uint8_t>> runs;
+  for (auto address : differing) {
+    if (!runs.empty() && runs.back().second < 8 &&
+        runs.back().first + runs.back().second == address)
+      ++runs.back().second;
+    else
+      runs.push_back({address, 1});
+  }
+
+  // registers, then flags, then memory runs
+  auto snapshot = [&](lifterClass& side) {
+    builder.SetInsertPoint(side.blockInfo.block);
+    std::vector<Value*> values;
+    for (size_t i = 0; i < side.Registers.vec.size(); ++i)
+      values.push_back(side.materializeRegister(i));
+    for (int flag = FLAG_CF; flag < FLAGS_END; flag++) {
+      auto value = side.getFlag((Flag)flag);
+      // lazy flags are not truncated on set
+      if (!value->getType()->isIntegerTy(1))
+        value = side.createTruncFolder(value, builder.getInt1Ty());
+      values.push_back(value);
+    }
+    for (auto [start, size] : runs) {
+      auto type = builder.getIntNTy(size * 8);
+      LazyValue original([&side, start, type]() -> Value* {
+        auto ptr = side.builder.CreateGEP(side.builder.getInt8Ty(),
+                                          getMemory(),
+                                          side.builder.getInt64(start));
+        return side.builder.CreateLoad(type, ptr);
+      });
+      values.push_back(side.retrieveCombinedValue(start, size, original));
+    }
+    return values;
+  };
+
+  auto mine = snapshot(*this);
+  auto theirs = snapshot(other);
+
+  auto myBlock = blockInfo.block;
+  auto otherBlock = other.blockInfo.block;
+  auto merged = BasicBlock::Create(builder.getContext(), "merge",
+                                   myBlock->getParent());
+  builder.SetInsertPoint(myBlock);
+  createBr(merged);
+  builder.SetInsertPoint(otherBlock);
+  createBr(merged);
+  builder.SetInsertPoint(merged);
+
+  auto join = [&](Value* a, Value* b) -> Value* {
+    if (a == b)
+      return a;
+    auto phi = builder.CreatePHI(a->getType(), 2);
+    phi->addIncoming(a, myBlock);
+    phi->addIncoming(b, otherBlock);
+    return phi;
+  };
+
+  size_t i = 0;
+  for (; i < Registers.vec.size(); ++i)
+    if (mine[i])
+      Registers.set(i, join(mine[i], theirs[i]));
+  for (int flag = FLAG_CF; flag < FLAGS_END; flag++, i++)
+    setFlag((Flag)flag, join(mine[i], theirs[i]));
+  for (auto [start, size] : runs) {
+    addValueReference(join(mine[i], theirs[i]), start);
+    ++i;
+  }
+
+  // only what holds on both paths survives
+  DenseMap<Instruction*, APInt> commonAssumptions;
+  for (const auto& [inst, value] : assumptions) {
+    auto it = other.assumptions.find(inst);
+    if (it != other.assumptions.end() &&
+        it->second.getBitWidth() == value.getBitWidth() && it->second == value)
+      commonAssumptions[inst] = value;
+  }
+  assumptions = std::move(commonAssumptions);
+
+  size_t commonPrefix = 0;
+  while (commonPrefix < pathConditions.size() &&
+         commonPrefix < other.pathConditions.size() &&
+         pathConditions[commonPrefix] == other.pathConditions[commonPrefix])
+    ++commonPrefix;
+  pathConditions.resize(commonPrefix);
+  // it still holds the conditions that were just dropped
+  solverBackend.reset();
+  sliceSolver.reset();
+  sliceAsserted.clear();
+
+  DenseMap<Value*, ConstantRange> commonRanges;
+  for (const auto& [value, range] : pathRanges) {
+    auto it = other.pathRanges.find(value);
+    if (it != other.pathRanges.end())
+      commonRanges.insert({value, range.unionWith(it->second)});
+  }
+  pathRanges = std::move(commonRanges);
+
+  // cached values were built in blocks that dont dominate the merge block
+  symbolicStores.clear();
+  cache = InstructionCache();
+  mbaSimplifier.results.clear();
+  GEPcache.clear();
+  writes.merge(other.writes);
+  counter = std::max(counter, other.counter);
+  rehashBuffer();
+
+  // both histories share the part before the fork, keep the rest of theirs
+  auto appendMissing = [](auto& into, const auto& from) {
+    SmallPtrSet<const void*, 32> seen(into.begin(), into.end());
+    for (auto entry : from)
+      if (seen.insert(entry).second)
+        into.push_back(entry);
+  };
+  appendMissing(memInfos, other.memInfos);
+  appendMissing(BIlist, other.BIlist);
+
+  blockInfo.block = merged;
+  return true;
+}
+
+// registers, flags and memory. all three are kept up to date on every write,
+// lazy flags go in by their calculation so nothing is forced here
+uint64_t lifterClass::stateHash() const {
+  return llvm::hash_combine(bufferHash, Registers.hash, flagsHash);
+}
+
+namespace {
+  struct VisitedState {
+    BasicBlock* block;
+    // the state itself, a matching hash alone is not enough
+    RegisterManager registers;
+    std::array<std::pair<uint64_t, Value*>, FLAGS_END> flags;
+    DenseMap<uint64_t, ValueByteReference> buffer;
+    // facts the code in block was lifted under
+    DenseMap<Instruction*, APInt> assumptions;
+    DenseMap<Value*, ConstantRange> pathRanges;
+  };
+
+  std::map<std::pair<uint64_t, uint64_t>, std::vector<VisitedState>>
+      visitedStates;
+
+  // bytes without a value are the same as missing ones
+  bool sameBuffer(const DenseMap<uint64_t, ValueByteReference>& a,
+                  const DenseMap<uint64_t, ValueByteReference>& b) {
+    auto live = [](const auto& buffer) {
+      return llvm::count_if(buffer,
+                            [](const auto& entry) { return entry.second.value; });
+    };
+    if (live(a) != live(b))
+      return false;
+    for (const auto& [address, ref] : a) {
+      if (!ref.value)
+        continue;
+      auto it = b.find(address);
+      if (it == b.end() || it->second.value != ref.value ||
+          it->second.byteOffset != ref.byteOffset)
+        return false;
+    }
+    return true;
+  }
+} // namespace
+
+// blocks of the previous function are gone
+void lifterClass::forgetVisitedStates() { visitedStates.clear(); }
+
+// an earlier path started lifting this address from the same state. its
+// code is reused if everything it assumed also holds here, otherwise this
+// state gets recorded for the paths after us.
+bool lifterClass::joinVisitedState() {
+  builder.SetInsertPoint(blockInfo.block);
+  auto& candidates =
+      visitedStates[{blockInfo.runtime_address, stateHash()}];
+
+  std::array<std::pair<uint64_t, Value*>, FLAGS_END> flags;
+  for (int flag = FLAG_CF; flag < FLAGS_END; flag++)
+    flags[flag] = FlagList[flag].identity();
+
+  auto holdsHere = [&](const VisitedState& visited) {
+    if (visited.flags != flags || !visited.registers.sameSlices(Registers) ||
+        !sameBuffer(visited.buffer, buffer))
+      return false;
+    for (const auto& [inst, value] : visited.assumptions) {
+      auto it = assumptions.find(inst);
+      if (it == assumptions.end() ||
+          it->second.getBitWidth() != value.getBitWidth() ||
+          it->second != value)
+        return false;
+    }
+    for (const auto& [value, range] : visited.pathRanges) {
+      auto it = pathRanges.find(value);
+      if (it == pathRanges.end() || !range.contains(it->second))
+        return false;
+    }
+    return true;
+  };
+
+  for (const auto& visited : candidates) {
+    if (!holdsHere(visited))
+      continue;
+    createBr(visited.block);
+    return true;
+  }
+
+  candidates.push_back(
+      {blockInfo.block, Registers, flags, buffer, assumptions, pathRanges});
+  // code lifted from here on may only depend on the state itself, cached
+  // values from earlier blocks wouldnt dominate a path that jumps in
+  symbolicStores.clear();
+  cache = InstructionCache();
+  mbaSimplifier.results.clear();
+  GEPcache.clear();
+  return false;
+}
+
 void final_optpass(Function* clonedFuncx) {
   llvm::PassBuilder passBuilder;
 
@@ -71,7 +582,7 @@ void final_optpass(Function* clonedFuncx) {
 
     modulePassManager.addPass(GEPLoadPass());
     modulePassManager.addPass(ReplaceTruncWithLoadPass());
-    modulePassManager.addPass(PromotePseudoStackPass());
+    modulePassManager.addPass(StackFrameRecoveryPass());
 
     modulePassManager.run(*module, moduleAnalysisManager);
 
@@ -84,16 +595,86 @@ void final_optpass(Function* clonedFuncx) {
   modulePassManager =
       passBuilder.buildPerModuleDefaultPipeline(OptimizationLevel::O2);
 
-  modulePassManager.addPass(ResizeAllocatedStackPass());
   modulePassManager.addPass(PromotePseudoMemory());
 
   modulePassManager.run(*module, moduleAnalysisManager);
 }
 
+// true/false if the path so far decides it, the solver also sees what the
+// branches we took imply together
+std::optional<bool> lifterClass::decideCondition(Value* condition) {
+  if (auto constant = dyn_cast<ConstantInt>(condition))
+    return constant->isOne();
+  if (auto decided = evaluateUnderPathConditions(condition))
+    return decided;
+  if (isFeasible(condition, true) == false)
+    return false;
+  if (isFeasible(condition, false) == false)
+    return true;
+  return std::nullopt;
+}
+
+// jumps to trueAddress or falseAddress, forking a path for trueAddress when
+// the condition can go both ways
+PATH_info lifterClass::branchOnCondition(Function* function, uint64_t& dest,
+                                         Value* condition,
+                                         const uint64_t trueAddress,
+                                         const uint64_t falseAddress) {
+  if (auto decided = decideCondition(condition)) {
+    printvalue2(*decided);
+    dest = *decided ? trueAddress : falseAddress;
+    auto bb_solved = BasicBlock::Create(function->getContext(), "bb_implied",
+                                        builder.GetInsertBlock()->getParent());
+    createBr(bb_solved);
+    blockInfo = BBInfo(dest, bb_solved);
+    return PATH_solved;
+  }
+
+  auto bb_false = BasicBlock::Create(function->getContext(), "bb_false",
+                                     builder.GetInsertBlock()->getParent());
+  auto bb_true = BasicBlock::Create(function->getContext(), "bb_true",
+                                    builder.GetInsertBlock()->getParent());
+  auto BR = createCondBr(condition, bb_false, bb_true);
+
+  RegisterBranch(BR);
+  DC->registerBranch(BR);
+
+  blockInfo = BBInfo(falseAddress, bb_true);
+  printvalue(condition);
+  forkPath(BBInfo(trueAddress, bb_false), condition);
+
+  debugging::doIfDebug([&]() {
+    std::string cond;
+    raw_string_ostream OS(cond);
+    condition->printAsOperand(OS, false);
+    debugging::journalNewBlocks(function, "fork on " + OS.str() + ": " +
+                                              to_string(trueAddress) + " / " +
+                                              to_string(falseAddress));
+  });
+  std::cout << "created a new path\n" << std::flush;
+  return PATH_unsolved;
+}
+
+// conditional jumps already know both targets, no need to build a select
+// and find them again
+PATH_info lifterClass::solveConditionalBranch(Function* function,
+                                              uint64_t& dest,
+                                              Value* condition,
+                                              const uint64_t trueAddress,
+                                              const uint64_t falseAddress) {
+  run = 0;
+  if (trueAddress == falseAddress)
+    condition = builder.getTrue();
+  return branchOnCondition(function, dest, condition, trueAddress,
+                           falseAddress);
+}
+
 PATH_info lifterClass::solvePath(Function* function, uint64_t& dest,
                                  Value* simplifyValue) {
 
   PATH_info result = PATH_unsolved;
+  // opaque targets often collapse to a constant or a two way select
+  simplifyValue = simplifyWithEGraph(simplifyValue);
   if (llvm::ConstantInt* constInt =
           dyn_cast<llvm::ConstantInt>(simplifyValue)) {
     dest = constInt->getZExtValue();
@@ -102,7 +683,7 @@ PATH_info lifterClass::solvePath(Function* function, uint64_t& dest,
     auto bb_solved = BasicBlock::Create(function->getContext(), "bb_constraint",
                                         builder.GetInsertBlock()->getParent());
 
-    builder.CreateBr(bb_solved);
+    createBr(bb_solved);
     blockInfo = BBInfo(dest, bb_solved);
     return result;
   }
@@ -116,7 +697,7 @@ PATH_info lifterClass::solvePath(Function* function, uint64_t& dest,
           BasicBlock::Create(function->getContext(), "bb_constraint",
                              builder.GetInsertBlock()->getParent());
 
-      builder.CreateBr(bb_solved);
+      createBr(bb_solved);
       blockInfo = BBInfo(dest, bb_solved);
       return solved;
     }
@@ -125,27 +706,40 @@ PATH_info lifterClass::solvePath(Function* function, uint64_t& dest,
   // unsolved
   printvalue(simplifyValue);
   run = 0;
-  auto pvset = computePossibleValues(simplifyValue);
-  vector<APInt> pv(pvset.begin(), pvset.end());
+  vector<APInt> pv;
+  if (auto pvset =
+          tryComputePossibleValues(simplifyValue, MAX_POSSIBLE_VALUES)) {
+    pv.assign(pvset->begin(), pvset->end());
+    // thats every value the expression can make, the path may rule out some
+    if (pv.size() > 2)
+      if (auto reachable = enumerateValues(simplifyValue, pv.size());
+          reachable && !reachable->empty())
+        pv = *reachable;
+  } else if (auto reachable =
+                 enumerateValues(simplifyValue, MAX_POSSIBLE_VALUES);
+             reachable && !reachable->empty()) {
+    pv = *reachable;
+  } else {
+    // reports why and stops
+    auto pvset = computePossibleValues(simplifyValue);
+    pv.assign(pvset.begin(), pvset.end());
+  }
+  std::sort(pv.begin(), pv.end(),
+            [](const APInt& a, const APInt& b) { return a.ult(b); });
+  printvalue2(static_cast<uint64_t>(pv.size()));
   if (pv.size() == 1) {
     printvalue2(pv[0]);
     auto bb_solved = BasicBlock::Create(function->getContext(), "bb_false",
                                         builder.GetInsertBlock()->getParent());
 
-    builder.CreateBr(bb_solved);
+    createBr(bb_solved);
     blockInfo = BBInfo(pv[0].getZExtValue(), bb_solved);
   }
   if (pv.size() == 2) {
-    auto bb_false = BasicBlock::Create(function->getContext(), "bb_false",
-                                       builder.GetInsertBlock()->getParent());
-    auto bb_true = BasicBlock::Create(function->getContext(), "bb_true",
-                                      builder.GetInsertBlock()->getParent());
-
     auto firstcase = pv[0];
     auto secondcase = pv[1];
 
-    static auto try_simplify = [&](APInt c1,
-                                   Value* simplifyv) -> optional<Value*> {
+    auto try_simplify = [&](APInt c1, Value* simplifyv) -> optional<Value*> {
       if (auto si = dyn_cast<SelectInst>(simplifyv)) {
         auto firstcase_v = builder.getIntN(
             simplifyv->getType()->getIntegerBitWidth(), c1.getZExtValue());
@@ -166,38 +760,46 @@ PATH_info lifterClass::solvePath(Function* function, uint64_t& dest,
           builder.getIntN(simplifyValue->getType()->getIntegerBitWidth(),
                           firstcase.getZExtValue()));
     printvalue(condition);
-    auto BR = builder.CreateCondBr(condition, bb_false, bb_true);
-
-    RegisterBranch(BR);
 
     printvalue2(firstcase);
     printvalue2(secondcase);
-    blockInfo = BBInfo(secondcase.getZExtValue(), bb_true);
-    // for [this], we can assume condition is true
-    // we can simplify any value tied to is dependent on condition,
-    // and try to simplify any value calculates condition
-
-    lifterClass* newlifter = new lifterClass(*this);
-
-    // for [newlifter], we can assume condition is false
-    newlifter->blockInfo = BBInfo(firstcase.getZExtValue(), bb_false);
-    printvalue(condition);
-    newlifter->assumptions[cast<Instruction>(condition)] = 1;
+    uint64_t target = 0;
+    branchOnCondition(function, target, condition, firstcase.getZExtValue(),
+                      secondcase.getZExtValue());
+  }
+  if (pv.size() > 2) {
+    // a path per target, this one keeps the last
+    const unsigned width = simplifyValue->getType()->getIntegerBitWidth();
+    std::vector<Value*> conditions;
+    for (auto& target : pv)
+      conditions.push_back(createICMPFolder(
+          CmpInst::ICMP_EQ, simplifyValue,
+          builder.getIntN(width, target.getZExtValue())));
 
-    assumptions[cast<Instruction>(condition)] = 0;
+    auto bb_default = BasicBlock::Create(function->getContext(), "bb_case",
+                                         builder.GetInsertBlock()->getParent());
+    SmallVector<std::pair<ConstantInt*, BasicBlock*>, 16> cases;
+    for (size_t i = 0; i + 1 < pv.size(); ++i) {
+      auto bb_case = BasicBlock::Create(function->getContext(), "bb_case",
+                                        builder.GetInsertBlock()->getParent());
+      cases.push_back({builder.getIntN(width, pv[i].getZExtValue()), bb_case});
+    }
+    createSwitch(simplifyValue, bb_default, cases);
 
-    lifters.push_back(newlifter);
+    blockInfo = BBInfo(pv.back().getZExtValue(), bb_default);
+    SmallVector<std::pair<BBInfo, Value*>, 16> forks;
+    for (size_t i = 0; i + 1 < pv.size(); ++i)
+      forks.push_back(
+          {BBInfo(pv[i].getZExtValue(), cases[i].second), conditions[i]});
+    forkCases(forks);
 
     debugging::doIfDebug([&]() {
-      std::string Filename = "output_newpath.ll";
-      std::error_code EC;
-      raw_fd_ostream OS(Filename, EC);
-      function->getParent()->print(OS, nullptr);
+      std::string targets;
+      for (auto& target : pv)
+        targets += " " + to_string(target.getZExtValue());
+      debugging::journalNewBlocks(function, "switch on" + targets);
     });
-    std::cout << "created a new path\n" << std::flush;
-  }
-  if (pv.size() > 2) {
-    UNREACHABLE("cant reach more than 2 paths!");
+    std::cout << "created " << pv.size() - 1 << " new paths\n" << std::flush;
   }
 
   return result;
@@ -1,6 +1,7 @@
 #pragma once
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Value.h>
+#include <string>
 
 enum PATH_info {
   PATH_unsolved = 0,
@@ -10,4 +11,42 @@ enum PATH_info {
 void final_optpass(llvm::Function* clonedFuncx);
 
 PATH_info solvePath(llvm::Function* function, uint64_t& dest,
-                    llvm::Value* simplifyValue);
\ No newline at end of file
+                    llvm::Value* simplifyValue);
+
+// how pending paths are picked and combined
+namespace explorer {
+
+  enum class Strategy {
+    DFS,         // newest path first
+    BFS,         // round robin, a block at a time
+    ReturnFirst, // path whose rsp is closest to the real return
+    Novelty,     // path at the address we visited least
+  };
+
+  struct Config {
+    Strategy strategy = Strategy::DFS;
+    // 0 means no limit. when a limit is hit the remaining paths end with
+    // a call to unresolved_path(address) so we still get IR
+    uint64_t maxPathInstructions = 0;
+    uint64_t maxPaths = 0; // finished paths
+    uint64_t timeoutSeconds = 0;
+
+    // join paths that wait at the same address instead of lifting the rest
+    // of the function once per path
+    bool mergeStates = false;
+    // jump into the code an earlier path lifted from the same state
+    bool dedupeStates = false;
+    // rewind one path to its forks instead of cloning it at each, so memory
+    // follows the current path and not the pending ones. dfs without
+    // merging only, it falls back to cloning otherwise
+    bool backtrack = false;
+  };
+
+  Config& config();
+
+  bool setStrategy(const std::string& value);
+  bool setMaxPathInstructions(const std::string& value);
+  bool setMaxPaths(const std::string& value);
+  bool setTimeout(const std::string& value);
+
+} // namespace explorer
\ No newline at end of file
@@ -0,0 +1,268 @@
+#define MERGEN_LOG_CATEGORY debugging::LOG_OPERANDS
+#include "RewriteRules.h"
+#include "includes.h"
+#include "lifterClass.h"
+#include "utils.h"
+#include <llvm/ADT/bit.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+
+namespace {
+  using namespace rewrite;
+
+  bool isAllOnesInt(Value* V) {
+    auto C = dyn_cast<ConstantInt>(V);
+    return C && C->isMinusOne();
+  }
+
+  Shape shapeOf(Value* V) {
+    if (auto C = dyn_cast<ConstantInt>(V))
+      return C->isZero()       ? Shape::Zero
+             : C->isMinusOne() ? Shape::AllOnes
+                               : Shape::Constant;
+    if (isa<ZExtInst>(V))
+      return Shape::ZExt;
+    if (isa<TruncInst>(V))
+      return Shape::Trunc;
+    auto BO = dyn_cast<BinaryOperator>(V);
+    if (!BO)
+      return Shape::Other;
+    switch (BO->getOpcode()) {
+    case Instruction::Add:
+      return Shape::Add;
+    case Instruction::Sub:
+      return Shape::Sub;
+    case Instruction::Mul:
+      return Shape::Mul;
+    case Instruction::And:
+      return Shape::And;
+    case Instruction::Or:
+      return Shape::Or;
+    case Instruction::Xor:
+      return isAllOnesInt(BO->getOperand(0)) || isAllOnesInt(BO->getOperand(1))
+                 ? Shape::Not
+                 : Shape::Xor;
+    case Instruction::Shl:
+      return Shape::Shl;
+    case Instruction::LShr:
+      return Shape::LShr;
+    default:
+      return Shape::Other;
+    }
+  }
+
+  bool matchNode(const Tree& tree, uint8_t index, Value* V,
+                 Bindings& bindings);
+
+  // both operand orders for ops that commute, captures from a failed order
+  // are dropped before the next one
+  bool matchOperands(const Tree& tree, const PatternNode& node, Value* L,
+                     Value* R, Bindings& bindings) {
+    const Bindings saved = bindings;
+    if (matchNode(tree, node.children[0], L, bindings) &&
+        matchNode(tree, node.children[1], R, bindings))
+      return true;
+    bindings = saved;
+    if (commutes(node.kind) && matchNode(tree, node.children[0], R, bindings) &&
+        matchNode(tree, node.children[1], L, bindings))
+      return true;
+    bindings = saved;
+    return false;
+  }
+
+  bool matchNode(const Tree& tree, uint8_t index, Value* V,
+                 Bindings& bindings) {
+    const auto& node = tree.nodes[index];
+    switch (node.kind) {
+    case Kind::ConstantCapture:
+      if (!isa<ConstantInt>(V))
+        return false;
+      [[fallthrough]];
+    case Kind::Capture: {
+      auto& bound = bindings[node.slot];
+      if (bound)
+        return bound == V;
+      bound = V;
+      return true;
+    }
+    case Kind::Literal: {
+      auto C = dyn_cast<ConstantInt>(V);
+      return C && C->getValue() == APInt(C->getBitWidth(), node.literal, true);
+    }
+    case Kind::Not: {
+      auto BO = dyn_cast<BinaryOperator>(V);
+      if (!BO || BO->getOpcode() != Instruction::Xor)
+        return false;
+      if (isAllOnesInt(BO->getOperand(1)))
+        return matchNode(tree, node.children[0], BO->getOperand(0), bindings);
+      return isAllOnesInt(BO->getOperand(0)) &&
+             matchNode(tree, node.children[0], BO->getOperand(1), bindings);
+    }
+    case Kind::ZExtOrSelf: {
+      const Bindings saved = bindings;
+      if (auto Z = dyn_cast<ZExtInst>(V))
+        if (matchNode(tree, node.children[0], Z->getOperand(0), bindings))
+          return true;
+      bindings = saved;
+      return matchNode(tree, node.children[0], V, bindings);
+    }
+    case Kind::ZExt: {
+      auto Z = dyn_cast<ZExtInst>(V);
+      return Z && matchNode(tree, node.children[0], Z->getOperand(0), bindings);
+    }
+    case Kind::Trunc: {
+      auto T = dyn_cast<TruncInst>(V);
+      return T && matchNode(tree, node.children[0], T->getOperand(0), bindings);
+    }
+    case Kind::Select: {
+      auto S = dyn_cast<SelectInst>(V);
+      return S &&
+             matchNode(tree, node.children[0], S->getCondition(), bindings) &&
+             matchNode(tree, node.children[1], S->getTrueValue(), bindings) &&
+             matchNode(tree, node.children[2], S->getFalseValue(), bindings);
+    }
+    case Kind::Eq: {
+      auto cmp = dyn_cast<ICmpInst>(V);
+      return cmp && cmp->getPredicate() == CmpInst::ICMP_EQ &&
+             matchOperands(tree, node, cmp->getOperand(0),
+                           cmp->getOperand(1), bindings);
+    }
+    case Kind::Mask:
+      return false;
+    default: {
+      auto BO = dyn_cast<BinaryOperator>(V);
+      return BO && BO->getOpcode() == rewrite::detail::opcodeOf(node.kind) &&
+             matchOperands(tree, node, BO->getOperand(0), BO->getOperand(1),
+                           bindings);
+    }
+    }
+  }
+
+  const APInt& constantIn(const Bindings& bindings, const char letter) {
+    return cast<ConstantInt>(bindings[letter - 'a'])->getValue();
+  }
+
+  bool guardHolds(const Guard guard, const Bindings& bindings,
+                  const DataLayout& DL) {
+    switch (guard) {
+    case Guard::None:
+      return true;
+    case Guard::SignMask: {
+      Value* a = bindings['a' - 'a'];
+      return ComputeNumSignBits(a, DL) ==
+             a->getType()->getScalarSizeInBits();
+    }
+    case Guard::BitToNegative: {
+      const auto& power = constantIn(bindings, 'p');
+      const auto& shift = constantIn(bindings, 's');
+      const auto& c = constantIn(bindings, 'c');
+      return power.isPowerOf2() && shift.ule(power.logBase2()) &&
+             c == -power.lshr(shift);
+    }
+    }
+    return false;
+  }
+} // namespace
+
+Value* lifterClass::emitRewrite(const rewrite::Tree& tree, uint8_t index,
+                                const rewrite::Bindings& bindings,
+                                Type* type) {
+  using rewrite::Kind;
+  const auto& node = tree.nodes[index];
+
+  switch (node.kind) {
+  case Kind::Capture:
+  case Kind::ConstantCapture:
+    return bindings[node.slot];
+  case Kind::Literal:
+    return ConstantInt::get(type, node.literal, true);
+  case Kind::Mask: {
+    auto captured = bindings[tree.nodes[node.children[0]].slot];
+    const unsigned width = type->getIntegerBitWidth();
+    const unsigned low =
+        std::min(width, captured->getType()->getIntegerBitWidth());
+    return ConstantInt::get(type, APInt::getAllOnes(low).zext(width));
+  }
+  default:
+    break;
+  }
+
+  // literals take the type of their sibling, eq has no type of its own to
+  // hand down
+  Type* childType = node.kind == Kind::Eq ? nullptr : type;
+  std::array<Value*, 3> operands{};
+  for (unsigned i = 0; i < node.childCount; ++i) {
+    const auto& child = tree.nodes[node.children[i]];
+    if (child.kind == Kind::Literal)
+      continue;
+    Type* hint = node.kind == Kind::Select && i == 0 ? builder.getInt1Ty()
+                                                     : childType;
+    operands[i] = emitRewrite(tree, node.children[i], bindings, hint);
+    if (!childType && node.kind != Kind::Select)
+      childType = operands[i]->getType();
+  }
+  for (unsigned i = 0; i < node.childCount; ++i)
+    if (!operands[i])
+      operands[i] = emitRewrite(tree, node.children[i], bindings, childType);
+
+  switch (node.kind) {
+  case Kind::Add:
+    return createAddFolder(operands[0], operands[1], "rw-add");
+  case Kind::Sub:
+    return createSubFolder(operands[0], operands[1], "rw-sub");
+  case Kind::Mul:
+    return createMulFolder(operands[0], operands[1], "rw-mul");
+  case Kind::And:
+    return createAndFolder(operands[0], operands[1], "rw-and");
+  case Kind::Or:
+    return createOrFolder(operands[0], operands[1], "rw-or");
+  case Kind::Xor:
+    return createXorFolder(operands[0], operands[1], "rw-xor");
+  case Kind::Shl:
+    return createShlFolder(operands[0], operands[1], "rw-shl");
+  case Kind::LShr:
+    return createLShrFolder(operands[0], operands[1], "rw-lshr");
+  case Kind::Not:
+    return createNotFolder(operands[0], "rw-not");
+  case Kind::ZExt:
+  case Kind::ZExtOrSelf:
+    return createZExtOrTruncFolder(operands[0], type, "rw-zext");
+  case Kind::Trunc:
+    return createTruncFolder(operands[0], type, "rw-trunc");
+  case Kind::Select:
+    return createSelectFolder(operands[0], operands[1], operands[2],
+                              "rw-select");
+  case Kind::Eq:
+    return createICMPFolder(CmpInst::ICMP_EQ, operands[0], operands[1],
+                            "rw-eq");
+  default:
+    UNREACHABLE("unexpected node in rewrite result");
+  }
+}
+
+Value* lifterClass::doPatternMatching(Instruction::BinaryOps const I,
+                                      Value* const op0, Value* const op1) {
+  const auto& candidates =
+      rewrite::candidates(I, shapeOf(op0), shapeOf(op1));
+  const auto& DL = fnc->getParent()->getDataLayout();
+
+  for (unsigned word = 0; word < candidates.size(); ++word) {
+    for (uint64_t bits = candidates[word]; bits; bits &= bits - 1) {
+      const auto& rule =
+          rewrite::rules[word * 64 + llvm::countr_zero(bits)];
+      const auto& root = rule.pattern.root();
+
+      rewrite::Bindings bindings{};
+      if (!matchOperands(rule.pattern, root, op0, op1, bindings) ||
+          !guardHolds(rule.guard, bindings, DL))
+        continue;
+
+      printvalue2(std::string(rule.name));
+      return emitRewrite(rule.result, rule.result.size - 1, bindings,
+                         op0->getType());
+    }
+  }
+  return nullptr;
+}
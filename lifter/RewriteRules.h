@@ -0,0 +1,411 @@
+#pragma once
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Value.h>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+// rewrite rules for the binary folders. a rule is a pattern and a result
+// written as s-expressions, both are parsed at compile time and the rules are
+// sorted into a table by root opcode and the shape of both operands, so a
+// folded op only tries the few rules that could match it.
+//
+//   $x         any value, the same letter twice means the same value
+//   #k         any constant int, same letters as $
+//   -1, 0, 3   that constant
+//   (op ...)   add sub mul and or xor shl lshr not zext trunc select eq,
+//              zext? is zext or the value itself
+//   (mask $x)  result only, all ones in the width of $x
+//
+// select and eq can't be an operand of the pattern root, the table has no
+// shape for them. deeper down they are fine.
+//
+// ops that commute match both operand orders. rules are tried in the order
+// they are listed, the first one that matches wins.
+namespace rewrite {
+
+  enum class Kind : uint8_t {
+    Capture,
+    ConstantCapture,
+    Literal,
+    Add,
+    Sub,
+    Mul,
+    And,
+    Or,
+    Xor,
+    Shl,
+    LShr,
+    Not,
+    ZExt,
+    ZExtOrSelf,
+    Trunc,
+    Select,
+    Eq,
+    Mask,
+  };
+
+  // checks a pattern cant express, on fixed capture letters
+  enum class Guard : uint8_t {
+    None,
+    SignMask,      // $a is 0 or -1
+    BitToNegative, // #p is a power of two at or above bit #s, #c == -(#p >> #s)
+  };
+
+  // what the table dispatches on, one per operand
+  enum class Shape : uint8_t {
+    Other,
+    Constant,
+    Zero,
+    AllOnes,
+    Not,
+    Add,
+    Sub,
+    Mul,
+    And,
+    Or,
+    Xor,
+    Shl,
+    LShr,
+    ZExt,
+    Trunc,
+    Count,
+  };
+
+  constexpr unsigned MAX_TREE = 16;
+  constexpr unsigned CAPTURES = 26;
+
+  struct PatternNode {
+    Kind kind = Kind::Literal;
+    uint8_t slot = 0; // capture letter
+    uint8_t childCount = 0;
+    std::array<uint8_t, 3> children{};
+    int64_t literal = 0;
+  };
+
+  // children come before their parent, root is the last node
+  struct Tree {
+    std::array<PatternNode, MAX_TREE> nodes{};
+    uint8_t size = 0;
+
+    constexpr const PatternNode& root() const { return nodes[size - 1]; }
+  };
+
+  struct Rule {
+    std::string_view name;
+    Tree pattern;
+    Tree result;
+    Guard guard;
+  };
+
+  using Bindings = std::array<llvm::Value*, CAPTURES>;
+
+  // not constexpr, reaching it while building a rule fails the build
+  inline void invalidRule() {}
+
+  namespace detail {
+    constexpr unsigned arityOf(const Kind kind) {
+      switch (kind) {
+      case Kind::Capture:
+      case Kind::ConstantCapture:
+      case Kind::Literal:
+        return 0;
+      case Kind::Not:
+      case Kind::ZExt:
+      case Kind::ZExtOrSelf:
+      case Kind::Trunc:
+      case Kind::Mask:
+        return 1;
+      case Kind::Select:
+        return 3;
+      default:
+        return 2;
+      }
+    }
+
+    constexpr Kind kindOf(const std::string_view word) {
+      constexpr std::pair<std::string_view, Kind> names[] = {
+          {"add", Kind::Add},       {"sub", Kind::Sub},
+          {"mul", Kind::Mul},       {"and", Kind::And},
+          {"or", Kind::Or},         {"xor", Kind::Xor},
+          {"shl", Kind::Shl},       {"lshr", Kind::LShr},
+          {"not", Kind::Not},       {"zext", Kind::ZExt},
+          {"zext?", Kind::ZExtOrSelf}, {"trunc", Kind::Trunc},
+          {"select", Kind::Select}, {"eq", Kind::Eq},
+          {"mask", Kind::Mask}};
+      for (const auto& [name, kind] : names)
+        if (name == word)
+          return kind;
+      invalidRule();
+      return Kind::Literal;
+    }
+
+    struct Parser {
+      std::string_view text;
+      size_t pos = 0;
+      Tree tree;
+
+      constexpr void skipSpaces() {
+        while (pos < text.size() && text[pos] == ' ')
+          ++pos;
+      }
+
+      constexpr uint8_t push(const PatternNode& node) {
+        if (tree.size == MAX_TREE)
+          invalidRule();
+        tree.nodes[tree.size] = node;
+        return tree.size++;
+      }
+
+      constexpr uint8_t parse() {
+        skipSpaces();
+        if (pos >= text.size())
+          invalidRule();
+
+        PatternNode node;
+        const char c = text[pos];
+        if (c == '$' || c == '#') {
+          node.kind = c == '$' ? Kind::Capture : Kind::ConstantCapture;
+          const char letter = pos + 1 < text.size() ? text[pos + 1] : 0;
+          if (letter < 'a' || letter > 'z')
+            invalidRule();
+          node.slot = letter - 'a';
+          pos += 2;
+          return push(node);
+        }
+
+        if (c == '-' || (c >= '0' && c <= '9')) {
+          const bool negative = c == '-';
+          if (negative)
+            ++pos;
+          int64_t value = 0;
+          while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9')
+            value = value * 10 + (text[pos++] - '0');
+          node.kind = Kind::Literal;
+          node.literal = negative ? -value : value;
+          return push(node);
+        }
+
+        if (c != '(')
+          invalidRule();
+        const size_t start = ++pos;
+        while (pos < text.size() && text[pos] != ' ' && text[pos] != ')')
+          ++pos;
+        node.kind = kindOf(text.substr(start, pos - start));
+        while (true) {
+          skipSpaces();
+          if (pos < text.size() && text[pos] == ')') {
+            ++pos;
+            break;
+          }
+          if (node.childCount == 3)
+            invalidRule();
+          node.children[node.childCount++] = parse();
+        }
+        if (node.childCount != arityOf(node.kind))
+          invalidRule();
+        return push(node);
+      }
+    };
+
+    constexpr Tree parseTree(const std::string_view text) {
+      Parser parser{text};
+      parser.parse();
+      parser.skipSpaces();
+      if (parser.pos != text.size())
+        invalidRule();
+      return parser.tree;
+    }
+
+    constexpr bool isBinaryRoot(const Kind kind) {
+      return kind >= Kind::Add && kind <= Kind::LShr;
+    }
+
+    constexpr bool contains(const Tree& tree, const Kind kind) {
+      for (unsigned i = 0; i < tree.size; ++i)
+        if (tree.nodes[i].kind == kind)
+          return true;
+      return false;
+    }
+  } // namespace detail
+
+  consteval Rule rule(const std::string_view name,
+                      const std::string_view pattern,
+                      const std::string_view result,
+                      const Guard guard = Guard::None) {
+    Rule built{name, detail::parseTree(pattern), detail::parseTree(result),
+               guard};
+    // the table is keyed by the root, and mask only means something once
+    // the captures are known
+    const auto& root = built.pattern.root();
+    if (!detail::isBinaryRoot(root.kind) ||
+        detail::contains(built.pattern, Kind::Mask))
+      invalidRule();
+    // the root's operands are dispatched on by shape, see detail::accepts
+    for (unsigned i = 0; i < root.childCount; ++i) {
+      const auto kind = built.pattern.nodes[root.children[i]].kind;
+      if (kind == Kind::Select || kind == Kind::Eq)
+        invalidRule();
+    }
+    return built;
+  }
+
+  constexpr bool commutes(const Kind kind) {
+    return kind == Kind::Add || kind == Kind::Mul || kind == Kind::And ||
+           kind == Kind::Or || kind == Kind::Xor || kind == Kind::Eq;
+  }
+
+  // clang-format off
+  inline constexpr std::array rules{
+      // ((a & 2^p) >> s) - 2^(p-s) is 0 or -2^(p-s)
+      rule("bit-to-negative",
+           "(add #c (lshr (and $x #p) #s))",
+           "(select (eq (lshr (and $x #p) #s) 0) #c 0)",
+           Guard::BitToNegative),
+
+      // (~a & b) | (a & c) with a all zeros or all ones
+      rule("mask-select",
+           "(or (and (not $a) $b) (and $a $c))",
+           "(select (eq $a 0) $b $c)",
+           Guard::SignMask),
+      rule("and-xor-or", "(or (and $a $b) (xor $a $b))", "(or $a $b)"),
+
+      rule("and-not-self", "(and (zext? (not $x)) (zext? $x))", "0"),
+      rule("and-not-self-trunc", "(and (trunc (not $x)) (trunc $x))", "0"),
+      rule("or-minus-and", "(and (or $a $b) (not (and $a $b)))",
+           "(xor $a $b)"),
+
+      rule("xor-not-self", "(xor (zext? (not $x)) (zext? $x))", "(mask $x)"),
+      rule("xor-not-self-trunc", "(xor (trunc (not $x)) (trunc $x))", "-1"),
+      rule("xor-self", "(xor $x $x)", "0"),
+      // de morgan on constants
+      rule("not-or-not-constant", "(xor (or (not $a) #k) -1)",
+           "(and $a (not #k))"),
+      rule("not-or-constant", "(xor (or $a #k) -1)",
+           "(and (not $a) (not #k))"),
+      rule("not-or-not-not", "(xor (or (not $a) (not $b)) -1)",
+           "(and $a $b)"),
+  };
+  // clang-format on
+
+  namespace detail {
+    constexpr unsigned OPCODES =
+        llvm::Instruction::BinaryOpsEnd - llvm::Instruction::BinaryOpsBegin;
+    constexpr unsigned SHAPES = static_cast<unsigned>(Shape::Count);
+    constexpr unsigned RULE_WORDS = (rules.size() + 63) / 64;
+
+    constexpr unsigned opcodeOf(const Kind kind) {
+      switch (kind) {
+      case Kind::Add:
+        return llvm::Instruction::Add;
+      case Kind::Sub:
+        return llvm::Instruction::Sub;
+      case Kind::Mul:
+        return llvm::Instruction::Mul;
+      case Kind::And:
+        return llvm::Instruction::And;
+      case Kind::Or:
+        return llvm::Instruction::Or;
+      case Kind::Xor:
+        return llvm::Instruction::Xor;
+      case Kind::Shl:
+        return llvm::Instruction::Shl;
+      case Kind::LShr:
+        return llvm::Instruction::LShr;
+      default:
+        invalidRule();
+        return 0;
+      }
+    }
+
+    // can an operand of this shape match the pattern node at all
+    constexpr bool accepts(const PatternNode& node, const Shape shape) {
+      switch (node.kind) {
+      case Kind::Capture:
+      case Kind::ZExtOrSelf:
+        return true;
+      case Kind::ConstantCapture:
+        return shape == Shape::Constant || shape == Shape::Zero ||
+               shape == Shape::AllOnes;
+      case Kind::Literal:
+        if (node.literal == 0)
+          return shape == Shape::Zero;
+        if (node.literal == -1)
+          return shape == Shape::AllOnes;
+        return shape == Shape::Constant;
+      case Kind::Not:
+        return shape == Shape::Not;
+      case Kind::Xor:
+        return shape == Shape::Xor || shape == Shape::Not;
+      case Kind::Add:
+        return shape == Shape::Add;
+      case Kind::Sub:
+        return shape == Shape::Sub;
+      case Kind::Mul:
+        return shape == Shape::Mul;
+      case Kind::And:
+        return shape == Shape::And;
+      case Kind::Or:
+        return shape == Shape::Or;
+      case Kind::Shl:
+        return shape == Shape::Shl;
+      case Kind::LShr:
+        return shape == Shape::LShr;
+      case Kind::ZExt:
+        return shape == Shape::ZExt;
+      case Kind::Trunc:
+        return shape == Shape::Trunc;
+      case Kind::Select:
+      case Kind::Eq:
+      case Kind::Mask:
+        // no shape for these, as an operand of the root the rule would
+        // never be tried
+        break;
+      }
+      invalidRule();
+      return false;
+    }
+
+    using Candidates = std::array<uint64_t, RULE_WORDS>;
+
+    constexpr unsigned cellOf(const unsigned opcode, const Shape lhs,
+                              const Shape rhs) {
+      return ((opcode - llvm::Instruction::BinaryOpsBegin) * SHAPES +
+              static_cast<unsigned>(lhs)) *
+                 SHAPES +
+             static_cast<unsigned>(rhs);
+    }
+
+    constexpr auto buildTable() {
+      std::array<Candidates, OPCODES * SHAPES * SHAPES> table{};
+      for (unsigned index = 0; index < rules.size(); ++index) {
+        const auto& pattern = rules[index].pattern;
+        const auto& root = pattern.root();
+        const auto& lhs = pattern.nodes[root.children[0]];
+        const auto& rhs = pattern.nodes[root.children[1]];
+        for (unsigned l = 0; l < SHAPES; ++l)
+          for (unsigned r = 0; r < SHAPES; ++r) {
+            const auto L = static_cast<Shape>(l), R = static_cast<Shape>(r);
+            const bool direct = accepts(lhs, L) && accepts(rhs, R);
+            const bool swapped = commutes(root.kind) && accepts(lhs, R) &&
+                                 accepts(rhs, L);
+            if (direct || swapped)
+              table[cellOf(opcodeOf(root.kind), L, R)][index / 64] |=
+                  1ULL << (index % 64);
+          }
+      }
+      return table;
+    }
+
+    inline constexpr auto table = buildTable();
+  } // namespace detail
+
+  // indices into rules that could match, as a bitset
+  constexpr const detail::Candidates& candidates(const unsigned opcode,
+                                                 const Shape lhs,
+                                                 const Shape rhs) {
+    return detail::table[detail::cellOf(opcode, lhs, rhs)];
+  }
+
+} // namespace rewrite
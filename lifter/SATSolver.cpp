@@ -0,0 +1,385 @@
+#include "SATSolver.h"
+#include <algorithm>
+
+namespace sat {
+
+  namespace {
+    // 1, 1, 2, 1, 1, 2, 4, 1, ...
+    uint64_t luby(uint64_t index) {
+      uint64_t size = 1, sequence = 0;
+      while (size < index + 1) {
+        ++sequence;
+        size = 2 * size + 1;
+      }
+      while (size - 1 != index) {
+        size = (size - 1) >> 1;
+        --sequence;
+        index %= size;
+      }
+      return 1ULL << sequence;
+    }
+
+    constexpr uint64_t RESTART_BASE = 100;
+    constexpr double ACTIVITY_DECAY = 0.95;
+  } // namespace
+
+  Var Solver::newVar() {
+    const Var var = assigns.size();
+    assigns.push_back(UNDEF);
+    levels.push_back(0);
+    reasons.push_back(-1);
+    activity.push_back(0);
+    polarity.push_back(true);
+    seen.push_back(false);
+    heapIndex.push_back(-1);
+    watches.emplace_back();
+    watches.emplace_back();
+    heapInsert(var);
+    return var;
+  }
+
+  void Solver::attach(const uint32_t index) {
+    const auto& lits = clauses[index].lits;
+    watches[negate(lits[0])].push_back({index, lits[1]});
+    watches[negate(lits[1])].push_back({index, lits[0]});
+  }
+
+  bool Solver::addClause(llvm::ArrayRef<Lit> input) {
+    if (!ok)
+      return false;
+
+    llvm::SmallVector<Lit, 8> lits(input.begin(), input.end());
+    std::sort(lits.begin(), lits.end());
+    Lit previous = -1;
+    size_t kept = 0;
+    for (auto lit : lits) {
+      // satisfied at the root or a tautology
+      if (value(lit) == TRUE || lit == negate(previous))
+        return true;
+      if (value(lit) != FALSE && lit != previous)
+        lits[kept++] = previous = lit;
+    }
+    lits.resize(kept);
+
+    if (lits.empty())
+      return ok = false;
+    if (lits.size() == 1) {
+      enqueue(lits[0], -1);
+      return ok = propagate() < 0;
+    }
+    Clause clause;
+    clause.lits.assign(lits.begin(), lits.end());
+    clauses.push_back(std::move(clause));
+    attach(clauses.size() - 1);
+    return true;
+  }
+
+  void Solver::enqueue(const Lit lit, const int32_t reason) {
+    const Var var = varOf(lit);
+    assigns[var] = !isNegated(lit);
+    levels[var] = decisionLevel();
+    reasons[var] = reason;
+    trail.push_back(lit);
+  }
+
+  int32_t Solver::propagate() {
+    int32_t conflict = -1;
+    while (propagated < trail.size()) {
+      const Lit p = trail[propagated++];
+      const Lit falseLit = negate(p);
+      auto& list = watches[p];
+      size_t i = 0, j = 0;
+      while (i < list.size()) {
+        const Watcher watcher = list[i];
+        if (value(watcher.blocker) == TRUE) {
+          list[j++] = list[i++];
+          continue;
+        }
+        auto& lits = clauses[watcher.clause].lits;
+        if (lits[0] == falseLit)
+          std::swap(lits[0], lits[1]);
+        ++i;
+
+        const Lit first = lits[0];
+        if (first != watcher.blocker && value(first) == TRUE) {
+          list[j++] = {watcher.clause, first};
+          continue;
+        }
+
+        bool moved = false;
+        for (size_t k = 2; k < lits.size(); ++k) {
+          if (value(lits[k]) != FALSE) {
+            std::swap(lits[1], lits[k]);
+            watches[negate(lits[1])].push_back({watcher.clause, first});
+            moved = true;
+            break;
+          }
+        }
+        if (moved)
+          continue;
+
+        list[j++] = {watcher.clause, first};
+        if (value(first) == FALSE) {
+          conflict = watcher.clause;
+          propagated = trail.size();
+          while (i < list.size())
+            list[j++] = list[i++];
+        } else {
+          enqueue(first, watcher.clause);
+        }
+      }
+      list.resize(j);
+      if (conflict >= 0)
+        break;
+    }
+    return conflict;
+  }
+
+  void Solver::analyze(int32_t conflict, llvm::SmallVectorImpl<Lit>& learnt,
+                       size_t& backtrackLevel) {
+    int pending = 0;
+    Lit p = -1;
+    size_t index = trail.size();
+    learnt.push_back(-1); // the asserting literal goes here
+
+    do {
+      const auto& lits = clauses[conflict].lits;
+      // lits[0] of a reason is the literal it implied
+      for (size_t k = p == -1 ? 0 : 1; k < lits.size(); ++k) {
+        const Var var = varOf(lits[k]);
+        if (seen[var] || levels[var] == 0)
+          continue;
+        bump(var);
+        seen[var] = true;
+        if (static_cast<size_t>(levels[var]) >= decisionLevel())
+          ++pending;
+        else
+          learnt.push_back(lits[k]);
+      }
+      while (!seen[varOf(trail[--index])])
+        ;
+      p = trail[index];
+      conflict = reasons[varOf(p)];
+      seen[varOf(p)] = false;
+      --pending;
+    } while (pending > 0);
+    learnt[0] = negate(p);
+
+    backtrackLevel = 0;
+    if (learnt.size() > 1) {
+      size_t highest = 1;
+      for (size_t k = 2; k < learnt.size(); ++k)
+        if (levels[varOf(learnt[k])] > levels[varOf(learnt[highest])])
+          highest = k;
+      std::swap(learnt[1], learnt[highest]);
+      backtrackLevel = levels[varOf(learnt[1])];
+    }
+    for (auto lit : learnt)
+      seen[varOf(lit)] = false;
+  }
+
+  void Solver::cancelUntil(const size_t level) {
+    if (decisionLevel() <= level)
+      return;
+    for (size_t i = trail.size(); i > trailLimits[level]; --i) {
+      const Var var = varOf(trail[i - 1]);
+      polarity[var] = isNegated(trail[i - 1]);
+      assigns[var] = UNDEF;
+      reasons[var] = -1;
+      heapInsert(var);
+    }
+    trail.resize(trailLimits[level]);
+    trailLimits.resize(level);
+    propagated = trail.size();
+  }
+
+  // drops the longer half of the learnt clauses that arent a reason for
+  // anything on the trail, watches are rebuilt from scratch
+  void Solver::reduceLearnts() {
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < clauses.size(); ++i)
+      if (clauses[i].learnt && !clauses[i].deleted &&
+          clauses[i].lits.size() > 2)
+        candidates.push_back(i);
+    std::sort(candidates.begin(), candidates.end(),
+              [&](uint32_t a, uint32_t b) {
+                return clauses[a].lits.size() > clauses[b].lits.size();
+              });
+
+    std::vector<bool> locked(clauses.size());
+    for (auto lit : trail)
+      if (reasons[varOf(lit)] >= 0)
+        locked[reasons[varOf(lit)]] = true;
+
+    for (size_t k = 0; k < candidates.size() / 2; ++k) {
+      if (locked[candidates[k]])
+        continue;
+      clauses[candidates[k]].deleted = true;
+      clauses[candidates[k]].lits.clear();
+      --learntCount;
+    }
+
+    for (auto& list : watches)
+      list.clear();
+    for (uint32_t i = 0; i < clauses.size(); ++i)
+      if (!clauses[i].deleted)
+        attach(i);
+    maxLearnts += maxLearnts / 2;
+  }
+
+  void Solver::bump(const Var var) {
+    if ((activity[var] += activityIncrement) > 1e100) {
+      for (auto& a : activity)
+        a *= 1e-100;
+      activityIncrement *= 1e-100;
+    }
+    if (heapIndex[var] >= 0)
+      heapUp(heapIndex[var]);
+  }
+
+  void Solver::heapInsert(const Var var) {
+    if (heapIndex[var] >= 0)
+      return;
+    heapIndex[var] = heap.size();
+    heap.push_back(var);
+    heapUp(heap.size() - 1);
+  }
+
+  void Solver::heapUp(size_t position) {
+    const Var var = heap[position];
+    while (position > 0) {
+      const size_t parent = (position - 1) / 2;
+      if (activity[heap[parent]] >= activity[var])
+        break;
+      heap[position] = heap[parent];
+      heapIndex[heap[position]] = position;
+      position = parent;
+    }
+    heap[position] = var;
+    heapIndex[var] = position;
+  }
+
+  void Solver::heapDown(size_t position) {
+    const Var var = heap[position];
+    while (true) {
+      size_t child = position * 2 + 1;
+      if (child >= heap.size())
+        break;
+      if (child + 1 < heap.size() &&
+          activity[heap[child + 1]] > activity[heap[child]])
+        ++child;
+      if (activity[heap[child]] <= activity[var])
+        break;
+      heap[position] = heap[child];
+      heapIndex[heap[position]] = position;
+      position = child;
+    }
+    heap[position] = var;
+    heapIndex[var] = position;
+  }
+
+  Var Solver::heapPop() {
+    const Var top = heap.front();
+    heapIndex[top] = -1;
+    heap.front() = heap.back();
+    heap.pop_back();
+    if (!heap.empty()) {
+      heapIndex[heap.front()] = 0;
+      heapDown(0);
+    }
+    return top;
+  }
+
+  Lit Solver::pickBranch() {
+    while (!heap.empty()) {
+      const Var var = heapPop();
+      if (assigns[var] == UNDEF)
+        return mkLit(var, polarity[var]);
+    }
+    return -1;
+  }
+
+  Result Solver::solve(llvm::ArrayRef<Lit> assumptions,
+                       const uint64_t conflictBudget) {
+    if (!ok)
+      return Result::Unsat;
+
+    uint64_t conflicts = 0, restarts = 0;
+    uint64_t restartLimit = luby(0) * RESTART_BASE;
+    uint64_t sinceRestart = 0;
+    llvm::SmallVector<Lit, 32> learnt;
+
+    while (true) {
+      const int32_t conflict = propagate();
+      if (conflict >= 0) {
+        ++conflicts;
+        ++sinceRestart;
+        if (decisionLevel() == 0) {
+          ok = false;
+          return Result::Unsat;
+        }
+
+        learnt.clear();
+        size_t backtrackLevel;
+        analyze(conflict, learnt, backtrackLevel);
+        cancelUntil(backtrackLevel);
+        if (learnt.size() == 1) {
+          enqueue(learnt[0], -1);
+        } else {
+          Clause clause;
+          clause.lits.assign(learnt.begin(), learnt.end());
+          clause.learnt = true;
+          clauses.push_back(std::move(clause));
+          attach(clauses.size() - 1);
+          enqueue(learnt[0], clauses.size() - 1);
+          ++learntCount;
+        }
+        activityIncrement /= ACTIVITY_DECAY;
+
+        if (conflictBudget && conflicts >= conflictBudget) {
+          cancelUntil(0);
+          return Result::Unknown;
+        }
+        continue;
+      }
+
+      if (sinceRestart >= restartLimit) {
+        cancelUntil(0);
+        sinceRestart = 0;
+        restartLimit = luby(++restarts) * RESTART_BASE;
+        if (learntCount > maxLearnts)
+          reduceLearnts();
+        continue;
+      }
+
+      // assumptions are the first decisions, a level each
+      Lit next = -1;
+      while (decisionLevel() < assumptions.size()) {
+        const Lit assumption = assumptions[decisionLevel()];
+        if (value(assumption) == TRUE) {
+          trailLimits.push_back(trail.size());
+        } else if (value(assumption) == FALSE) {
+          cancelUntil(0);
+          return Result::Unsat;
+        } else {
+          next = assumption;
+          break;
+        }
+      }
+
+      if (next == -1) {
+        next = pickBranch();
+        if (next == -1) {
+          model.assign(assigns.size(), false);
+          for (Var var = 0; var < static_cast<Var>(assigns.size()); ++var)
+            model[var] = assigns[var] == TRUE;
+          cancelUntil(0);
+          return Result::Sat;
+        }
+      }
+      trailLimits.push_back(trail.size());
+      enqueue(next, -1);
+    }
+  }
+
+} // namespace sat
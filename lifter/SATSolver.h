@@ -0,0 +1,97 @@
+#pragma once
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+#include <cstdint>
+#include <vector>
+
+// small cdcl sat solver for the bit-blasted path queries. two watched
+// literals, 1-uip learning, vsids, phase saving, luby restarts and solving
+// under assumptions, so one instance can stay alive for a whole path.
+namespace sat {
+
+  using Var = int32_t;
+  using Lit = int32_t; // var * 2, +1 when negated
+
+  inline Lit mkLit(const Var var, const bool negated = false) {
+    return var * 2 + negated;
+  }
+  inline Lit negate(const Lit lit) { return lit ^ 1; }
+  inline Var varOf(const Lit lit) { return lit >> 1; }
+  inline bool isNegated(const Lit lit) { return lit & 1; }
+
+  enum class Result { Sat, Unsat, Unknown };
+
+  class Solver {
+  public:
+    Var newVar();
+    size_t varCount() const { return assigns.size(); }
+
+    // only between solves. false once the clauses cant be satisfied at all
+    bool addClause(llvm::ArrayRef<Lit> lits);
+
+    // Unknown when the conflict budget runs out, 0 means no budget
+    Result solve(llvm::ArrayRef<Lit> assumptions, uint64_t conflictBudget);
+
+    // after Sat
+    bool modelValue(const Var var) const { return model[var]; }
+
+  private:
+    enum : int8_t { FALSE = 0, TRUE = 1, UNDEF = 2 };
+
+    struct Clause {
+      llvm::SmallVector<Lit, 4> lits;
+      bool learnt = false;
+      bool deleted = false;
+    };
+
+    struct Watcher {
+      uint32_t clause;
+      Lit blocker; // if this is true the clause is already satisfied
+    };
+
+    std::vector<Clause> clauses;
+    std::vector<std::vector<Watcher>> watches; // by literal
+    std::vector<int8_t> assigns;
+    std::vector<int32_t> levels;
+    std::vector<int32_t> reasons; // clause index, -1 for decisions
+    std::vector<Lit> trail;
+    std::vector<size_t> trailLimits;
+    size_t propagated = 0;
+    bool ok = true;
+
+    std::vector<double> activity;
+    double activityIncrement = 1;
+    std::vector<bool> polarity;
+    std::vector<bool> seen;
+    std::vector<bool> model;
+
+    // max heap of variables by activity
+    std::vector<Var> heap;
+    std::vector<int32_t> heapIndex; // -1 when not in the heap
+
+    size_t learntCount = 0;
+    size_t maxLearnts = 8192;
+
+    int8_t value(const Lit lit) const {
+      const int8_t assigned = assigns[varOf(lit)];
+      return assigned == UNDEF ? UNDEF : assigned ^ isNegated(lit);
+    }
+    size_t decisionLevel() const { return trailLimits.size(); }
+
+    void enqueue(Lit lit, int32_t reason);
+    int32_t propagate();
+    void analyze(int32_t conflict, llvm::SmallVectorImpl<Lit>& learnt,
+                 size_t& backtrackLevel);
+    void cancelUntil(size_t level);
+    void attach(uint32_t index);
+    void reduceLearnts();
+
+    void bump(Var var);
+    void heapInsert(Var var);
+    void heapUp(size_t position);
+    void heapDown(size_t position);
+    Var heapPop();
+    Lit pickBranch();
+  };
+
+} // namespace sat
@@ -1,4 +1,5 @@
-﻿#include "FunctionSignatures.h"
+﻿#define MERGEN_LOG_CATEGORY debugging::LOG_SEMANTICS
+#include "FunctionSignatures.h"
 #include "GEPTracker.h"
 #include "OperandUtils.h"
 #include "includes.h"
@@ -131,6 +132,9 @@ Value* lifterClass::callFunctionIR(const string& functionName,
   vector<Value*> args = parseArgs(funcInfo);
   auto callresult = builder.CreateCall(externFunc, args);
 
+  // the callee may write anywhere through the pointers it got
+  symbolicStores.clear();
+
   SetRegisterValue(ZYDIS_REGISTER_RAX,
                    callresult); // rax = externalfunc()
   // check if the function is exit or something similar to that
@@ -241,27 +245,32 @@ void lifterClass::branchHelper(Value* condition, const string& instname,
   // execution from the other branch
 
   auto block = builder.GetInsertBlock();
-  block->setName(instname + to_string(numbered));
+  block->setName(instname + Twine(numbered));
   auto function = block->getParent();
 
   auto dest = operands[0];
-  auto true_jump_addr = dest.imm.value.s + blockInfo.runtime_address;
-  Value* true_jump =
-      ConstantInt::get(function->getReturnType(), true_jump_addr);
-  auto false_jump_addr = blockInfo.runtime_address;
-  Value* false_jump =
-      ConstantInt::get(function->getReturnType(), false_jump_addr);
-  Value* next_jump = nullptr;
-
-  if (!reverse)
-    next_jump = createSelectFolder(condition, true_jump, false_jump);
-  else
-    next_jump = createSelectFolder(condition, false_jump, true_jump);
+  uint64_t true_jump_addr = dest.imm.value.s + blockInfo.runtime_address;
+  uint64_t false_jump_addr = blockInfo.runtime_address;
+  if (reverse)
+    swap(true_jump_addr, false_jump_addr);
+
+  // a condition that can only go one way doesnt fork
+  switch (classifyPredicate(condition)) {
+  case OPAQUE_TRUE:
+    condition = builder.getTrue();
+    break;
+  case OPAQUE_FALSE:
+    condition = builder.getFalse();
+    break;
+  default:
+    break;
+  }
 
   uint64_t destination = 0;
-  solvePath(function, destination, next_jump);
+  solveConditionalBranch(function, destination, condition, true_jump_addr,
+                         false_jump_addr);
 
-  block->setName("previousjmp_block-" + to_string(destination) + "-");
+  block->setName("previousjmp_block-" + Twine(destination) + "-");
   // cout << "pathInfo:" << pathInfo << " dest: " << destination  <<
   // "\n";
 }
@@ -364,8 +373,8 @@ void lifterClass::lift_movaps() {
   auto src = operands[1];
 
   auto Rvalue =
-      GetOperandValue(src, src.size, to_string(blockInfo.runtime_address));
-  SetOperandValue(dest, Rvalue, to_string(blockInfo.runtime_address));
+      GetOperandValue(src, src.size, Twine(blockInfo.runtime_address));
+  SetOperandValue(dest, Rvalue, Twine(blockInfo.runtime_address));
 }
 */
 void lifterClass::lift_mov() {
@@ -374,24 +383,24 @@ void lifterClass::lift_mov() {
   auto src = operands[1];
 
   auto Rvalue =
-      GetOperandValue(src, src.size, to_string(blockInfo.runtime_address));
+      GetOperandValue(src, src.size, Twine(blockInfo.runtime_address));
 
   switch (instruction.mnemonic) {
   case ZYDIS_MNEMONIC_MOVSX: {
     Rvalue =
         createSExtFolder(Rvalue, Type::getIntNTy(context, dest.size),
-                         "movsx-" + to_string(blockInfo.runtime_address) + "-");
+                         "movsx-" + Twine(blockInfo.runtime_address) + "-");
     break;
   }
   case ZYDIS_MNEMONIC_MOVZX: {
     Rvalue =
         createZExtFolder(Rvalue, Type::getIntNTy(context, dest.size),
-                         "movzx-" + to_string(blockInfo.runtime_address) + "-");
+                         "movzx-" + Twine(blockInfo.runtime_address) + "-");
     break;
   }
   case ZYDIS_MNEMONIC_MOVSXD: {
     Rvalue = createSExtFolder(Rvalue, Type::getIntNTy(context, dest.size),
-                              "movsxd-" + to_string(blockInfo.runtime_address) +
+                              "movsxd-" + Twine(blockInfo.runtime_address) +
                                   "-");
     break;
   }
@@ -406,7 +415,7 @@ void lifterClass::lift_mov() {
 
   printvalue(Rvalue);
 
-  SetOperandValue(dest, Rvalue, to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, Rvalue, Twine(blockInfo.runtime_address));
 }
 
 void lifterClass::lift_cmovbz() {
@@ -443,7 +452,7 @@ void lifterClass::lift_cmovnbz() {
   Value* resultValue =
       createSelectFolder(nbeCondition, Rvalue, Lvalue, "cmovnbe");
 
-  SetOperandValue(dest, resultValue, to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, resultValue, Twine(blockInfo.runtime_address));
 }
 
 void lifterClass::lift_cmovz() {
@@ -457,7 +466,7 @@ void lifterClass::lift_cmovz() {
 
   Value* resultValue = createSelectFolder(zf, Rvalue, Lvalue, "cmovz");
 
-  SetOperandValue(dest, resultValue, to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, resultValue, Twine(blockInfo.runtime_address));
 }
 
 void lifterClass::lift_cmovnz() {
@@ -531,7 +540,7 @@ void lifterClass::lift_cmovnb() {
   Value* resultValue =
       createSelectFolder(createNotFolder(cf), Rvalue, Lvalue, "cmovnb");
 
-  SetOperandValue(dest, resultValue, to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, resultValue, Twine(blockInfo.runtime_address));
 }
 
 void lifterClass::lift_cmovns() {
@@ -735,7 +744,7 @@ void lifterClass::lift_call() {
 
       // callFunctionIR(registerValue->getName().str() + "_call_fnc", nullptr);
 
-      SetOperandValue(rsp, RspValue, to_string(blockInfo.runtime_address));
+      SetOperandValue(rsp, RspValue, Twine(blockInfo.runtime_address));
       break;
       // registerValue =
       //    ConstantInt::get(Type::getInt32Ty(context), 0x1337);
@@ -750,13 +759,13 @@ void lifterClass::lift_call() {
     break;
   }
 
-  SetOperandValue(rsp, result, to_string(blockInfo.runtime_address));
+  SetOperandValue(rsp, result, Twine(blockInfo.runtime_address));
   ; // sub rsp 8 last,
 
   auto push_into_rsp = GetRegisterValue(ZYDIS_REGISTER_RIP);
 
   SetOperandValue(rsp_memory, push_into_rsp,
-                  to_string(blockInfo.runtime_address));
+                  Twine(blockInfo.runtime_address));
   ; // sub rsp 8 last,
 
   auto bb = BasicBlock::Create(context, block_name.c_str(),
@@ -765,7 +774,7 @@ void lifterClass::lift_call() {
   // continue from [rsp]
   APInt temp;
 
-  builder.CreateBr(bb);
+  createBr(bb);
 
   printvalue2(jump_address);
 
@@ -798,7 +807,7 @@ void lifterClass::lift_ret() {
   auto realval = GetOperandValue(rspaddr, rspaddr.size);
 
   auto block = builder.GetInsertBlock();
-  block->setName("ret_check" + to_string(ret_count));
+  block->setName("ret_check" + Twine(ret_count));
   auto function = block->getParent();
   auto lastinst = builder.CreateRet(realval);
 
@@ -871,7 +880,7 @@ void lifterClass::lift_ret() {
                                     BinaryOperations::getBitness() / 8);
   auto rsp_result = createAddFolder(
       rspvalue, val,
-      "ret-new-rsp-" + to_string(blockInfo.runtime_address) + "-");
+      "ret-new-rsp-" + Twine(blockInfo.runtime_address) + "-");
 
   if (operands[0].type == ZYDIS_OPERAND_TYPE_IMMEDIATE) {
     rspaddr = operands[3];
@@ -893,7 +902,7 @@ void lifterClass::lift_jmp() {
   auto Value = GetOperandValue(dest, BinaryOperations::getBitness());
   auto ripval = GetRegisterValue(ZYDIS_REGISTER_RIP);
   auto newRip = createAddFolder(
-      Value, ripval, "jump-xd-" + to_string(blockInfo.runtime_address) + "-");
+      Value, ripval, "jump-xd-" + Twine(blockInfo.runtime_address) + "-");
 
   jmpcount++;
   auto targetv = GetOperandValue(dest, BinaryOperations::getBitness());
@@ -1452,8 +1461,8 @@ void lifterClass::lift_not() {
   auto Rvalue = GetOperandValue(dest, dest.size);
   Rvalue =
       createXorFolder(Rvalue, Constant::getAllOnesValue(Rvalue->getType()),
-                      "realnot-" + to_string(blockInfo.runtime_address) + "-");
-  SetOperandValue(dest, Rvalue, to_string(blockInfo.runtime_address));
+                      "realnot-" + Twine(blockInfo.runtime_address) + "-");
+  SetOperandValue(dest, Rvalue, Twine(blockInfo.runtime_address));
 
   printvalue(Rvalue);
   //  Flags Affected
@@ -1579,7 +1588,7 @@ void lifterClass::lift_sar() {
   clampedCount = createSelectFolder(isZeroed, maxShift, clampedCount);
   Value* result = createAShrFolder(
       Lvalue, clampedCount,
-      "sar-ashr-" + std::to_string(blockInfo.runtime_address) + "-");
+      "sar-ashr-" + Twine(blockInfo.runtime_address) + "-");
 
   auto last_shift = createAShrFolder(
       Lvalue,
@@ -1624,7 +1633,7 @@ void lifterClass::lift_sar() {
     setFlag(FLAG_OF, of);
   }
 
-  SetOperandValue(dest, result, std::to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, result, Twine(blockInfo.runtime_address));
 }
 
 // TODO fix
@@ -1644,7 +1653,7 @@ void lifterClass::lift_shr() {
 
   Value* result = createLShrFolder(
       Lvalue, clampedCount,
-      "shr-lshr-" + to_string(blockInfo.runtime_address) + "-");
+      "shr-lshr-" + Twine(blockInfo.runtime_address) + "-");
   Value* zero = ConstantInt::get(countValue->getType(), 0);
   Value* isZeroed =
       createICMPFolder(CmpInst::ICMP_UGT, clampedCount,
@@ -1690,7 +1699,7 @@ void lifterClass::lift_shr() {
   }
   printvalue(Lvalue) printvalue(clampedCount) printvalue(result) printvalue(
       isNotZero) printvalue(oldcf) printvalue(cfValue)
-      SetOperandValue(dest, result, std::to_string(blockInfo.runtime_address));
+      SetOperandValue(dest, result, Twine(blockInfo.runtime_address));
 }
 
 void lifterClass::lift_shl() {
@@ -1698,7 +1707,7 @@ void lifterClass::lift_shl() {
   auto dest = operands[0 + (instruction.mnemonic == ZYDIS_MNEMONIC_SHLX)];
   auto count = operands[1 + (instruction.mnemonic == ZYDIS_MNEMONIC_SHLX)];
   Value* Lvalue = GetOperandValue(dest, dest.size,
-                                  std::to_string(blockInfo.runtime_address));
+                                  Twine(blockInfo.runtime_address));
   Value* countValue = GetOperandValue(count, dest.size);
   unsigned bitWidth = Lvalue->getType()->getIntegerBitWidth();
   unsigned maskC = bitWidth == 64 ? 0x3f : 0x1f;
@@ -1790,7 +1799,7 @@ void lifterClass::lift_shl() {
                                 oldpf);
     });
   }
-  SetOperandValue(dest, result, std::to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, result, Twine(blockInfo.runtime_address));
 }
 
 void lifterClass::lift_bswap() {
@@ -1887,7 +1896,7 @@ void lifterClass::lift_xchg() {
 
   printvalue(Lvalue) printvalue(Rvalue);
 
-  SetOperandValue(dest, Rvalue, to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, Rvalue, Twine(blockInfo.runtime_address));
   ;
   SetOperandValue(src, Lvalue);
 }
@@ -1988,7 +1997,7 @@ void lifterClass::lift_shld() {
   setFlag(FLAG_ZF, computeZeroFlag(resultValue));
   setFlag(FLAG_PF, computeParityFlag(resultValue));
 
-  SetOperandValue(dest, resultValue, std::to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, resultValue, Twine(blockInfo.runtime_address));
 }
 
 void lifterClass::lift_shrd() {
@@ -2050,7 +2059,7 @@ void lifterClass::lift_shrd() {
   setFlag(FLAG_ZF, computeZeroFlag(resultValue));
   setFlag(FLAG_PF, computeParityFlag(resultValue));
 
-  SetOperandValue(dest, resultValue, std::to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, resultValue, Twine(blockInfo.runtime_address));
 }
 
 void lifterClass::lift_lea() {
@@ -2062,7 +2071,7 @@ void lifterClass::lift_lea() {
 
   printvalue(Rvalue)
 
-      SetOperandValue(dest, Rvalue, to_string(blockInfo.runtime_address));
+      SetOperandValue(dest, Rvalue, Twine(blockInfo.runtime_address));
   ;
 }
 
@@ -2079,7 +2088,7 @@ void lifterClass::lift_add_sub() {
   switch (instruction.mnemonic) {
   case ZYDIS_MNEMONIC_ADD: {
     result = createAddFolder(Lvalue, Rvalue,
-                             "realadd-" + to_string(blockInfo.runtime_address) +
+                             "realadd-" + Twine(blockInfo.runtime_address) +
                                  "-");
 
     setFlag(FLAG_AF, [this, result, Lvalue, Rvalue]() {
@@ -2106,7 +2115,7 @@ void lifterClass::lift_add_sub() {
   }
   case ZYDIS_MNEMONIC_SUB: {
     result = createSubFolder(Lvalue, Rvalue,
-                             "realsub-" + to_string(blockInfo.runtime_address) +
+                             "realsub-" + Twine(blockInfo.runtime_address) +
                                  "-");
 
     setFlag(FLAG_AF, [this, result, Lvalue, Rvalue]() {
@@ -2531,7 +2540,7 @@ void lifterClass::lift_xor() {
   auto Rvalue = GetOperandValue(src, dest.size);
   auto Lvalue = GetOperandValue(dest, dest.size);
   auto result = createXorFolder(
-      Lvalue, Rvalue, "realxor-" + to_string(blockInfo.runtime_address) + "-");
+      Lvalue, Rvalue, "realxor-" + Twine(blockInfo.runtime_address) + "-");
 
   printvalue(Lvalue) printvalue(Rvalue) printvalue(result);
 
@@ -2558,7 +2567,7 @@ void lifterClass::lift_or() {
   auto Rvalue = GetOperandValue(src, dest.size);
   auto Lvalue = GetOperandValue(dest, dest.size);
   auto result = createOrFolder(
-      Lvalue, Rvalue, "realor-" + to_string(blockInfo.runtime_address) + "-");
+      Lvalue, Rvalue, "realor-" + Twine(blockInfo.runtime_address) + "-");
 
   printvalue(Lvalue);
   printvalue(Rvalue);
@@ -2589,7 +2598,7 @@ void lifterClass::lift_and() {
   auto Lvalue = GetOperandValue(dest, dest.size);
 
   auto result = createAndFolder(
-      Lvalue, Rvalue, "realand-" + to_string(blockInfo.runtime_address) + "-");
+      Lvalue, Rvalue, "realand-" + Twine(blockInfo.runtime_address) + "-");
 
   auto sf = computeSignFlag(result);
   auto zf = computeZeroFlag(result);
@@ -2606,7 +2615,7 @@ void lifterClass::lift_and() {
 
   printvalue(Lvalue) printvalue(Rvalue) printvalue(result);
 
-  SetOperandValue(dest, result, "and" + to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, result, "and" + Twine(blockInfo.runtime_address));
 }
 
 void lifterClass::lift_andn() {
@@ -2618,7 +2627,7 @@ void lifterClass::lift_andn() {
 
   auto result =
       createAndFolder(createNotFolder(Lvalue), Rvalue,
-                      "realand-" + to_string(blockInfo.runtime_address) + "-");
+                      "realand-" + Twine(blockInfo.runtime_address) + "-");
 
   auto sf = computeSignFlag(result);
   auto zf = computeZeroFlag(result);
@@ -2636,7 +2645,7 @@ void lifterClass::lift_andn() {
 
   printvalue(Lvalue) printvalue(Rvalue) printvalue(result);
 
-  SetOperandValue(dest, result, "and" + to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, result, "and" + Twine(blockInfo.runtime_address));
 }
 
 /*
@@ -2751,7 +2760,7 @@ void lifterClass::lift_ror() {
       createShlFolder(Lvalue, createSubFolder(bitWidth, Rvalue));
   Value* result =
       createOrFolder(rightshifted, leftshifted,
-                     "ror-" + std::to_string(blockInfo.runtime_address) + "-");
+                     "ror-" + Twine(blockInfo.runtime_address) + "-");
 
   Value* msb = createLShrFolder(result, MSBpos);
   Value* cf = createZExtOrTruncFolder(msb, Type::getInt1Ty(context), "ror-cf");
@@ -2785,7 +2794,7 @@ void lifterClass::lift_inc() {
 
   Value* one = ConstantInt::get(Lvalue->getType(), 1, true);
   Value* result = createAddFolder(
-      Lvalue, one, "inc-" + std::to_string(blockInfo.runtime_address) + "-");
+      Lvalue, one, "inc-" + Twine(blockInfo.runtime_address) + "-");
   Value* of = computeOverflowFlagAdd(Lvalue, one, result);
   // The CF flag is not affected. The OF, SF, ZF, AF, and PF flags are set
   // according to the result.
@@ -2822,7 +2831,7 @@ void lifterClass::lift_dec() {
 
   Value* one = ConstantInt::get(Lvalue->getType(), 1, true);
   Value* result = createSubFolder(
-      Lvalue, one, "dec-" + std::to_string(blockInfo.runtime_address) + "-");
+      Lvalue, one, "dec-" + Twine(blockInfo.runtime_address) + "-");
   Value* of = computeOverflowFlagSub(Lvalue, one, result);
 
   // The CF flag is not affected. The OF, SF, ZF, AF, and PF flags are set
@@ -2865,13 +2874,13 @@ void lifterClass::lift_push() {
       dest.size / 8); // jokes on me apparently this is not a fixed value
   auto result = createSubFolder(RspValue, val,
                                 "pushing_newrsp-" +
-                                    to_string(blockInfo.runtime_address) + "-");
+                                    Twine(blockInfo.runtime_address) + "-");
 
   printvalue(RspValue) printvalue(result)
-      SetOperandValue(rsp, result, to_string(blockInfo.runtime_address));
+      SetOperandValue(rsp, result, Twine(blockInfo.runtime_address));
   ; // sub rsp 8 first,
 
-  SetOperandValue(dest, Rvalue, to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, Rvalue, Twine(blockInfo.runtime_address));
   ; // then mov rsp, val
 }
 
@@ -2888,12 +2897,12 @@ void lifterClass::lift_pushfq() {
   auto val = ConstantInt::get(Type::getInt64Ty(context), src.size / 8);
   auto result = createSubFolder(RspValue, val);
 
-  SetOperandValue(rsp, result, to_string(blockInfo.runtime_address));
+  SetOperandValue(rsp, result, Twine(blockInfo.runtime_address));
   ; // sub rsp 8 first,
 
   // pushFlags( dest, Rvalue,
-  // to_string(blockInfo.runtime_address));;
-  SetOperandValue(dest, Rvalue, to_string(blockInfo.runtime_address));
+  // Twine(blockInfo.runtime_address));;
+  SetOperandValue(dest, Rvalue, Twine(blockInfo.runtime_address));
   ; // then mov rsp, val
 }
 
@@ -2904,23 +2913,23 @@ void lifterClass::lift_pop() {
   auto rsp = operands[1];
 
   auto Rvalue =
-      GetOperandValue(src, dest.size, to_string(blockInfo.runtime_address));
+      GetOperandValue(src, dest.size, Twine(blockInfo.runtime_address));
   ;
   auto RspValue =
-      GetOperandValue(rsp, rsp.size, to_string(blockInfo.runtime_address));
+      GetOperandValue(rsp, rsp.size, Twine(blockInfo.runtime_address));
   ;
 
   auto val = ConstantInt::getSigned(Type::getInt64Ty(context),
                                     dest.size / 8); // assuming its x64
   auto result = createAddFolder(RspValue, val,
                                 "popping_new_rsp-" +
-                                    to_string(blockInfo.runtime_address) + "-");
+                                    Twine(blockInfo.runtime_address) + "-");
 
   printvalue(Rvalue) printvalue(RspValue) printvalue(result);
 
   SetOperandValue(rsp, result); // then add rsp 8
 
-  SetOperandValue(dest, Rvalue, to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, Rvalue, Twine(blockInfo.runtime_address));
   ; // mov val, rsp first
 }
 
@@ -2933,10 +2942,10 @@ void lifterClass::lift_leave() {
   // then [xsp] to xbp
 
   auto xbp = GetOperandValue(src1, dest.size,
-                             std::to_string(blockInfo.runtime_address));
+                             Twine(blockInfo.runtime_address));
 
   SetOperandValue(dest, xbp,
-                  std::to_string(blockInfo.runtime_address)); // move xbp to xsp
+                  Twine(blockInfo.runtime_address)); // move xbp to xsp
 
   auto popstack = popStack(dest.size / 8);
 
@@ -2952,18 +2961,18 @@ void lifterClass::lift_popfq() {
   auto rsp = operands[0];  // rsp
 
   auto Rvalue =
-      GetOperandValue(src, dest.size, to_string(blockInfo.runtime_address));
+      GetOperandValue(src, dest.size, Twine(blockInfo.runtime_address));
 
   auto RspValue =
-      GetOperandValue(rsp, rsp.size, to_string(blockInfo.runtime_address));
+      GetOperandValue(rsp, rsp.size, Twine(blockInfo.runtime_address));
 
   auto val = ConstantInt::getSigned(Type::getInt64Ty(context), dest.size / 8);
   auto result = createAddFolder(
-      RspValue, val, "popfq-" + to_string(blockInfo.runtime_address) + "-");
+      RspValue, val, "popfq-" + Twine(blockInfo.runtime_address) + "-");
 
-  SetOperandValue(dest, Rvalue, to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, Rvalue, Twine(blockInfo.runtime_address));
   // mov val, rsp first
-  SetOperandValue(rsp, result, to_string(blockInfo.runtime_address));
+  SetOperandValue(rsp, result, Twine(blockInfo.runtime_address));
   // then add rsp 8
 }
 
@@ -2978,10 +2987,10 @@ void lifterClass::lift_adc() {
   cf = createZExtFolder(cf, Lvalue->getType());
 
   Value* tempResult = createAddFolder(
-      Lvalue, Rvalue, "adc-temp-" + to_string(blockInfo.runtime_address) + "-");
+      Lvalue, Rvalue, "adc-temp-" + Twine(blockInfo.runtime_address) + "-");
   Value* result = createAddFolder(
       tempResult, cf,
-      "adc-result-" + to_string(blockInfo.runtime_address) + "-");
+      "adc-result-" + Twine(blockInfo.runtime_address) + "-");
   // The OF, SF, ZF, AF, CF, and PF flags are set according to the result.
 
   printvalue(Lvalue) printvalue(Rvalue) printvalue(tempResult)
@@ -3022,12 +3031,12 @@ void lifterClass::lift_xadd() {
   auto Rvalue = GetOperandValue(src, src.size);
 
   Value* sumValue = createAddFolder(
-      Lvalue, Rvalue, "xadd_sum-" + to_string(blockInfo.runtime_address) + "-");
+      Lvalue, Rvalue, "xadd_sum-" + Twine(blockInfo.runtime_address) + "-");
 
-  SetOperandValue(dest, sumValue, to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, sumValue, Twine(blockInfo.runtime_address));
   ;
 
-  SetOperandValue(src, Lvalue, to_string(blockInfo.runtime_address));
+  SetOperandValue(src, Lvalue, Twine(blockInfo.runtime_address));
   ;
   /*
   TEMP := SRC + DEST;
@@ -3406,7 +3415,7 @@ void lifterClass::lift_setnp() {
   Value* resultValue =
       createZExtFolder(createNotFolder(pf), Type::getInt8Ty(context));
 
-  SetOperandValue(dest, resultValue, to_string(blockInfo.runtime_address));
+  SetOperandValue(dest, resultValue, Twine(blockInfo.runtime_address));
 }
 
 void lifterClass::lift_setb() {
@@ -3583,7 +3592,7 @@ void lifterClass::lift_btr() {
 
   Value* bit = createLShrFolder(baseVal, bitOffsetMasked,
                                 "btr-lshr-" +
-                                    to_string(blockInfo.runtime_address) + "-");
+                                    Twine(blockInfo.runtime_address) + "-");
 
   Value* one = ConstantInt::get(bit->getType(), 1);
 
@@ -3596,7 +3605,7 @@ void lifterClass::lift_btr() {
 
   mask = createNotFolder(mask); // invert mask
   baseVal = createAndFolder(
-      baseVal, mask, "btr-and-" + to_string(blockInfo.runtime_address) + "-");
+      baseVal, mask, "btr-and-" + Twine(blockInfo.runtime_address) + "-");
 
   SetOperandValue(base, baseVal);
   printvalue(bitOffset);
@@ -3811,7 +3820,7 @@ void lifterClass::lift_btc() {
 
   Value* bit = createLShrFolder(baseVal, bitOffsetMasked,
                                 "btc-lshr-" +
-                                    to_string(blockInfo.runtime_address) + "-");
+                                    Twine(blockInfo.runtime_address) + "-");
 
   Value* one = ConstantInt::get(bit->getType(), 1);
 
@@ -3823,7 +3832,7 @@ void lifterClass::lift_btc() {
                                 bitOffsetMasked, "btc-shl");
 
   baseVal = createXorFolder(
-      baseVal, mask, "btc-and-" + to_string(blockInfo.runtime_address) + "-");
+      baseVal, mask, "btc-and-" + Twine(blockInfo.runtime_address) + "-");
 
   SetOperandValue(base, baseVal);
   printvalue(bitOffset);
@@ -3945,7 +3954,7 @@ void lifterClass::lift_bts() {
 
   Value* bit = createLShrFolder(baseVal, bitOffsetMasked,
                                 "bts-lshr-" +
-                                    to_string(blockInfo.runtime_address) + "-");
+                                    Twine(blockInfo.runtime_address) + "-");
 
   Value* one = ConstantInt::get(bit->getType(), 1);
 
@@ -3957,7 +3966,7 @@ void lifterClass::lift_bts() {
                                 bitOffsetMasked, "bts-shl");
 
   baseVal = createOrFolder(
-      baseVal, mask, "bts-or-" + to_string(blockInfo.runtime_address) + "-");
+      baseVal, mask, "bts-or-" + Twine(blockInfo.runtime_address) + "-");
 
   SetOperandValue(base, baseVal);
   printvalue(bitOffset);
@@ -4649,7 +4658,7 @@ void lifterClass::liftInstruction() {
 
     auto bb = BasicBlock::Create(context, "returnToOrgCF",
                                  builder.GetInsertBlock()->getParent());
-    builder.CreateBr(bb);
+    createBr(bb);
 
     blockInfo = BBInfo(jump_address, bb);
     run = 0;
@@ -4682,7 +4691,7 @@ void lifterClass::liftInstruction() {
     auto RIP_value = cast<ConstantInt>(next_jump);
     jump_address = RIP_value->getZExtValue();
 
-    builder.CreateBr(bb);
+    createBr(bb);
 
     blockInfo = BBInfo(jump_address, bb);
     run = 0;
@@ -4704,5 +4713,7 @@ void lifterClass::liftInstruction() {
   }
 
   // do something for prefixes like rep here
+  if (tryConcreteExecution())
+    return;
   liftInstructionSemantics();
 }
\ No newline at end of file
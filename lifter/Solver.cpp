@@ -0,0 +1,884 @@
+#define MERGEN_LOG_CATEGORY debugging::LOG_PATH
+#include "Solver.h"
+#include "SATSolver.h"
+#include "includes.h"
+#include "lifterClass.h"
+#include "utils.h"
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <unordered_map>
+#include <vector>
+#ifdef MERGEN_HAS_Z3
+#include <z3++.h>
+#endif
+
+namespace solver {
+
+  Config& config() {
+    static Config cfg;
+    return cfg;
+  }
+
+  bool setBackend(const std::string& value) {
+    if (value == "builtin")
+      config().backend = BackendKind::Builtin;
+#ifdef MERGEN_HAS_Z3
+    else if (value == "z3")
+      config().backend = BackendKind::Z3;
+#endif
+    else if (value == "none")
+      config().backend = BackendKind::None;
+    else
+      return false;
+    return true;
+  }
+
+  bool setConflictBudget(const std::string& value) {
+    return !llvm::StringRef(value).getAsInteger(10, config().conflictBudget);
+  }
+
+  namespace {
+    constexpr unsigned MAX_KEY_NODES = 4096;
+
+    // what the backends translate, anything else is a free input
+    bool isModelled(Value* V) {
+      auto I = dyn_cast<Instruction>(V);
+      if (!I || !I->getType()->isIntegerTy() ||
+          I->getType()->getIntegerBitWidth() > 64)
+        return false;
+      switch (I->getOpcode()) {
+      case Instruction::Add:
+      case Instruction::Sub:
+      case Instruction::Mul:
+      case Instruction::And:
+      case Instruction::Or:
+      case Instruction::Xor:
+      case Instruction::Shl:
+      case Instruction::LShr:
+      case Instruction::AShr:
+      case Instruction::ZExt:
+      case Instruction::SExt:
+      case Instruction::Trunc:
+      case Instruction::Select:
+      case Instruction::ICmp:
+        break;
+      default:
+        return false;
+      }
+      for (auto& operand : I->operands())
+        if (!operand->getType()->isIntegerTy() ||
+            operand->getType()->getIntegerBitWidth() > 64)
+          return false;
+      return true;
+    }
+
+    // operands before users without recursing, expressions here can be
+    // thousands of instructions deep
+    template <typename Visit>
+    bool walkPostOrder(llvm::ArrayRef<Value*> roots, const unsigned limit,
+                       Visit visit) {
+      llvm::DenseSet<Value*> done;
+      std::vector<std::pair<Value*, bool>> stack;
+      for (auto it = roots.rbegin(); it != roots.rend(); ++it)
+        stack.push_back({*it, false});
+      while (!stack.empty()) {
+        auto [V, expanded] = stack.back();
+        if (done.contains(V)) {
+          stack.pop_back();
+          continue;
+        }
+        if (!expanded && isModelled(V)) {
+          stack.back().second = true;
+          auto I = cast<Instruction>(V);
+          for (unsigned i = I->getNumOperands(); i-- > 0;)
+            if (!done.contains(I->getOperand(i)))
+              stack.push_back({I->getOperand(i), false});
+          continue;
+        }
+        stack.pop_back();
+        done.insert(V);
+        if (done.size() > limit)
+          return false;
+        visit(V);
+      }
+      return true;
+    }
+
+    class BitBlaster {
+    public:
+      using Bits = llvm::SmallVector<sat::Lit, 64>;
+
+      explicit BitBlaster(sat::Solver& solver) : solver(solver) {
+        trueLit = sat::mkLit(solver.newVar());
+        solver.addClause({trueLit});
+      }
+
+      const Bits& bitsOf(Value* V) {
+        if (auto it = blasted.find(V); it != blasted.end())
+          return it->second;
+        walkPostOrder({V}, ~0u, [&](Value* current) {
+          if (!blasted.contains(current))
+            blasted[current] = encode(current);
+        });
+        return blasted[V];
+      }
+
+      bool isBlasted(Value* V) const { return blasted.contains(V); }
+
+      sat::Lit equals(Value* V, const APInt& k) {
+        return equal(bitsOf(V), constant(k));
+      }
+
+      sat::Lit truth() const { return trueLit; }
+
+    private:
+      sat::Solver& solver;
+      sat::Lit trueLit;
+      llvm::DenseMap<Value*, Bits> blasted;
+      // structural hashing, the same gate is only built once
+      llvm::DenseMap<uint64_t, sat::Lit> andGates, xorGates;
+
+      sat::Lit falseLit() const { return sat::negate(trueLit); }
+      sat::Lit fresh() { return sat::mkLit(solver.newVar()); }
+
+      Bits constant(const APInt& value) {
+        Bits bits;
+        for (unsigned i = 0; i < value.getBitWidth(); ++i)
+          bits.push_back(value[i] ? trueLit : falseLit());
+        return bits;
+      }
+
+      sat::Lit mkAnd(sat::Lit a, sat::Lit b) {
+        if (a == falseLit() || b == falseLit() || a == sat::negate(b))
+          return falseLit();
+        if (a == trueLit || a == b)
+          return b;
+        if (b == trueLit)
+          return a;
+        if (a > b)
+          std::swap(a, b);
+        const uint64_t key = (uint64_t(uint32_t(a)) << 32) | uint32_t(b);
+        if (auto it = andGates.find(key); it != andGates.end())
+          return it->second;
+        const sat::Lit g = fresh();
+        solver.addClause({sat::negate(g), a});
+        solver.addClause({sat::negate(g), b});
+        solver.addClause({g, sat::negate(a), sat::negate(b)});
+        return andGates[key] = g;
+      }
+
+      sat::Lit mkOr(const sat::Lit a, const sat::Lit b) {
+        return sat::negate(mkAnd(sat::negate(a), sat::negate(b)));
+      }
+
+      sat::Lit mkXor(sat::Lit a, sat::Lit b) {
+        if (a == falseLit())
+          return b;
+        if (b == falseLit())
+          return a;
+        if (a == trueLit)
+          return sat::negate(b);
+        if (b == trueLit)
+          return sat::negate(a);
+        if (a == b)
+          return falseLit();
+        if (a == sat::negate(b))
+          return trueLit;
+        // xor only cares about the polarity of the result
+        const bool flip = sat::isNegated(a) != sat::isNegated(b);
+        a = sat::mkLit(sat::varOf(a));
+        b = sat::mkLit(sat::varOf(b));
+        if (a > b)
+          std::swap(a, b);
+        const uint64_t key = (uint64_t(uint32_t(a)) << 32) | uint32_t(b);
+        sat::Lit g;
+        if (auto it = xorGates.find(key); it != xorGates.end()) {
+          g = it->second;
+        } else {
+          g = fresh();
+          solver.addClause({sat::negate(g), a, b});
+          solver.addClause({sat::negate(g), sat::negate(a), sat::negate(b)});
+          solver.addClause({g, sat::negate(a), b});
+          solver.addClause({g, a, sat::negate(b)});
+          xorGates[key] = g;
+        }
+        return flip ? sat::negate(g) : g;
+      }
+
+      sat::Lit mkMux(const sat::Lit select, const sat::Lit T,
+                     const sat::Lit F) {
+        if (select == trueLit || T == F)
+          return T;
+        if (select == falseLit())
+          return F;
+        return mkOr(mkAnd(select, T), mkAnd(sat::negate(select), F));
+      }
+
+      Bits add(const Bits& a, const Bits& b, sat::Lit carry,
+               sat::Lit* carryOut = nullptr) {
+        Bits sum;
+        for (unsigned i = 0; i < a.size(); ++i) {
+          const sat::Lit half = mkXor(a[i], b[i]);
+          sum.push_back(mkXor(half, carry));
+          carry = mkOr(mkAnd(a[i], b[i]), mkAnd(carry, half));
+        }
+        if (carryOut)
+          *carryOut = carry;
+        return sum;
+      }
+
+      Bits invert(const Bits& a) {
+        Bits inverted;
+        for (auto bit : a)
+          inverted.push_back(sat::negate(bit));
+        return inverted;
+      }
+
+      sat::Lit unsignedLess(const Bits& a, const Bits& b) {
+        // a - b borrows when a < b
+        sat::Lit carry;
+        add(a, invert(b), trueLit, &carry);
+        return sat::negate(carry);
+      }
+
+      sat::Lit equal(const Bits& a, const Bits& b) {
+        sat::Lit result = trueLit;
+        for (unsigned i = 0; i < a.size(); ++i)
+          result = mkAnd(result, sat::negate(mkXor(a[i], b[i])));
+        return result;
+      }
+
+      Bits multiply(const Bits& a, const Bits& b) {
+        Bits result(a.size(), falseLit());
+        for (unsigned i = 0; i < b.size(); ++i) {
+          if (b[i] == falseLit())
+            continue;
+          Bits partial(a.size(), falseLit());
+          for (unsigned j = i; j < a.size(); ++j)
+            partial[j] = mkAnd(a[j - i], b[i]);
+          result = add(result, partial, falseLit());
+        }
+        return result;
+      }
+
+      Bits shiftBy(const Bits& a, const unsigned amount, const unsigned opcode) {
+        const unsigned width = a.size();
+        const sat::Lit fill =
+            opcode == Instruction::AShr ? a.back() : falseLit();
+        Bits shifted(width, falseLit());
+        for (unsigned i = 0; i < width; ++i) {
+          if (opcode == Instruction::Shl)
+            shifted[i] = i >= amount ? a[i - amount] : falseLit();
+          else
+            shifted[i] = i + amount < width ? a[i + amount] : fill;
+        }
+        return shifted;
+      }
+
+      // oversized amounts give 0, same as the folders
+      Bits shift(const Bits& a, const Bits& amount, const unsigned opcode) {
+        const unsigned width = a.size();
+        Bits result = a;
+        for (unsigned stage = 0; (1u << stage) < width; ++stage) {
+          if (stage >= amount.size())
+            break;
+          const Bits shifted = shiftBy(result, 1u << stage, opcode);
+          for (unsigned i = 0; i < width; ++i)
+            result[i] = mkMux(amount[stage], shifted[i], result[i]);
+        }
+        const sat::Lit inRange =
+            unsignedLess(amount, constant(APInt(amount.size(), width)));
+        for (auto& bit : result)
+          bit = mkAnd(inRange, bit);
+        return result;
+      }
+
+      Bits encode(Value* V) {
+        const unsigned width = V->getType()->getIntegerBitWidth();
+        if (auto C = dyn_cast<ConstantInt>(V))
+          return constant(C->getValue());
+        if (!isModelled(V)) {
+          Bits bits;
+          for (unsigned i = 0; i < width; ++i)
+            bits.push_back(fresh());
+          return bits;
+        }
+
+        auto I = cast<Instruction>(V);
+        auto operand = [&](unsigned i) -> const Bits& {
+          return blasted.find(I->getOperand(i))->second;
+        };
+        const Bits& a = operand(0);
+        switch (I->getOpcode()) {
+        case Instruction::Add:
+          return add(a, operand(1), falseLit());
+        case Instruction::Sub:
+          return add(a, invert(operand(1)), trueLit);
+        case Instruction::Mul:
+          return multiply(a, operand(1));
+        case Instruction::And:
+        case Instruction::Or:
+        case Instruction::Xor: {
+          Bits bits;
+          for (unsigned i = 0; i < width; ++i)
+            bits.push_back(I->getOpcode() == Instruction::And
+                               ? mkAnd(a[i], operand(1)[i])
+                           : I->getOpcode() == Instruction::Or
+                               ? mkOr(a[i], operand(1)[i])
+                               : mkXor(a[i], operand(1)[i]));
+          return bits;
+        }
+        case Instruction::Shl:
+        case Instruction::LShr:
+        case Instruction::AShr: {
+          if (auto C = dyn_cast<ConstantInt>(I->getOperand(1))) {
+            if (C->getValue().uge(width))
+              return Bits(width, falseLit());
+            return shiftBy(a, C->getZExtValue(), I->getOpcode());
+          }
+          return shift(a, operand(1), I->getOpcode());
+        }
+        case Instruction::ZExt:
+        case Instruction::SExt: {
+          Bits bits = a;
+          const sat::Lit fill =
+              I->getOpcode() == Instruction::SExt ? a.back() : falseLit();
+          bits.resize(width, fill);
+          return bits;
+        }
+        case Instruction::Trunc:
+          return Bits(a.begin(), a.begin() + width);
+        case Instruction::Select: {
+          Bits bits;
+          for (unsigned i = 0; i < width; ++i)
+            bits.push_back(mkMux(a[0], operand(1)[i], operand(2)[i]));
+          return bits;
+        }
+        case Instruction::ICmp: {
+          auto predicate = cast<ICmpInst>(I)->getPredicate();
+          Bits L = a, R = operand(1);
+          if (ICmpInst::isSigned(predicate)) {
+            // flipping the sign bits turns signed order into unsigned
+            L.back() = sat::negate(L.back());
+            R.back() = sat::negate(R.back());
+          }
+          sat::Lit result;
+          switch (predicate) {
+          case CmpInst::ICMP_EQ:
+            result = equal(L, R);
+            break;
+          case CmpInst::ICMP_NE:
+            result = sat::negate(equal(L, R));
+            break;
+          case CmpInst::ICMP_ULT:
+          case CmpInst::ICMP_SLT:
+            result = unsignedLess(L, R);
+            break;
+          case CmpInst::ICMP_UGT:
+          case CmpInst::ICMP_SGT:
+            result = unsignedLess(R, L);
+            break;
+          case CmpInst::ICMP_ULE:
+          case CmpInst::ICMP_SLE:
+            result = sat::negate(unsignedLess(R, L));
+            break;
+          default:
+            result = sat::negate(unsignedLess(L, R));
+            break;
+          }
+          return Bits{result};
+        }
+        default:
+          UNREACHABLE("unmodelled instruction in the bit blaster");
+        }
+      }
+    };
+
+    class BuiltinBackend : public Backend {
+    public:
+      void assertCondition(Value* condition, const bool value) override {
+        const sat::Lit lit = blaster.bitsOf(condition)[0];
+        solver.addClause({value ? lit : sat::negate(lit)});
+      }
+
+      Result
+      check(llvm::ArrayRef<std::pair<Value*, bool>> conditions,
+            llvm::ArrayRef<std::pair<Value*, APInt>> excluded) override {
+        llvm::SmallVector<sat::Lit, 16> assumptions;
+        for (const auto& [condition, value] : conditions) {
+          const sat::Lit lit = blaster.bitsOf(condition)[0];
+          assumptions.push_back(value ? lit : sat::negate(lit));
+        }
+        for (const auto& [V, k] : excluded)
+          assumptions.push_back(sat::negate(blaster.equals(V, k)));
+
+        switch (solver.solve(assumptions, config().conflictBudget)) {
+        case sat::Result::Sat:
+          return Result::Sat;
+        case sat::Result::Unsat:
+          return Result::Unsat;
+        default:
+          return Result::Unknown;
+        }
+      }
+
+      void track(Value* V) override { blaster.bitsOf(V); }
+
+      std::optional<APInt> modelValue(Value* V) override {
+        if (!blaster.isBlasted(V))
+          return std::nullopt;
+        const auto& bits = blaster.bitsOf(V);
+        APInt value(bits.size(), 0);
+        for (unsigned i = 0; i < bits.size(); ++i)
+          value.setBitVal(i, solver.modelValue(sat::varOf(bits[i])) !=
+                                 sat::isNegated(bits[i]));
+        return value;
+      }
+
+    private:
+      sat::Solver solver;
+      BitBlaster blaster{solver};
+    };
+
+#ifdef MERGEN_HAS_Z3
+    class Z3Backend : public Backend {
+    public:
+      Z3Backend() : solver(context) {}
+
+      void assertCondition(Value* condition, const bool value) override {
+        solver.add(translate(condition) == context.bv_val(value, 1));
+      }
+
+      Result
+      check(llvm::ArrayRef<std::pair<Value*, bool>> conditions,
+            llvm::ArrayRef<std::pair<Value*, APInt>> excluded) override {
+        if (config().conflictBudget) {
+          z3::params params(context);
+          params.set("max_conflicts",
+                     static_cast<unsigned>(std::min<uint64_t>(
+                         config().conflictBudget, ~0u)));
+          solver.set(params);
+        }
+
+        solver.push();
+        for (const auto& [condition, value] : conditions)
+          solver.add(translate(condition) == context.bv_val(value, 1));
+        for (const auto& [V, k] : excluded)
+          solver.add(translate(V) !=
+                     context.bv_val(k.getZExtValue(), k.getBitWidth()));
+        const auto result = solver.check();
+        model.reset();
+        if (result == z3::sat)
+          model.emplace(solver.get_model());
+        solver.pop();
+
+        switch (result) {
+        case z3::sat:
+          return Result::Sat;
+        case z3::unsat:
+          return Result::Unsat;
+        default:
+          return Result::Unknown;
+        }
+      }
+
+      void track(Value* V) override { translate(V); }
+
+      std::optional<APInt> modelValue(Value* V) override {
+        auto it = exprs.find(V);
+        if (!model || it == exprs.end())
+          return std::nullopt;
+        auto evaluated = model->eval(it->second, true);
+        return APInt(V->getType()->getIntegerBitWidth(),
+                     evaluated.get_numeral_uint64());
+      }
+
+    private:
+      z3::context context;
+      z3::solver solver;
+      std::optional<z3::model> model;
+      std::unordered_map<Value*, z3::expr> exprs;
+      unsigned leafCount = 0;
+
+      z3::expr translate(Value* root) {
+        walkPostOrder({root}, ~0u, [&](Value* V) {
+          if (!exprs.count(V))
+            exprs.emplace(V, encode(V));
+        });
+        return exprs.at(root);
+      }
+
+      z3::expr boolToBits(const z3::expr& condition) {
+        return z3::ite(condition, context.bv_val(1, 1), context.bv_val(0, 1));
+      }
+
+      z3::expr encode(Value* V) {
+        const unsigned width = V->getType()->getIntegerBitWidth();
+        if (auto C = dyn_cast<ConstantInt>(V))
+          return context.bv_val(C->getZExtValue(), width);
+        if (!isModelled(V))
+          return context.bv_const(
+              ("v" + std::to_string(leafCount++)).c_str(), width);
+
+        auto I = cast<Instruction>(V);
+        const z3::expr a = exprs.at(I->getOperand(0));
+        auto b = [&]() { return exprs.at(I->getOperand(1)); };
+        const auto zero = context.bv_val(0, width);
+        const auto limit = context.bv_val(width, width);
+        switch (I->getOpcode()) {
+        case Instruction::Add:
+          return a + b();
+        case Instruction::Sub:
+          return a - b();
+        case Instruction::Mul:
+          return a * b();
+        case Instruction::And:
+          return a & b();
+        case Instruction::Or:
+          return a | b();
+        case Instruction::Xor:
+          return a ^ b();
+        case Instruction::Shl:
+          return z3::ite(z3::uge(b(), limit), zero, z3::shl(a, b()));
+        case Instruction::LShr:
+          return z3::ite(z3::uge(b(), limit), zero, z3::lshr(a, b()));
+        case Instruction::AShr:
+          return z3::ite(z3::uge(b(), limit), zero, z3::ashr(a, b()));
+        case Instruction::ZExt:
+          return z3::zext(a, width - a.get_sort().bv_size());
+        case Instruction::SExt:
+          return z3::sext(a, width - a.get_sort().bv_size());
+        case Instruction::Trunc:
+          return a.extract(width - 1, 0);
+        case Instruction::Select:
+          return z3::ite(a == context.bv_val(1, 1),
+                         exprs.at(I->getOperand(1)),
+                         exprs.at(I->getOperand(2)));
+        case Instruction::ICmp: {
+          const auto R = b();
+          switch (cast<ICmpInst>(I)->getPredicate()) {
+          case CmpInst::ICMP_EQ:
+            return boolToBits(a == R);
+          case CmpInst::ICMP_NE:
+            return boolToBits(a != R);
+          case CmpInst::ICMP_ULT:
+            return boolToBits(z3::ult(a, R));
+          case CmpInst::ICMP_ULE:
+            return boolToBits(z3::ule(a, R));
+          case CmpInst::ICMP_UGT:
+            return boolToBits(z3::ugt(a, R));
+          case CmpInst::ICMP_UGE:
+            return boolToBits(z3::uge(a, R));
+          case CmpInst::ICMP_SLT:
+            return boolToBits(z3::slt(a, R));
+          case CmpInst::ICMP_SLE:
+            return boolToBits(z3::sle(a, R));
+          case CmpInst::ICMP_SGT:
+            return boolToBits(z3::sgt(a, R));
+          default:
+            return boolToBits(z3::sge(a, R));
+          }
+        }
+        default:
+          UNREACHABLE("unmodelled instruction in the z3 backend");
+        }
+      }
+    };
+#endif
+  } // namespace
+
+  std::unique_ptr<Backend> createBackend() {
+    switch (config().backend) {
+    case BackendKind::Builtin:
+      return std::make_unique<BuiltinBackend>();
+#ifdef MERGEN_HAS_Z3
+    case BackendKind::Z3:
+      return std::make_unique<Z3Backend>();
+#endif
+    default:
+      return nullptr;
+    }
+  }
+
+  std::string canonicalKey(llvm::ArrayRef<Value*> roots) {
+    llvm::DenseMap<Value*, unsigned> ids;
+    unsigned leaves = 0;
+    std::string key;
+    const bool small = walkPostOrder(roots, MAX_KEY_NODES, [&](Value* V) {
+      const unsigned width = V->getType()->getIntegerBitWidth();
+      if (auto C = dyn_cast<ConstantInt>(V)) {
+        key += "k" + std::to_string(width) + ":" +
+               llvm::toString(C->getValue(), 16, false);
+      } else if (isModelled(V)) {
+        auto I = cast<Instruction>(V);
+        key += "(" + std::to_string(I->getOpcode());
+        if (auto cmp = dyn_cast<ICmpInst>(I))
+          key += "." + std::to_string(cmp->getPredicate());
+        key += ":" + std::to_string(width);
+        for (auto& operand : I->operands())
+          key += " " + std::to_string(ids[operand]);
+        key += ")";
+      } else {
+        // inputs by order of appearance, not by who they are
+        key += "v" + std::to_string(width) + ":" + std::to_string(leaves++);
+      }
+      key += ";";
+      const unsigned id = ids.size();
+      ids[V] = id;
+    });
+    if (!small)
+      return "";
+    for (auto root : roots)
+      key += "|" + std::to_string(ids[root]);
+    return key;
+  }
+
+} // namespace solver
+
+namespace {
+  // answers only depend on the shape of the query, so paths share them
+  std::unordered_map<std::string, solver::Result> feasibilityCache;
+  std::unordered_map<std::string, std::optional<std::vector<APInt>>>
+      valueCache;
+
+  // nullopt if the walk gave up before it saw every input
+  std::optional<llvm::DenseSet<Value*>> inputsOf(Value* V) {
+    llvm::DenseSet<Value*> inputs;
+    std::vector<Value*> worklist{V};
+    llvm::DenseSet<Value*> visited;
+    while (!worklist.empty()) {
+      if (visited.size() >= 4096)
+        return std::nullopt;
+      auto current = worklist.back();
+      worklist.pop_back();
+      if (!visited.insert(current).second || isa<ConstantInt>(current))
+        continue;
+      auto I = dyn_cast<Instruction>(current);
+      if (!I || !I->getType()->isIntegerTy() ||
+          I->getType()->getIntegerBitWidth() > 64 ||
+          (!isa<BinaryOperator>(I) && !isa<CastInst>(I) &&
+           !isa<SelectInst>(I) && !isa<ICmpInst>(I))) {
+        inputs.insert(current);
+        continue;
+      }
+      for (auto& operand : I->operands())
+        worklist.push_back(operand);
+    }
+    return inputs;
+  }
+
+  // the slice as the conditions it stands for
+  std::vector<std::pair<Value*, bool>>
+  sliceConditions(llvm::ArrayRef<std::pair<Value*, bool>> conditions,
+                  llvm::ArrayRef<unsigned> slice) {
+    std::vector<std::pair<Value*, bool>> picked;
+    for (auto i : slice)
+      picked.push_back(conditions[i]);
+    return picked;
+  }
+
+  // the rest of what the slice solver holds shares no input with the
+  // query, so it can only change the answer by being unsat on its own. a
+  // model rules that out, without one the answer is only kept when the
+  // slice is all there is
+  bool holdsOnly(const std::vector<bool>& asserted, size_t sliceSize) {
+    return static_cast<size_t>(llvm::count(asserted, true)) == sliceSize;
+  }
+
+  std::string queryKey(Value* query, const std::string& kind,
+                       llvm::ArrayRef<std::pair<Value*, bool>> conditions) {
+    std::vector<Value*> roots{query};
+    std::string polarity = kind;
+    for (const auto& [condition, value] : conditions) {
+      roots.push_back(condition);
+      polarity += value ? "+" : "-";
+    }
+    auto key = solver::canonicalKey(roots);
+    return key.empty() ? key : polarity + "#" + key;
+  }
+} // namespace
+
+solver::Backend* lifterClass::pathBackend() {
+  if (!solverBackend) {
+    solverBackend = solver::createBackend();
+    solverAsserted = 0;
+  }
+  if (!solverBackend)
+    return nullptr;
+  // conditions of the path so far stay in the backend, only new ones go in
+  for (; solverAsserted < pathConditions.size(); ++solverAsserted) {
+    const auto& [condition, value] = pathConditions[solverAsserted];
+    if (condition->getType()->isIntegerTy(1))
+      solverBackend->assertCondition(condition, value);
+  }
+  return solverBackend.get();
+}
+
+// branch conditions that share an input with the query. the others cant
+// make it unsat, leaving them out lets more queries share a key. nullopt
+// when some input walk gave up, a partial slice could be missing the
+// condition that decides the query
+std::optional<std::vector<unsigned>>
+lifterClass::relevantConditions(Value* query) {
+  auto inputs = inputsOf(query);
+  if (!inputs)
+    return std::nullopt;
+
+  // which conditions read each input, so every input is expanded once
+  DenseMap<Value*, SmallVector<unsigned, 2>> readers;
+  for (unsigned i = 0; i < pathConditions.size(); ++i) {
+    auto condition = pathConditions[i].first;
+    // pathBackend only asserts these
+    if (!condition->getType()->isIntegerTy(1))
+      continue;
+    auto [it, inserted] = conditionInputs.try_emplace(condition);
+    if (inserted)
+      it->second = inputsOf(condition);
+    if (!it->second)
+      return std::nullopt;
+    for (auto input : *it->second)
+      readers[input].push_back(i);
+  }
+
+  std::vector<bool> taken(pathConditions.size());
+  std::vector<Value*> worklist(inputs->begin(), inputs->end());
+  while (!worklist.empty()) {
+    auto input = worklist.back();
+    worklist.pop_back();
+    auto it = readers.find(input);
+    if (it == readers.end())
+      continue;
+    for (auto i : it->second) {
+      if (taken[i])
+        continue;
+      taken[i] = true;
+      for (auto next : *conditionInputs.find(pathConditions[i].first)->second)
+        if (inputs->insert(next).second)
+          worklist.push_back(next);
+    }
+  }
+
+  std::vector<unsigned> relevant;
+  for (unsigned i = 0; i < taken.size(); ++i)
+    if (taken[i])
+      relevant.push_back(i);
+  return relevant;
+}
+
+// slices along a path only ever pick from pathConditions, so one solver
+// can keep what earlier slices asserted instead of encoding them again
+solver::Backend* lifterClass::sliceBackend(ArrayRef<unsigned> slice) {
+  if (!sliceSolver) {
+    sliceSolver = solver::createBackend();
+    sliceAsserted.clear();
+  }
+  if (!sliceSolver)
+    return nullptr;
+  for (auto i : slice) {
+    if (i >= sliceAsserted.size())
+      sliceAsserted.resize(i + 1);
+    if (sliceAsserted[i])
+      continue;
+    sliceAsserted[i] = true;
+    const auto& [condition, value] = pathConditions[i];
+    sliceSolver->assertCondition(condition, value);
+  }
+  return sliceSolver.get();
+}
+
+std::optional<bool> lifterClass::isFeasible(Value* condition,
+                                            const bool value) {
+  if (auto C = dyn_cast<ConstantInt>(condition))
+    return C->isOne() == value;
+
+  // cached under the slice that was checked. without a slice or a key the
+  // whole path is asked and the answer isnt kept
+  auto slice = relevantConditions(condition);
+  const auto key =
+      slice ? queryKey(condition, value ? "f+" : "f-",
+                       sliceConditions(pathConditions, *slice))
+            : "";
+  solver::Result result;
+  if (key.empty()) {
+    auto backend = pathBackend();
+    if (!backend)
+      return std::nullopt;
+    result = backend->check({{condition, value}}, {});
+  } else if (auto cached = feasibilityCache.find(key);
+             cached != feasibilityCache.end()) {
+    result = cached->second;
+  } else {
+    auto backend = sliceBackend(*slice);
+    if (!backend)
+      return std::nullopt;
+    result = backend->check({{condition, value}}, {});
+    if (result == solver::Result::Sat ||
+        (result == solver::Result::Unsat &&
+         holdsOnly(sliceAsserted, slice->size())))
+      feasibilityCache[key] = result;
+  }
+  printvalue2(static_cast<int32_t>(result));
+
+  if (result == solver::Result::Unknown)
+    return std::nullopt;
+  return result == solver::Result::Sat;
+}
+
+std::optional<std::vector<APInt>>
+lifterClass::enumerateValues(Value* V, const unsigned limit) {
+  auto type = dyn_cast<IntegerType>(V->getType());
+  if (!type || type->getBitWidth() > 64)
+    return std::nullopt;
+  if (auto C = dyn_cast<ConstantInt>(V))
+    return std::vector<APInt>{C->getValue()};
+
+  // same as isFeasible, the slice is what gets asked when there is a key
+  auto slice = relevantConditions(V);
+  const auto key =
+      slice ? queryKey(V, "e" + std::to_string(limit),
+                       sliceConditions(pathConditions, *slice))
+            : "";
+  solver::Backend* backend;
+  bool keep = !key.empty();
+  if (key.empty()) {
+    backend = pathBackend();
+  } else {
+    if (auto it = valueCache.find(key); it != valueCache.end())
+      return it->second;
+    backend = sliceBackend(*slice);
+    keep = holdsOnly(sliceAsserted, slice->size());
+  }
+  if (!backend)
+    return std::nullopt;
+
+  // each model found is ruled out for the next check
+  backend->track(V);
+  std::vector<APInt> values;
+  std::vector<std::pair<Value*, APInt>> excluded;
+  std::optional<std::vector<APInt>> result;
+  while (true) {
+    const auto answer = backend->check({}, excluded);
+    if (answer == solver::Result::Unknown)
+      return std::nullopt;
+    if (answer == solver::Result::Unsat) {
+      result = values;
+      break;
+    }
+    keep = !key.empty();
+    auto value = backend->modelValue(V);
+    if (!value)
+      return std::nullopt;
+    if (values.size() == limit)
+      break; // one more than limit, result stays nullopt
+    values.push_back(*value);
+    excluded.push_back({V, *value});
+  }
+
+  if (keep)
+    valueCache[key] = result;
+  return result;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/IR/Value.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+// bit-vector queries about the current path: can this branch go that way,
+// which values can this jump target take. path conditions are asserted into
+// one backend per path as they come, a query only adds its own part on top.
+namespace solver {
+
+  enum class BackendKind {
+    Builtin, // bit-blasting into the in-tree sat solver
+    Z3,      // only when built with MERGEN_HAS_Z3
+    None,
+  };
+
+  struct Config {
+    BackendKind backend = BackendKind::Builtin;
+    // per query, 0 means no limit. no wall clock limit so the answers dont
+    // depend on the machine
+    uint64_t conflictBudget = 100000;
+  };
+
+  Config& config();
+
+  bool setBackend(const std::string& value);
+  bool setConflictBudget(const std::string& value);
+
+  enum class Result { Sat, Unsat, Unknown };
+
+  class Backend {
+  public:
+    virtual ~Backend() = default;
+
+    // holds for every later query
+    virtual void assertCondition(llvm::Value* condition, bool value) = 0;
+
+    // everything asserted plus conditions, with every (V, k) in excluded
+    // meaning V != k. nothing here outlives the call.
+    virtual Result
+    check(llvm::ArrayRef<std::pair<llvm::Value*, bool>> conditions,
+          llvm::ArrayRef<std::pair<llvm::Value*, llvm::APInt>> excluded) = 0;
+
+    // translates V so the models of later checks have a value for it
+    virtual void track(llvm::Value* V) = 0;
+
+    // value of V in the model of the last Sat check
+    virtual std::optional<llvm::APInt> modelValue(llvm::Value* V) = 0;
+  };
+
+  // nullptr if the configured backend isnt available
+  std::unique_ptr<Backend> createBackend();
+
+  // same string for queries that only differ in which values are the
+  // inputs. empty when the expression is too big to bother
+  std::string canonicalKey(llvm::ArrayRef<llvm::Value*> roots);
+
+} // namespace solver
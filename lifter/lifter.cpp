@@ -1,12 +1,19 @@
+#define MERGEN_LOG_CATEGORY debugging::LOG_LIFT
 
 #include "FunctionSignatures.h"
 #include "GEPTracker.h"
+#include "LiftCache.h"
+#include "OperandUtils.h"
+#include "OutputWriter.h"
 #include "PathSolver.h"
 #include "includes.h"
 #include "lifterClass.h"
 #include "nt/nt_headers.hpp"
 #include "utils.h"
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <limits>
 #include <iostream>
 #include <llvm/IR/IRBuilderFolder.h>
 #include <llvm/Support/NativeFormatting.h>
@@ -14,11 +21,93 @@
 vector<lifterClass*> lifters;
 uint64_t original_address = 0;
 unsigned int pathNo = 0;
+uint64_t finishedPaths = 0;
+uint64_t unresolvedPaths = 0;
+// how many times a path started a block at the address, for novelty
+DenseMap<uint64_t, unsigned> blockVisits;
 // consider having this function in a class, later we can use multi-threading to
 // explore different paths
 unsigned int breaking = 0;
 arch_mode is64Bit;
 
+// paths waiting at the same address are folded into one
+void mergePendingStates() {
+  for (size_t i = 0; i < lifters.size(); ++i) {
+    for (size_t j = i + 1; j < lifters.size();) {
+      if (lifters[i]->canMergeWith(*lifters[j]) &&
+          lifters[i]->mergeWith(*lifters[j])) {
+        outs() << "merged two paths at "
+               << lifters[i]->blockInfo.runtime_address << "\n";
+        delete lifters[j];
+        lifters.erase(lifters.begin() + j);
+        continue;
+      }
+      ++j;
+    }
+  }
+}
+
+// index of the path to lift next
+size_t pickNextPath() {
+  auto pickMin = [](auto score) {
+    // ties go to the newest path, like dfs
+    size_t best = lifters.size() - 1;
+    for (size_t i = lifters.size() - 1; i-- > 0;)
+      if (score(lifters[i]) < score(lifters[best]))
+        best = i;
+    return best;
+  };
+
+  // the path that is furthest behind goes first, so the others are still
+  // waiting at the join point when it gets there
+  if (explorer::config().mergeStates)
+    return pickMin([](lifterClass* l) { return (uint64_t)l->counter; });
+
+  switch (explorer::config().strategy) {
+  case explorer::Strategy::BFS:
+    return 0;
+  case explorer::Strategy::ReturnFirst:
+    return pickMin([](lifterClass* l) {
+      auto rsp =
+          dyn_cast_or_null<ConstantInt>(l->Registers.whole(ZYDIS_REGISTER_RSP));
+      if (!rsp)
+        return std::numeric_limits<uint64_t>::max();
+      return (uint64_t)std::abs(rsp->getSExtValue() - STACKP_VALUE);
+    });
+  case explorer::Strategy::Novelty:
+    return pickMin([](lifterClass* l) {
+      return (uint64_t)blockVisits.lookup(l->blockInfo.runtime_address);
+    });
+  default:
+    return lifters.size() - 1;
+  }
+}
+
+// the path at the back is done. with --backtrack it goes on from the newest
+// fork it left behind instead
+void retirePath(lifterClass* lifter) {
+  if (lifter->backtrack())
+    return;
+  lifters.pop_back();
+  delete lifter;
+}
+
+// budget ran out, every pending path ends where it is
+void closePendingPaths(const std::string& reason) {
+  outs() << reason << ", closing " << lifters.size()
+         << " pending paths as unresolved\n";
+  for (auto lifter : lifters) {
+    // fork points are pending paths too
+    do {
+      lifter->builder.SetInsertPoint(lifter->blockInfo.block);
+      lifter->closeUnresolved();
+      ++unresolvedPaths;
+    } while (lifter->backtrack());
+    delete lifter;
+  }
+  lifters.clear();
+}
+
 void asm_to_zydis_to_lift(ZyanU8* data) {
   ZydisDecoder decoder;
   ZydisDecoderInit(&decoder,
@@ -27,9 +116,36 @@ void asm_to_zydis_to_lift(ZyanU8* data) {
                    is64Bit ? ZYDIS_STACK_WIDTH_64 : ZYDIS_STACK_WIDTH_32);
 
   BinaryOperations::initBases(data, is64Bit); // sigh ?
+  lifterClass::forgetVisitedStates();
+  const auto& cfg = explorer::config();
+  const auto started = std::chrono::steady_clock::now();
   while (lifters.size() > 0) {
+    if (cfg.timeoutSeconds &&
+        std::chrono::steady_clock::now() - started >=
+            std::chrono::seconds(cfg.timeoutSeconds)) {
+      closePendingPaths("timeout");
+      break;
+    }
+    if (cfg.maxPaths && finishedPaths >= cfg.maxPaths) {
+      closePendingPaths("path limit reached");
+      break;
+    }
+
+    if (cfg.mergeStates)
+      mergePendingStates();
+    // chosen path goes to the back, the rest keep their order
+    auto next = lifters.begin() + pickNextPath();
+    std::rotate(next, next + 1, lifters.end());
     lifterClass* lifter = lifters.back();
 
+    if (explorer::config().dedupeStates && lifter->blockInfo.block->empty() &&
+        lifter->joinVisitedState()) {
+      outs() << "state at " << lifter->blockInfo.runtime_address
+             << " was already lifted\n";
+      retirePath(lifter);
+      continue;
+    }
+
     uint64_t offset = BinaryOperations::address_to_mapped_address(
         lifter->blockInfo.runtime_address);
     debugging::doIfDebug([&]() {
@@ -44,12 +160,25 @@ void asm_to_zydis_to_lift(ZyanU8* data) {
     });
 
     lifter->builder.SetInsertPoint(lifter->blockInfo.block);
+    // every edge queued since the last block, applied in one go
+    lifter->syncDomTree();
+    ++blockVisits[lifter->blockInfo.runtime_address];
 
     lifter->run = 1;
 
     while ((lifter->run && !lifter->finished)) {
+      if (cfg.maxPathInstructions &&
+          lifter->counter >= cfg.maxPathInstructions) {
+        outs() << "path ran out of instructions at "
+               << lifter->blockInfo.runtime_address << "\n";
+        lifter->closeUnresolved();
+        ++finishedPaths;
+        ++unresolvedPaths;
+        retirePath(lifter);
+        break;
+      }
 
-      if (BinaryOperations::isWrittenTo(lifter->blockInfo.runtime_address)) {
+      if (lifter->writes.isWritten(lifter->blockInfo.runtime_address)) {
         printvalueforce2(lifter->blockInfo.runtime_address);
         UNREACHABLE("Found Self Modifying Code! we dont support it");
       }
@@ -59,6 +188,8 @@ void asm_to_zydis_to_lift(ZyanU8* data) {
 
       ++(lifter->counter);
       auto counter = debugging::increaseInstCounter() - 1;
+      liftcache::recordRead(lifter->blockInfo.runtime_address,
+                            lifter->instruction.length);
 
       debugging::doIfDebug([&]() {
         ZydisFormatter formatter;
@@ -83,18 +214,16 @@ void asm_to_zydis_to_lift(ZyanU8* data) {
       if (lifter->finished) {
 
         lifter->run = 0;
-        lifters.pop_back();
+        ++finishedPaths;
 
         debugging::doIfDebug([&]() {
-          std::string Filename = "output_path_" + to_string(++pathNo) + ".ll";
-          std::error_code EC;
-          raw_fd_ostream OS(Filename, EC);
-          lifter->fnc->getParent()->print(OS, nullptr);
+          debugging::journalNewBlocks(
+              lifter->fnc, "path " + to_string(++pathNo) + " finished");
         });
         outs() << "next lifter instance\n";
 
-        delete lifter;
-        continue;
+        retirePath(lifter);
+        break;
       }
 
       offset += lifter->instruction.length;
@@ -102,11 +231,32 @@ void asm_to_zydis_to_lift(ZyanU8* data) {
   }
 }
 
-void InitFunction_and_LiftInstructions(const ZyanU64 runtime_address,
+// everything that changes what we lift, part of the lift cache key
+std::string optionsFingerprint() {
+  const auto& cfg = explorer::config();
+  return "strategy=" + to_string((int)cfg.strategy) +
+         ",insts=" + to_string(cfg.maxPathInstructions) +
+         ",paths=" + to_string(cfg.maxPaths) +
+         ",merge=" + to_string(cfg.mergeStates) +
+         ",dedupe=" + to_string(cfg.dedupeStates) +
+         ",backtrack=" + to_string(cfg.backtrack) + ",names=" +
+         to_string(debugging::shouldDebug || debugging::keepValueNames) +
+         ",egraph=" + to_string(egraph::config().maxNodes) + "/" +
+         to_string(egraph::config().timeoutMilliseconds) + ",solver=" +
+         to_string(static_cast<int>(solver::config().backend)) + "/" +
+         to_string(solver::config().conflictBudget);
+}
+
+// false if the output could not be written
+bool InitFunction_and_LiftInstructions(const ZyanU64 runtime_address,
                                        std::vector<uint8_t> fileData) {
 
   auto fileBase = fileData.data();
   LLVMContext context;
+  // names are only for reading the output, building them costs a string per
+  // instruction
+  context.setDiscardValueNames(!debugging::shouldDebug &&
+                               !debugging::keepValueNames);
   string mod_name = "my_lifting_module";
   llvm::Module lifting_module = llvm::Module(mod_name.c_str(), context);
 
@@ -194,14 +344,31 @@ void InitFunction_and_LiftInstructions(const ZyanU64 runtime_address,
               << " fOffset: " << fileOffset << " RVA: " << RVA
               << " stackSize: " << stackSize << std::endl;
 
-    main->markMemPaged(STACKP_VALUE - stackSize, STACKP_VALUE + stackSize);
+    main->markMemPaged(STACKP_VALUE - stackSize, STACKP_VALUE + stackSize,
+                       MemoryRegionType::STACK);
     printvalue2(stackSize);
-    main->markMemPaged(address, address + imageSize);
+    main->markMemPaged(address, address + imageSize, MemoryRegionType::IMAGE);
+    main->writes.init(address, imageSize);
     return address;
   };
 
   original_address = processHeaders(fileBase + dosHeader->e_lfanew);
 
+  std::string cacheKey;
+  if (!liftcache::config().directory.empty()) {
+    BinaryOperations::initBases(fileBase, is64Bit);
+    cacheKey = liftcache::computeKey(fileData, runtime_address, is64Bit,
+                                     optionsFingerprint());
+    if (auto cached = liftcache::lookup(cacheKey, fileData, runtime_address,
+                                        context)) {
+      cout << "\nfound in lift cache, " << dec << timer::getTimer()
+           << " milliseconds has past" << endl;
+      outputwriter::writeModuleAsync(*cached, "output");
+      delete main;
+      return outputwriter::waitForWrites();
+    }
+  }
+
   funcsignatures::search_signatures(fileData);
   funcsignatures::createOffsetMap(); // ?
   for (const auto& [key, value] : funcsignatures::siglookup) {
@@ -220,22 +387,25 @@ void InitFunction_and_LiftInstructions(const ZyanU64 runtime_address,
 
   cout << "\nlifting complete, " << dec << ms << " milliseconds has past"
        << endl;
-  const string Filename_noopt = "output_no_opts.ll";
-  error_code EC_noopt;
-  llvm::raw_fd_ostream OS_noopt(Filename_noopt, EC_noopt);
+  // register names on arguments are cheap and keep the output readable
+  context.setDiscardValueNames(false);
+  nameRegisterArguments(function);
 
-  lifting_module.print(OS_noopt, nullptr);
+  // only the bitcode snapshot is taken here, printing runs alongside
+  // final_optpass
+  if (outputwriter::config().dumpUnoptimized)
+    outputwriter::writeModuleAsync(lifting_module, "output_no_opts");
 
   cout << "\nwriting complete, " << dec << ms << " milliseconds has past"
        << endl;
   final_optpass(function);
-  const string Filename = "output.ll";
-  error_code EC;
-  llvm::raw_fd_ostream OS(Filename, EC);
 
-  lifting_module.print(OS, nullptr);
+  // partial output depends on timing, dont cache it
+  if (!cacheKey.empty() && unresolvedPaths == 0)
+    liftcache::store(cacheKey, lifting_module, fileData, runtime_address);
 
-  return;
+  outputwriter::writeModuleAsync(lifting_module, "output");
+  return outputwriter::waitForWrites();
 }
 
 int main(int argc, char* argv[]) {
@@ -269,7 +439,10 @@ int main(int argc, char* argv[]) {
   }
   ifs.close();
 
-  InitFunction_and_LiftInstructions(startAddr, fileData);
+  if (!InitFunction_and_LiftInstructions(startAddr, fileData)) {
+    cerr << "Failed to write the output." << endl;
+    return 1;
+  }
   auto milliseconds = timer::stopTimer();
   std::cout << "\n"
             << std::dec << milliseconds << " milliseconds has past"
@@ -1,18 +1,27 @@
 #ifndef LIFTERCLASS_H
 #define LIFTERCLASS_H
+#include "EGraph.h"
 #include "FunctionSignatures.h"
 #include "GEPTracker.h"
+#include "MBASimplifier.h"
 #include "PathSolver.h"
+#include "RewriteRules.h"
+#include "Solver.h"
 #include "includes.h"
 #include "utils.h"
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/Hashing.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/Analysis/DomConditionCache.h>
+#include <llvm/Analysis/DomTreeUpdater.h>
 #include <llvm/Analysis/SimplifyQuery.h>
+#include <llvm/IR/ConstantRange.h>
 #include <llvm/IR/Dominators.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/Support/KnownBits.h>
 #include <set>
+#include <variant>
 
 #ifndef DEFINE_FUNCTION
 #define DEFINE_FUNCTION(name) void lift_##name()
@@ -76,6 +85,10 @@ public:
     return it != cache.end() ? it->second : nullptr;
   }
 
+  void erase(uint8_t opcode, const InstructionKey& key) {
+    opcodeCaches[opcode].erase(key);
+  }
+
 private:
   using CacheMap = llvm::SmallDenseMap<InstructionKey, Value*, 4,
                                        InstructionKey::InstructionKeyInfo>;
@@ -111,12 +124,27 @@ public:
     RFLAGS_,
     REGISTER_COUNT // Total number of registers
   };
-  std::array<Value*, REGISTER_COUNT> vec;
 
-  RegisterManager() {}
-  RegisterManager(const RegisterManager& other) : vec(other.vec) {}
+  // bits [start, start + width) of the register are bits
+  // [shift, shift + width) of value
+  struct Slice {
+    llvm::Value* value;
+    uint8_t start;
+    uint8_t width;
+    uint8_t shift;
+  };
+  // lowest bits first. partial writes add a slice instead of masking the new
+  // bits into the whole value, so al/ah/ax sized reads and writes need no IR
+  // and the whole register is only put together when something reads it
+  using Slices = llvm::SmallVector<Slice, 3>;
+  std::array<Slices, REGISTER_COUNT> vec;
+  // xor over every register, set and setSlice keep it up to date
+  uint64_t hash = 0;
 
-  // Overload the [] operator for getting register values
+  RegisterManager() {}
+  RegisterManager(const RegisterManager& other)
+      : vec(other.vec), hash(other.hash) {}
+  RegisterManager& operator=(const RegisterManager& other) = default;
 
   int getRegisterIndex(const ZydisRegister key) const {
 
@@ -137,9 +165,103 @@ public:
     }
   }
 
-  llvm::Value*& operator[](ZydisRegister key) {
-    int index = getRegisterIndex(key);
-    return vec[index];
+  static uint64_t hashSlices(const int index, const Slices& slices) {
+    if (slices.empty())
+      return 0;
+    llvm::hash_code result = llvm::hash_value(index);
+    for (const auto& slice : slices)
+      result = llvm::hash_combine(result, slice.value, slice.start,
+                                  slice.width, slice.shift);
+    return result;
+  }
+
+  void set(const int index, llvm::Value* value) {
+    hash ^= hashSlices(index, vec[index]);
+    vec[index] = {
+        {value, 0, (uint8_t)value->getType()->getIntegerBitWidth(), 0}};
+    hash ^= hashSlices(index, vec[index]);
+  }
+  void set(const ZydisRegister key, llvm::Value* value) {
+    set(getRegisterIndex(key), value);
+  }
+
+  // the value holding the whole register, nullptr while it is in slices
+  llvm::Value* whole(const int index) const {
+    const auto& slices = vec[index];
+    if (slices.size() != 1 || slices[0].shift != 0 ||
+        slices[0].width != slices[0].value->getType()->getIntegerBitWidth())
+      return nullptr;
+    return slices[0].value;
+  }
+  llvm::Value* whole(const ZydisRegister key) const {
+    return whole(getRegisterIndex(key));
+  }
+
+  unsigned width(const int index) const {
+    if (vec[index].empty())
+      return 0;
+    return vec[index].back().start + vec[index].back().width;
+  }
+
+  // overwrites [start, start + width of value), slices it cuts into keep the
+  // parts outside of it
+  void setSlice(const int index, const unsigned start, llvm::Value* value) {
+    const unsigned end = start + value->getType()->getIntegerBitWidth();
+    Slices result;
+    for (const auto& slice : vec[index]) {
+      const unsigned sliceEnd = slice.start + slice.width;
+      if (sliceEnd <= start || slice.start >= end) {
+        result.push_back(slice);
+        continue;
+      }
+      if (slice.start < start)
+        result.push_back(
+            {slice.value, slice.start, (uint8_t)(start - slice.start),
+             slice.shift});
+      if (sliceEnd > end)
+        result.push_back({slice.value, (uint8_t)end, (uint8_t)(sliceEnd - end),
+                          (uint8_t)(slice.shift + end - slice.start)});
+    }
+    result.push_back({value, (uint8_t)start, (uint8_t)(end - start), 0});
+    llvm::sort(result, [](const Slice& a, const Slice& b) {
+      return a.start < b.start;
+    });
+    hash ^= hashSlices(index, vec[index]);
+    vec[index] = std::move(result);
+    hash ^= hashSlices(index, vec[index]);
+  }
+
+  bool sameSlices(const RegisterManager& other) const {
+    for (size_t i = 0; i < vec.size(); ++i) {
+      if (vec[i].size() != other.vec[i].size())
+        return false;
+      for (size_t j = 0; j < vec[i].size(); ++j) {
+        const auto &a = vec[i][j], &b = other.vec[i][j];
+        if (a.value != b.value || a.start != b.start || a.width != b.width ||
+            a.shift != b.shift)
+          return false;
+      }
+    }
+    return true;
+  }
+
+  // whole register when every slice is a constant
+  std::optional<uint64_t> constantValue(const int index) const {
+    if (vec[index].empty() || width(index) > 64)
+      return std::nullopt;
+    uint64_t result = 0;
+    for (const auto& slice : vec[index]) {
+      auto constant = llvm::dyn_cast<llvm::ConstantInt>(slice.value);
+      if (!constant)
+        return std::nullopt;
+      result |= constant->getValue()
+                    .lshr(slice.shift)
+                    .zextOrTrunc(64)
+                    .getLoBits(slice.width)
+                    .getZExtValue()
+                << slice.start;
+    }
+    return result;
   }
 };
 
@@ -161,10 +283,25 @@ public:
 
   ComputeFunc computeFunc;
 
+  // which calculation this is, 0 once a value was set directly. copies share
+  // it, so states can be compared without forcing anything
+  uint64_t id = 0;
+
   LazyValue() : value(nullptr) {}
   LazyValue(llvm::Value* val) : value(val) {}
   LazyValue(std::function<llvm::Value*()> calc)
-      : computeFunc(calc), value(std::nullopt) {}
+      : value(std::nullopt), computeFunc(calc), id(nextId()) {}
+
+  static uint64_t nextId() {
+    static uint64_t last = 0;
+    return ++last;
+  }
+
+  std::pair<uint64_t, llvm::Value*> identity() const {
+    if (id)
+      return {id, nullptr};
+    return {0, value.value_or(nullptr)};
+  }
 
   // get value, calculate if doesnt exist
   llvm::Value* get() const {
@@ -180,10 +317,12 @@ public:
   void set(llvm::Value* newValue) {
     value = newValue;
     computeFunc = nullptr;
+    id = 0;
   }
   void setCalculation(const std::function<llvm::Value*()> calc) {
     computeFunc = calc;
     value = std::nullopt; // Reset the stored value
+    id = nextId();
   }
 };
 
@@ -201,11 +340,30 @@ public:
   ZydisDecodedInstruction instruction;
   ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
   llvm::DenseMap<llvm::Instruction*, llvm::APInt> assumptions;
+  // branch conditions taken on this path and the ranges they imply
+  std::vector<std::pair<llvm::Value*, bool>> pathConditions;
+  llvm::DenseMap<llvm::Value*, llvm::ConstantRange> pathRanges;
+  // pathConditions[0, solverAsserted) are already in solverBackend. forks
+  // start without one and build their own on the first query
+  std::unique_ptr<solver::Backend> solverBackend;
+  size_t solverAsserted = 0;
+  // only ever holds conditions some slice needed, sliceAsserted[i] says if
+  // pathConditions[i] is one of them. reset like solverBackend
+  std::unique_ptr<solver::Backend> sliceSolver;
+  std::vector<bool> sliceAsserted;
+  // inputs of each path condition, nullopt when the walk gave up
+  llvm::DenseMap<llvm::Value*, std::optional<llvm::DenseSet<llvm::Value*>>>
+      conditionInputs;
   llvm::DenseMap<uint64_t, ValueByteReference> buffer;
+  uint64_t bufferHash = 0;
+  // stores through [base + constant], base being symbolic
+  llvm::DenseMap<llvm::Value*, SymbolicStoreMap> symbolicStores;
   using flagManager = std::array<LazyValue, FLAGS_END>;
   // llvm::DenseMap<Value*, flagManager> flagbuffer;
 
   flagManager FlagList;
+  // xor over the flag identities, kept up to date by setFlag
+  uint64_t flagsHash = 0;
   RegisterManager Registers;
 
   llvm::DomConditionCache* DC = new DomConditionCache();
@@ -214,14 +372,18 @@ public:
   llvm::SimplifyQuery* cachedquery;
 
   llvm::DominatorTree* DT;
-  llvm::BasicBlock* lastBB = nullptr;
+  // shared by every path, new edges are queued and applied when the next
+  // block starts being lifted
+  llvm::DomTreeUpdater* DTU;
   unsigned int BIlistsize = 0;
 
-  std::map<int64_t, int64_t> pageMap;
+  MemoryRegionIndex memoryRegions;
+  WriteTracker writes;
   std::vector<llvm::BranchInst*> BIlist;
   // DenseMap<InstructionKey, Value*, InstructionKey::InstructionKeyInfo>
   // cache;
   InstructionCache cache;
+  mba::Simplifier mbaSimplifier; // not copied, forks start empty
   struct GEPinfo {
     Value* addr;
     uint8_t type;
@@ -264,6 +426,54 @@ public:
   DenseMap<GEPinfo, Value*, GEPinfo::GEPinfoKeyInfo> GEPcache;
   std::vector<llvm::Instruction*> memInfos;
 
+  // --backtrack keeps the other side of a fork as a fork point instead of
+  // cloning the path, and rewinds to it when the path ends. maps that grow
+  // with the path log what each change overwrote, the small fixed size
+  // state is copied into the fork point.
+  struct BufferUndo {
+    uint64_t address;
+    std::optional<ValueByteReference> old;
+  };
+  struct AssumptionUndo {
+    llvm::Instruction* inst;
+    std::optional<llvm::APInt> old;
+  };
+  struct RangeUndo {
+    llvm::Value* value;
+    std::optional<llvm::ConstantRange> old;
+  };
+  struct CacheUndo {
+    uint8_t opcode;
+    InstructionKey key;
+    llvm::Value* old;
+  };
+  struct GEPcacheUndo {
+    GEPinfo key;
+  };
+  using TrailEntry = std::variant<BufferUndo, AssumptionUndo, RangeUndo,
+                                  CacheUndo, GEPcacheUndo>;
+
+  struct ForkPoint {
+    BBInfo resume; // with condition set to taken
+    llvm::Value* condition;
+    bool taken;
+    size_t trailSize;
+    size_t pathConditionCount;
+    size_t memInfoCount;
+    uint32_t counter;
+    uint64_t bufferHash;
+    uint64_t flagsHash;
+    // lazy flags remember what they computed, so they cant be logged on set
+    flagManager flags;
+    RegisterManager registers;
+    llvm::DenseMap<llvm::Value*, SymbolicStoreMap> symbolicStores;
+    WriteTracker writes; // pages are shared until written
+  };
+  std::vector<TrailEntry> trail;
+  std::vector<ForkPoint> forkPoints;
+
+  bool trailing() const { return !forkPoints.empty(); }
+
   // global
   llvm::Value* memory;
   llvm::Value* TEB;
@@ -279,17 +489,21 @@ public:
         isUnreachable(other.isUnreachable),
         instruction(other.instruction), // Shallow copy of the pointer
         assumptions(other.assumptions), // Deep copy of assumptions
-        buffer(other.buffer),
+        pathConditions(other.pathConditions), pathRanges(other.pathRanges),
+        conditionInputs(other.conditionInputs),
+        buffer(other.buffer), bufferHash(other.bufferHash),
+        symbolicStores(other.symbolicStores),
         FlagList(other.FlagList), // Deep copy handled by unordered_map's copy
                                   // constructor
+        flagsHash(other.flagsHash),
         Registers(other.Registers),     // Assuming RegisterManager has a copy
                                         // constructor
         DC(other.DC),                   // Deep copy of DC
         instct(other.instct),
         cachedquery(other.cachedquery), // Assuming raw pointer, copied directly
         DT(other.DT),                   // Assuming pointer, copied directly
-        lastBB(other.lastBB), BIlistsize(other.BIlistsize),
-        pageMap(other.pageMap), // Deep copy handled by map's copy constructor
+        DTU(other.DTU), BIlistsize(other.BIlistsize),
+        memoryRegions(other.memoryRegions), writes(other.writes),
         BIlist(other.BIlist), // Deep copy handled by vector's copy constructor
         cache(other.cache), // Deep copy handled by DenseMap's copy constructor
         memInfos(
@@ -306,7 +520,10 @@ public:
 
   // init
   void Init_Flags();
-  void initDomTree(llvm::Function& F) { DT = new DominatorTree(F); }
+  void initDomTree(llvm::Function& F) {
+    DT = new DominatorTree(F);
+    DTU = new DomTreeUpdater(DT, DomTreeUpdater::UpdateStrategy::Lazy);
+  }
   // end init
 
   // getters-setters
@@ -315,6 +532,8 @@ public:
   LazyValue getLazyFlag(const Flag flag);
   llvm::Value* getFlag(const Flag flag);
   void InitRegisters(llvm::Function* function, ZyanU64 rip);
+  llvm::Value* readRegisterSlice(int index, unsigned start, unsigned width);
+  llvm::Value* materializeRegister(int index);
   llvm::Value* GetValueFromHighByteRegister(const ZydisRegister reg);
   llvm::Value* GetRegisterValue(const ZydisRegister key);
   llvm::Value* SetValueToHighByteRegister(const ZydisRegister reg,
@@ -325,19 +544,41 @@ public:
                                          llvm::Value* value);
   void SetRegisterValue(const ZydisRegister key, llvm::Value* value);
   void SetRFLAGSValue(llvm::Value* value);
+  void recordPathCondition(Value* condition, bool taken);
+  bool canMergeWith(const lifterClass& other) const;
+  bool mergeWith(lifterClass& other);
+  void closeUnresolved();
+  uint64_t stateHash() const;
+  bool joinVisitedState();
+  static void forgetVisitedStates();
+  std::optional<bool> evaluateUnderPathConditions(Value* condition);
+  void setAssumption(Instruction* inst, const APInt& value);
+  void forkPath(const BBInfo& forked, Value* condition);
+  void forkCases(llvm::ArrayRef<std::pair<BBInfo, Value*>> cases);
+  bool forksByBacktracking() const;
+  void pushForkPoint(const BBInfo& resume, Value* condition, bool taken);
+  // false when there is no fork point left to go back to
+  bool backtrack();
   PATH_info solvePath(llvm::Function* function, uint64_t& dest,
                       llvm::Value* simplifyValue);
+  std::optional<bool> decideCondition(Value* condition);
+  PATH_info branchOnCondition(llvm::Function* function, uint64_t& dest,
+                              Value* condition, uint64_t trueAddress,
+                              uint64_t falseAddress);
+  PATH_info solveConditionalBranch(llvm::Function* function, uint64_t& dest,
+                                   Value* condition, uint64_t trueAddress,
+                                   uint64_t falseAddress);
   llvm::Value* popStack(int size);
   void pushFlags(const std::vector<llvm::Value*>& value,
-                 const std::string& address);
+                 const Twine& address);
   std::vector<llvm::Value*> GetRFLAGS();
 
   llvm::Value* GetOperandValue(const ZydisDecodedOperand& op,
                                const int possiblesize,
-                               const std::string& address = "");
+                               const Twine& address = "");
   llvm::Value* SetOperandValue(const ZydisDecodedOperand& op,
                                llvm::Value* value,
-                               const std::string& address = "");
+                               const Twine& address = "");
   llvm::Value* GetRFLAGSValue();
   // end getters-setters
   // misc
@@ -367,36 +608,60 @@ public:
   llvm::Value* solveLoad(LazyValue load, Value* ptr, uint8_t size);
 
   llvm::SimplifyQuery createSimplifyQuery(Instruction* Inst);
+  Instruction* currentContext();
 
   void RegisterBranch(BranchInst* BI) {
     //
     BIlist.push_back(BI);
   }
 
-  DominatorTree* getDomTree() { return DT; }
-
-  void updateDomTree(Function& F) {
-    // should only recalculate if we
-
-    auto getLastBB = &(F.back());
+  // the tree is only brought up to date when a block starts being lifted,
+  // until then queries go without it instead of trusting a stale one
+  DominatorTree* getDomTree() {
+    return DTU->hasPendingDomTreeUpdates() ? nullptr : DT;
+  }
+  void syncDomTree() { DTU->getDomTree(); }
+
+  // every branch the lifter emits goes through these so the dominator tree
+  // hears about the new edges
+  BranchInst* createBr(BasicBlock* dest) {
+    auto from = builder.GetInsertBlock();
+    auto BR = builder.CreateBr(dest);
+    DTU->applyUpdates({{DominatorTree::Insert, from, dest}});
+    return BR;
+  }
 
-    if (getLastBB != lastBB)
-      DT->recalculate(F);
+  BranchInst* createCondBr(Value* condition, BasicBlock* trueBB,
+                           BasicBlock* falseBB) {
+    auto from = builder.GetInsertBlock();
+    auto BR = builder.CreateCondBr(condition, trueBB, falseBB);
+    DTU->applyUpdates({{DominatorTree::Insert, from, trueBB},
+                       {DominatorTree::Insert, from, falseBB}});
+    return BR;
+  }
 
-    lastBB = getLastBB;
+  SwitchInst*
+  createSwitch(Value* condition, BasicBlock* defaultBB,
+               ArrayRef<std::pair<ConstantInt*, BasicBlock*>> cases) {
+    auto from = builder.GetInsertBlock();
+    auto SW = builder.CreateSwitch(condition, defaultBB, cases.size());
+    SmallVector<DominatorTree::UpdateType, 8> updates{
+        {DominatorTree::Insert, from, defaultBB}};
+    for (const auto& [value, dest] : cases) {
+      SW->addCase(value, dest);
+      updates.push_back({DominatorTree::Insert, from, dest});
+    }
+    DTU->applyUpdates(updates);
+    return SW;
   }
 
-  void markMemPaged(const int64_t start, const int64_t end) {
-    //
-    pageMap[start] = end;
+  void markMemPaged(const int64_t start, const int64_t end,
+                    MemoryRegionType type) {
+    memoryRegions.add(start, end, type);
   }
 
   bool isMemPaged(const int64_t address) {
-    auto it = pageMap.upper_bound(address);
-    if (it == pageMap.begin())
-      return false;
-    --it;
-    return address >= it->first && address < it->second;
+    return memoryRegions.find(address) != nullptr;
   }
 
   set<APInt, APIntComparator> getPossibleValues(const llvm::KnownBits& known,
@@ -406,6 +671,19 @@ public:
                                const uint8_t byteCount, LazyValue orgLoad);
 
   void addValueReference(Value* value, const uint64_t address);
+  void rehashBuffer();
+
+  std::pair<Value*, int64_t> splitBaseOffset(Value* address);
+
+  void clobberSymbolicStores(Value* base, const int64_t offset,
+                             const uint8_t size);
+
+  void addSymbolicStore(Value* base, const int64_t offset, Value* value);
+
+  Value* retrieveSymbolicValue(Value* base, const int64_t offset,
+                               const uint8_t byteCount, LazyValue orgLoad);
+
+  void invalidateSymbolicStores(const uint64_t address, const uint8_t size);
 
   isPaged isValuePaged(Value* address, Instruction* ctxI);
 
@@ -414,8 +692,20 @@ public:
   void loadMemoryOp(Value* inst);
 
   void insertMemoryOp(StoreInst* inst);
+  void storeToPossibleAddresses(StoreInst* inst, Value* offset);
   set<APInt, APIntComparator> computePossibleValues(Value* V,
                                                     const uint8_t Depth = 0);
+  std::optional<set<APInt, APIntComparator>>
+  tryComputePossibleValues(Value* V, const unsigned limit,
+                           const uint8_t Depth = 0);
+  using PossibleValuesMemo =
+      llvm::DenseMap<Value*, std::optional<set<APInt, APIntComparator>>>;
+  std::optional<set<APInt, APIntComparator>>
+  possibleValues(Value* V, const unsigned limit, const uint8_t Depth,
+                 PossibleValuesMemo& memo, bool& opaque);
+  std::optional<set<APInt, APIntComparator>>
+  possibleValuesOf(Instruction* V, const unsigned limit, const uint8_t Depth,
+                   PossibleValuesMemo& memo, bool& opaque);
 
   Value* extractBytes(Value* value, const uint8_t startOffset,
                       const uint8_t endOffset);
@@ -483,9 +773,52 @@ public:
                      const Twine& Name);
   Value* doPatternMatching(Instruction::BinaryOps const I, Value* const op0,
                            Value* const op1);
+  Value* emitRewrite(const rewrite::Tree& tree, uint8_t index,
+                     const rewrite::Bindings& bindings, Type* type);
+  // nullptr unless the expression is linear mba over a few variables and
+  // has a cheaper equivalent
+  Value* simplifyMBA(Instruction::BinaryOps opcode, Value* LHS, Value* RHS);
+  std::optional<mba::Result> analyzeMBA(Instruction::BinaryOps opcode,
+                                        Value* LHS, Value* RHS);
+  Value* emitBitwise(const mba::TruthTable function,
+                     llvm::ArrayRef<Value*> variables);
+  // cheapest equivalent of an address or branch target, V if none is cheaper
+  Value* simplifyWithEGraph(Value* V);
+  Value* emitFromEGraph(egraph::EGraph& graph, egraph::ClassId id,
+                        llvm::DenseMap<egraph::ClassId, Value*>& emitted);
 
   // end folders
 
+  // opaque predicates
+  // OPAQUE_TRUE/OPAQUE_FALSE when the condition can only go one way,
+  // verdicts decided from the expression alone are cached by its shape
+  opaque_info classifyPredicate(Value* condition);
+
+  // solver
+  solver::Backend* pathBackend();
+  // sliceSolver with every condition in slice asserted
+  solver::Backend* sliceBackend(llvm::ArrayRef<unsigned> slice);
+  // indices of the path conditions that share an input with query,
+  // transitively. nullopt when some input walk gave up
+  std::optional<std::vector<unsigned>> relevantConditions(Value* query);
+  // nullopt when the backend gave up or there is none
+  std::optional<bool> isFeasible(Value* condition, bool value);
+  // every value V can take on this path, nullopt if there are more than
+  // limit or the backend couldnt tell
+  std::optional<std::vector<APInt>> enumerateValues(Value* V, unsigned limit);
+
+  // concrete
+  // runs the instruction on plain integers when every input is a constant,
+  // false means it has to be lifted normally
+  bool tryConcreteExecution();
+  std::optional<uint64_t> getConcreteRegister(const ZydisRegister reg);
+  std::optional<uint64_t> getConcreteAddress(const ZydisDecodedOperand& op);
+  std::optional<uint64_t> readConcreteMemory(const uint64_t address,
+                                             const unsigned byteCount);
+  std::optional<uint64_t> getConcreteOperand(const ZydisDecodedOperand& op,
+                                             const unsigned size);
+  // end concrete
+
   // semantics definition
   DEFINE_FUNCTION(movs_X);
   DEFINE_FUNCTION(movaps);
@@ -1,6 +1,15 @@
 #include "utils.h"
+#include "EGraph.h"
+#include "LiftCache.h"
+#include "OutputWriter.h"
+#include "PathSolver.h"
+#include "Solver.h"
 #include "llvm/IR/Value.h"
+#include <llvm/IR/ModuleSlotTracker.h>
+#include <llvm/IR/ValueHandle.h>
 #include <chrono>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <llvm/Analysis/ValueLattice.h>
 #include <llvm/Support/KnownBits.h>
@@ -77,10 +86,12 @@ namespace debugging {
   int ic = 1;
   int increaseInstCounter() { return ++ic; }
   bool shouldDebug = false;
+  bool keepValueNames = false;
+  uint32_t categoryMask = LOG_ALL;
   llvm::raw_ostream* debugStream = nullptr;
   std::unique_ptr<llvm::raw_fd_ostream> fileStream;
 
-  void enableDebug(const std::string& filename = "") {
+  void enableDebug(const std::string& filename) {
     shouldDebug = true;
     if (!filename.empty()) {
       std::error_code EC;
@@ -92,11 +103,71 @@ namespace debugging {
         shouldDebug = false;
         return;
       }
+      // big buffer, the lift loop logs a lot and we only flush on exit or
+      // UNREACHABLE
+      fileStream->SetBufferSize(1 << 20);
       debugStream = fileStream.get();
     } else {
       debugStream = &llvm::outs();
     }
     llvm::outs() << "Debugging enabled\n";
+    std::atexit(flushDebug);
+  }
+
+  namespace {
+    std::unique_ptr<llvm::raw_fd_ostream> journal;
+
+    // blocks are only appended while lifting, so the journal keeps the last
+    // block it has seen plus the ones that were still open at that point
+    struct JournalCursor {
+      const llvm::Function* function = nullptr;
+      llvm::WeakVH last;
+      std::vector<llvm::WeakVH> open;
+      // one per function, it numbers the function once. everything that is
+      // written gets a name first, so later values dont need a slot and the
+      // same value reads the same in every entry
+      std::unique_ptr<llvm::ModuleSlotTracker> slots;
+      unsigned named = 0;
+    } journalCursor;
+
+    void nameForJournal(llvm::Value* V, unsigned& named) {
+      if (V->hasName() || V->getType()->isVoidTy() ||
+          !(llvm::isa<llvm::Instruction>(V) || llvm::isa<llvm::Argument>(V) ||
+            llvm::isa<llvm::BasicBlock>(V)))
+        return;
+      V->setName("j" + std::to_string(named++));
+    }
+  } // namespace
+
+  void flushDebug() {
+    if (debugStream)
+      debugStream->flush();
+    if (journal)
+      journal->flush();
+  }
+
+  // comma separated list, e.g. "semantics,memory"
+  bool setCategories(const std::string& list) {
+    static const std::map<std::string, uint32_t> names = {
+        {"general", LOG_GENERAL},     {"lift", LOG_LIFT},
+        {"semantics", LOG_SEMANTICS}, {"operands", LOG_OPERANDS},
+        {"memory", LOG_MEMORY},       {"path", LOG_PATH},
+        {"all", LOG_ALL}};
+
+    uint32_t mask = 0;
+    size_t start = 0;
+    while (start <= list.size()) {
+      auto end = list.find(',', start);
+      if (end == std::string::npos)
+        end = list.size();
+      const auto it = names.find(list.substr(start, end - start));
+      if (it == names.end())
+        return false;
+      mask |= it->second;
+      start = end + 1;
+    }
+    categoryMask = mask;
+    return true;
   }
 
   void printLLVMValue(llvm::Value* v, const char* name) {
@@ -105,7 +176,68 @@ namespace debugging {
     *debugStream << " " << name << " : ";
     v->print(*debugStream);
     *debugStream << "\n";
-    debugStream->flush();
+  }
+
+  // printing the whole module per path/fork is quadratic, so only blocks
+  // that got terminated since the last entry are written
+  void journalNewBlocks(llvm::Function* F, const std::string& header) {
+    if (!shouldDebug)
+      return;
+
+    if (!journal) {
+      std::error_code EC;
+      journal = std::make_unique<llvm::raw_fd_ostream>("debug_journal.ll", EC);
+      if (EC) {
+        llvm::errs() << "Error opening debug journal: " << EC.message()
+                     << "\n";
+        journal.reset();
+        return;
+      }
+    }
+
+    auto& cursor = journalCursor;
+    if (cursor.function != F) {
+      cursor.function = F;
+      cursor.last = nullptr;
+      cursor.open.clear();
+      cursor.slots =
+          std::make_unique<llvm::ModuleSlotTracker>(F->getParent(), false);
+      cursor.named = 0;
+    }
+
+    *journal << "; ---- " << header << "\n";
+
+    // BasicBlock::print hides the slot tracker overload
+    auto write = [&](llvm::BasicBlock* BB) {
+      if (!BB->getTerminator()) {
+        cursor.open.push_back(BB);
+        return;
+      }
+      nameForJournal(BB, cursor.named);
+      for (auto& I : *BB) {
+        nameForJournal(&I, cursor.named);
+        for (auto& operand : I.operands())
+          nameForJournal(operand.get(), cursor.named);
+        if (auto phi = llvm::dyn_cast<llvm::PHINode>(&I))
+          for (auto incoming : phi->blocks())
+            nameForJournal(incoming, cursor.named);
+      }
+      static_cast<const llvm::Value&>(*BB).print(*journal, *cursor.slots);
+    };
+
+    auto open = std::move(cursor.open);
+    cursor.open.clear();
+    for (auto& handle : open)
+      if (auto BB = llvm::cast_or_null<llvm::BasicBlock>(handle))
+        write(BB);
+
+    auto it = F->begin();
+    if (auto last = llvm::cast_or_null<llvm::BasicBlock>(cursor.last))
+      it = std::next(last->getIterator());
+    for (; it != F->end(); ++it)
+      write(&*it);
+    if (!F->empty())
+      cursor.last = &F->back();
   }
 
   // Other functions remain the same, but use debugStream instead of
@@ -115,17 +247,9 @@ namespace debugging {
       return;
     if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, int8_t>) {
       *debugStream << " " << name << " : " << static_cast<int>(v) << "\n";
-      debugStream->flush();
       return;
     } else
       *debugStream << " " << name << " : " << v << "\n";
-    debugStream->flush();
-  }
-
-  void doIfDebug(const std::function<void(void)>& dothis) {
-    if (!shouldDebug)
-      return;
-    (dothis)();
   }
   template void printValue<uint64_t>(const uint64_t& v, const char* name);
   template void printValue<uint32_t>(const uint32_t& v, const char* name);
@@ -156,22 +280,78 @@ namespace argparser {
   void printHelp() {
     std::cerr << "Options:\n"
               << "  -d, --enable-debug   Enable debugging mode\n"
+              << "  --emit=ll|bc|none    Output format (default ll)\n"
+              << "  --compress=none|zlib|zstd\n"
+              << "                       Compress written modules\n"
+              << "  --no-unopt-dump      Skip writing output_no_opts\n"
+              << "  --keep-names         Keep IR value names (slower)\n"
+              << "  --merge-states       Merge paths that reach the same\n"
+              << "                       address into one\n"
+              << "  --dedupe-states      Reuse code lifted from an identical\n"
+              << "                       state\n"
+              << "  --backtrack          Rewind to forks instead of copying\n"
+              << "                       the path at each one (dfs only)\n"
+              << "  --strategy=dfs|bfs|return-first|novelty\n"
+              << "                       Order pending paths are lifted in\n"
+              << "  --max-path-insts=N   Instructions per path before it is\n"
+              << "                       closed as unresolved\n"
+              << "  --max-paths=N        Stop after N finished paths\n"
+              << "  --timeout=SECONDS    Close pending paths after SECONDS\n"
+              << "  --cache-dir=PATH     Cache optimized output by code hash\n"
+              << "  --cache-size=MB      Lift cache size limit (default 1024)\n"
+              << "  --egraph-nodes=N     E-graph node budget, 0 disables it\n"
+              << "  --egraph-time=MS     E-graph time budget per expression,\n"
+              << "                       0 (default) leaves only the node and\n"
+              << "                       iteration budgets, output stays stable\n"
+              << "  --solver=NAME        Path solver backend (builtin, z3, "
+                 "none)\n"
+              << "  --solver-budget=N    Solver conflicts per query, 0 for no\n"
+              << "                       limit (default 100000)\n"
+              << "  --log=cat1,cat2      Debug log categories (general, lift,\n"
+              << "                       semantics, operands, memory, path)\n"
               << "  -h                   Display this help message\n";
   }
 
   std::map<std::string, std::function<void()>> options = {
       {"-d", []() { debugging::enableDebug("debug.txt"); }},
+      {"--keep-names", []() { debugging::keepValueNames = true; }},
+      {"--no-unopt-dump",
+       []() { outputwriter::config().dumpUnoptimized = false; }},
+      {"--merge-states", []() { explorer::config().mergeStates = true; }},
+      {"--dedupe-states", []() { explorer::config().dedupeStates = true; }},
+      {"--backtrack", []() { explorer::config().backtrack = true; }},
       //
       {"-h", printHelp}};
 
+  // --key=value options, return false if value is not accepted
+  std::map<std::string, std::function<bool(const std::string&)>>
+      valueOptions = {{"--emit", outputwriter::setEmit},
+                      {"--compress", outputwriter::setCompression},
+                      {"--log", debugging::setCategories},
+                      {"--strategy", explorer::setStrategy},
+                      {"--max-path-insts", explorer::setMaxPathInstructions},
+                      {"--max-paths", explorer::setMaxPaths},
+                      {"--timeout", explorer::setTimeout},
+                      {"--cache-dir", liftcache::setDirectory},
+                      {"--cache-size", liftcache::setMaxSize},
+                      {"--egraph-nodes", egraph::setMaxNodes},
+                      {"--egraph-time", egraph::setTimeout},
+                      {"--solver", solver::setBackend},
+                      {"--solver-budget", solver::setConflictBudget}};
+
   void parseArguments(std::vector<std::string>& args) {
     std::vector<std::string> newArgs;
 
     for (const auto& arg : args) {
       // cout << arg << "\n";
+      const auto eq = arg.find('=');
       if (options.find(arg) != options.end())
         options[arg]();
-      else if (*(arg.c_str()) == '-')
+      else if (eq != std::string::npos &&
+               valueOptions.find(arg.substr(0, eq)) != valueOptions.end()) {
+        if (!valueOptions[arg.substr(0, eq)](arg.substr(eq + 1)))
+          printHelp();
+      } else if (*(arg.c_str()) == '-')
         printHelp();
       else
         newArgs.push_back(arg);
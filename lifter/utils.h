@@ -1,37 +1,61 @@
 #pragma once
 #include "coff/section_header.hpp"
 #include "nt/nt_headers.hpp"
+#include "llvm/IR/Function.h"
 #include "llvm/IR/Value.h"
 #include <cstdint>
+#include <iostream>
+#include <string>
 #include <linuxpe>
 
 // #define _NODEV why?
 
+// compile time log level, anything above it is compiled out
+#define MERGEN_LOG_NONE 0
+#define MERGEN_LOG_DEBUG 1 // doIfDebug blocks
+#define MERGEN_LOG_TRACE 2 // printvalue, printvalue2
+
+#ifndef MERGEN_LOG_LEVEL
+#ifdef _NODEV
+#define MERGEN_LOG_LEVEL MERGEN_LOG_NONE
+#else
+#define MERGEN_LOG_LEVEL MERGEN_LOG_TRACE
+#endif
+#endif
+
+// define before including anything to pick the category of a file
+#ifndef MERGEN_LOG_CATEGORY
+#define MERGEN_LOG_CATEGORY debugging::LOG_GENERAL
+#endif
+
+#define MERGEN_LOG_ENABLED(level)                                              \
+  (MERGEN_LOG_LEVEL >= (level) &&                                              \
+   debugging::isEnabled(MERGEN_LOG_CATEGORY))
+
 #ifndef UNREACHABLE
 #define UNREACHABLE(msg)                                                       \
   do {                                                                         \
                                                                                \
+    debugging::flushDebug();                                                   \
     llvm::outs().flush();                                                      \
     std::cout.flush();                                                         \
     llvm_unreachable_internal(msg, __FILE__, __LINE__);                        \
   } while (0)
 #endif
 
-#ifndef _NODEV
+// arguments are only evaluated when the category is enabled at runtime
 #define printvalue(x)                                                          \
   do {                                                                         \
-    debugging::printLLVMValue(x, #x);                                          \
+    if (MERGEN_LOG_ENABLED(MERGEN_LOG_TRACE))                                  \
+      debugging::printLLVMValue(x, #x);                                        \
   } while (0);
 // outs() << " " #x " : "; x->print(outs());
 // outs() << "\n";  outs().flush();
 #define printvalue2(x)                                                         \
   do {                                                                         \
-    debugging::printValue(x, #x);                                              \
+    if (MERGEN_LOG_ENABLED(MERGEN_LOG_TRACE))                                  \
+      debugging::printValue(x, #x);                                            \
   } while (0);
-#else
-#define printvalue(x) ((void)0);
-#define printvalue2(x) ((void)0);
-#endif // _NODEV
 
 #define printvalueforce(x)                                                     \
   do {                                                                         \
@@ -48,11 +72,39 @@
   } while (0);
 
 namespace debugging {
+  enum LogCategory : uint32_t {
+    LOG_GENERAL = 1 << 0,
+    LOG_LIFT = 1 << 1,      // decode loop, lifter.cpp
+    LOG_SEMANTICS = 1 << 2, // instruction semantics
+    LOG_OPERANDS = 1 << 3,  // folders, operand/register access
+    LOG_MEMORY = 1 << 4,    // GEPTracker, memory buffer
+    LOG_PATH = 1 << 5,      // path solving, passes
+    LOG_ALL = ~0u
+  };
+
+  extern bool shouldDebug;
+  extern bool keepValueNames; // implied by -d
+  extern uint32_t categoryMask;
+
+  inline bool isEnabled(uint32_t category) {
+    return shouldDebug && (categoryMask & category);
+  }
+
   int increaseInstCounter();
-  void enableDebug();
+  void enableDebug(const std::string& filename = "");
+  bool setCategories(const std::string& list);
+  void flushDebug();
   void printLLVMValue(llvm::Value* v, const char* name);
-  void doIfDebug(const std::function<void(void)>& dothis);
+  // appends every terminated block that is not in the journal yet, prefixed
+  // by a header line
+  void journalNewBlocks(llvm::Function* F, const std::string& header);
   template <typename T> void printValue(const T& v, const char* name);
+
+  // internal linkage so every file sees its own MERGEN_LOG_CATEGORY
+  template <typename F> static inline void doIfDebug(F&& dothis) {
+    if (MERGEN_LOG_ENABLED(MERGEN_LOG_DEBUG))
+      dothis();
+  }
 } // namespace debugging
 
 namespace argparser {
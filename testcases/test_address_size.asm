@@ -0,0 +1,18 @@
+section .text
+
+; 0x67 prefix, the effective address wraps at 32 bits. rax is fully known so
+; these go through the concrete path
+
+global main
+main:
+sub rsp, 0x10
+mov dword [rsp], 0x1234
+mov rax, 0x100000000
+add rax, rsp            ; low 32 bits are rsp, the high half is not
+mov ecx, [eax]          ; reads [rsp] back, 0x1234
+lea rdx, [eax+8]        ; rsp+8 without the high half
+sub rdx, rsp
+add ecx, edx            ; 0x123c
+mov eax, ecx
+add rsp, 0x10
+ret
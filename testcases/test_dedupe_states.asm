@@ -0,0 +1,48 @@
+section .text
+
+; lift with --dedupe-states, the join block is lifted once when both sides
+; arrive with the same state and twice when they dont
+
+global main
+main:    ; both sides end with the same registers, flags and memory
+xor eax, eax
+test ecx, ecx
+jz .left
+mov edx, 1
+jmp .join
+.left:
+mov edx, 1
+.join:
+add eax, edx
+ret
+
+global main_flags
+main_flags:    ; same registers, the carry left behind is different and
+               ; nothing reads it before the join
+test ecx, ecx
+jz .left
+add edx, 1
+sub edx, 1
+jmp .join
+.left:
+sub edx, 1
+add edx, 1
+.join:
+setc al
+movzx eax, al
+ret
+
+global main_memory
+main_memory:    ; registers match, one stack byte does not
+sub rsp, 0x10
+mov qword [rsp], 0
+test ecx, ecx
+jz .left
+mov byte [rsp], 1
+jmp .join
+.left:
+mov byte [rsp], 2
+.join:
+mov eax, [rsp]
+add rsp, 0x10
+ret
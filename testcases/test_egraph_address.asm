@@ -0,0 +1,40 @@
+section .text
+
+; addresses that only the e-graph turns back into constants. the store and
+; the load have to agree, otherwise the load reads the stale zero
+
+global main
+main:    ; (rsp + rcx) - rcx for the store, plain rsp for the load
+sub rsp, 0x10
+mov qword [rsp], 0
+lea rax, [rsp+rcx]
+sub rax, rcx
+mov qword [rax], 0x1234
+mov rax, [rsp]              ; 0x1234
+add rsp, 0x10
+ret
+
+global main_load
+main_load:    ; plain rsp for the store, (rsp ^ rcx) ^ rcx for the load
+sub rsp, 0x10
+mov qword [rsp], 0x5678
+mov rdx, rsp
+xor rdx, rcx
+xor rdx, rcx
+mov rax, [rdx]              ; 0x5678
+add rsp, 0x10
+ret
+
+global main_both
+main_both:    ; both sides go through different opaque forms
+sub rsp, 0x10
+mov qword [rsp+8], 0
+lea rdx, [rsp+rcx+8]
+sub rdx, rcx
+mov qword [rdx], 0x9abc
+mov r8, rsp
+xor r8, rcx
+xor r8, rcx
+mov rax, [r8+8]             ; 0x9abc
+add rsp, 0x10
+ret
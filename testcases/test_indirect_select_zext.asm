@@ -0,0 +1,55 @@
+section .text
+
+; indirect loads and stores whose address can only take a few values, the
+; index goes through zext/trunc and selects on the way
+
+global main
+main:    ; zext'd byte index
+sub rsp, 0x20
+mov qword [rsp], 10
+mov qword [rsp+8], 20
+mov qword [rsp+16], 30
+mov qword [rsp+24], 40
+movzx eax, cl
+and eax, 3
+mov rax, [rsp+rax*8]
+add rsp, 0x20
+ret
+
+global main_store
+main_store:    ; store through a truncated index, then read a fixed slot
+sub rsp, 0x20
+mov qword [rsp], 10
+mov qword [rsp+8], 20
+mov eax, ecx
+and eax, 1
+mov qword [rsp+rax*8], 99
+mov rax, [rsp+8]            ; 99 if rcx is odd, 20 otherwise
+add rsp, 0x20
+ret
+
+global main_chain
+main_chain:    ; selects feeding selects, the arms are shared
+sub rsp, 0x20
+mov qword [rsp], 1
+mov qword [rsp+8], 2
+mov qword [rsp+16], 3
+xor eax, eax
+mov r8d, 8
+test cl, 1
+cmovnz eax, r8d
+test cl, 2
+cmovnz eax, r8d
+test cl, 4
+mov r9d, 16
+cmovnz eax, r9d
+test cl, 8
+cmovnz eax, r8d
+mov rax, [rsp+rax]
+add rsp, 0x20
+ret
+
+global main_arg
+main_arg:    ; the address depends on an argument, nothing to enumerate
+mov rax, [rcx+rdx*8]
+ret
@@ -0,0 +1,49 @@
+section .text
+
+; linear mba, every entry should fold to the plain expression in the comment
+
+global main
+main:    ; (x ^ y) + 2 * (x & y) = x + y
+mov eax, ecx
+xor eax, edx
+mov r8d, ecx
+and r8d, edx
+add eax, r8d
+add eax, r8d
+ret
+
+global main_or
+main_or:    ; (x | y) - (x & y) = x ^ y
+mov eax, ecx
+or eax, edx
+mov r8d, ecx
+and r8d, edx
+sub eax, r8d
+ret
+
+global main_not
+main_not:    ; -x - 1 = ~x, with a third variable that cancels out
+mov eax, ecx
+neg eax
+dec eax
+mov r9d, r8d
+xor r9d, edx
+add eax, r9d
+sub eax, r9d
+ret
+
+global main_repeat
+main_repeat:    ; the same expression twice, the second one comes from the
+                ; per lifter results
+mov eax, ecx
+xor eax, edx
+mov r8d, ecx
+and r8d, edx
+add eax, r8d
+add eax, r8d
+mov r10d, ecx
+xor r10d, edx
+add r10d, r8d
+add r10d, r8d
+sub eax, r10d               ; 0
+ret
@@ -0,0 +1,47 @@
+section .text
+
+; lift with --merge-states, both sides of each diamond rejoin in one block
+
+global main
+main:    ; registers and a stack byte differ after the diamond
+sub rsp, 0x10
+mov qword [rsp], 0
+test ecx, ecx
+jz .zero
+mov eax, 1
+mov byte [rsp], 0x11
+jmp .join
+.zero:
+mov eax, 2
+mov byte [rsp], 0x22
+.join:
+movzx edx, byte [rsp]
+add eax, edx
+add rsp, 0x10
+ret
+
+global main_partial
+main_partial:    ; al on one side, whole rax on the other, the register is
+                 ; in slices on one side only
+mov rax, rcx
+test edx, edx
+jz .whole
+mov al, 0x7f
+jmp .join
+.whole:
+mov rax, 5
+.join:
+ret
+
+global main_flags
+main_flags:    ; carry comes out of different instructions on each side
+test ecx, ecx
+jz .sub
+add edx, r8d
+jmp .join
+.sub:
+sub edx, r8d
+.join:
+setc al
+movzx eax, al
+ret
@@ -0,0 +1,63 @@
+section .text
+
+; opaque predicates, every branch below always goes the same way and only
+; one side should be lifted
+
+global main
+main:    ; (x ^ y) + 2 * (x & y) == x + y, decided by the mba form
+mov eax, ecx
+xor eax, edx
+mov r8d, ecx
+and r8d, edx
+lea eax, [rax+r8*2]
+lea r9d, [rcx+rdx]
+cmp eax, r9d
+jne .never
+mov eax, 1
+ret
+.never:
+mov eax, 2
+ret
+
+global main_mba_ne
+main_mba_ne:    ; same shape, the difference is the constant 1
+mov eax, ecx
+or eax, edx
+mov r8d, ecx
+and r8d, edx
+sub eax, r8d
+mov r9d, ecx
+xor r9d, edx
+inc r9d
+cmp eax, r9d
+je .never
+mov eax, 1
+ret
+.never:
+mov eax, 2
+ret
+
+global main_range
+main_range:    ; x * (x + 1) is even
+mov eax, ecx
+lea edx, [rcx+1]
+imul eax, edx
+test eax, 1
+jnz .never
+mov eax, 1
+ret
+.never:
+mov eax, 2
+ret
+
+global main_not_opaque
+main_not_opaque:    ; looks alike but depends on the input, both sides stay
+mov eax, ecx
+xor eax, edx
+cmp eax, ecx
+jne .other
+mov eax, 1
+ret
+.other:
+mov eax, 2
+ret
@@ -0,0 +1,39 @@
+section .text
+
+; partial register writes are kept as slices, reads that span more than one
+; slice put the register back together
+
+global main
+main:    ; ax spans al and ah written separately
+mov rax, rcx
+mov al, 0x34
+mov ah, 0x12
+movzx eax, ax               ; 0x1234
+ret
+
+global main_upper
+main_upper:    ; the untouched upper half of rcx comes back with the low word
+mov rax, rcx
+mov ax, 0x5678
+shr rax, 8                  ; bits 8..63, crosses the written word
+ret
+
+global main_high_low
+main_high_low:    ; ah read after al was written, and al after ah
+mov rax, 0x1122334455667788
+mov al, 0xaa
+mov dl, ah                  ; 0x77
+mov ah, 0xbb
+mov cl, al                  ; 0xaa
+movzx eax, dl
+shl eax, 8
+or al, cl                   ; 0x77aa
+ret
+
+global main_dword
+main_dword:    ; a 32 bit write zeroes the upper half, no slices left
+mov rax, rcx
+mov al, 1
+mov eax, eax
+shr rax, 32                 ; 0
+ret
@@ -0,0 +1,63 @@
+section .text
+
+; solver answers are shared between paths by the shape of the query and the
+; conditions it depends on. lift with --max-paths high enough to see all of
+; them
+
+global main
+main:    ; the same check on ecx after different conditions on edx, the
+         ; edx ones dont touch it so both share the cached answer
+cmp edx, 5
+jb .low
+cmp ecx, 100
+ja .big_high
+mov eax, 1
+ret
+.big_high:
+mov eax, 2
+ret
+.low:
+cmp ecx, 100
+ja .big_low
+mov eax, 3
+ret
+.big_low:
+mov eax, 4
+ret
+
+global main_dependent
+main_dependent:    ; the second check on ecx is decided by the first one,
+                   ; its answer must not come from a path without it
+cmp ecx, 10
+jae .wide
+cmp ecx, 20
+jae .never                  ; ecx < 10 here
+mov eax, 1
+ret
+.never:
+mov eax, 2
+ret
+.wide:
+cmp ecx, 20
+jae .twenty
+mov eax, 3
+ret
+.twenty:
+mov eax, 4
+ret
+
+global main_linked
+main_linked:    ; edx only matters through r8d = ecx + edx
+lea r8d, [rcx+rdx]
+cmp edx, 0
+jne .skip
+cmp r8d, ecx
+jne .never                  ; equal while edx is 0
+mov eax, 1
+ret
+.never:
+mov eax, 2
+ret
+.skip:
+xor eax, eax
+ret
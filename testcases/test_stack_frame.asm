@@ -0,0 +1,57 @@
+section .text
+
+; stack frame recovery, every entry should return the same value with and
+; without the frame being split into allocas
+
+global main
+main:    ; partial overlap, the dword read lands in the middle of the qword
+sub rsp, 0x20
+mov rdx, 0x1122334455667788
+mov [rsp+8], rdx
+mov eax, [rsp+10]           ; 0x33445566
+mov word [rsp+14], 0x9999   ; [rsp+8] is now 0x9999334455667788
+add rax, [rsp+8]
+add rsp, 0x20
+ret
+
+global main_straddle
+main_straddle:    ; the qword read crosses the initial rsp, the frame has to
+                  ; stay in memory
+mov rdx, 0x1122334455667788
+mov [rsp-4], rdx
+mov rax, [rsp-4]
+ret
+
+global main_escape
+main_escape:    ; pointer to a local leaves through rax and is indexed by an
+                ; unknown amount
+sub rsp, 0x20
+mov qword [rsp+8], 0x1234
+and rcx, 8
+lea rax, [rsp+rcx]
+mov rdx, [rax+8]
+add rsp, 0x20
+mov [rsp-8], rdx
+ret
+
+global main_select
+main_select:    ; two candidate slots picked by a flag, both must see the
+                ; same store
+sub rsp, 0x20
+mov qword [rsp], 1
+mov qword [rsp+8], 2
+and rcx, 1
+mov rax, [rsp+rcx*8]
+add rsp, 0x20
+ret
+
+global main_indexed
+main_indexed:    ; a local next to a slot read through an unbounded index,
+                 ; the index can land on the local so it has to stay in
+                 ; memory
+sub rsp, 0x20
+mov qword [rsp+8], 0x1234
+mov qword [rsp+16], 0x5678
+mov rax, [rsp+rcx*8]
+add rsp, 0x20
+ret
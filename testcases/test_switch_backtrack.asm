@@ -0,0 +1,54 @@
+section .text
+
+; jump table with four targets, lift with --backtrack. every case has to be
+; reached with only its own index as the path condition, and the default
+; with all of the other ones ruled out
+
+global main
+main:
+and ecx, 3
+lea rdx, [rel jtable]
+movsxd rax, dword [rdx+rcx*4]
+add rax, rdx
+jmp rax
+
+case0:    ; ecx == 0 here, the branch below always goes to .zero
+test ecx, ecx
+jz .zero
+mov eax, 0xdead
+ret
+.zero:
+mov eax, 10
+ret
+
+case1:    ; ecx == 1, never 0
+cmp ecx, 1
+jne .wrong
+mov eax, 11
+ret
+.wrong:
+mov eax, 0xdead
+ret
+
+case2:    ; ecx == 2
+cmp ecx, 2
+jne .wrong
+mov eax, 12
+ret
+.wrong:
+mov eax, 0xdead
+ret
+
+case3:    ; last target, the default side of the switch
+cmp ecx, 3
+jne .wrong
+mov eax, 13
+ret
+.wrong:
+mov eax, 0xdead
+ret
+
+jtable: dd case0 - jtable
+        dd case1 - jtable
+        dd case2 - jtable
+        dd case3 - jtable
@@ -0,0 +1,34 @@
+section .text
+
+; stores through a symbolic base, later stores must drop what they might
+; overwrite before a load reads the old value back
+
+global main
+main:    ; rsp derived base, the concrete store hits the same slot when rcx
+         ; is 0
+sub rsp, 0x40
+and rcx, 7
+lea rdx, [rsp+rcx*8]
+mov qword [rdx+8], 0x1111
+mov qword [rsp+8], 0x2222
+mov rax, [rdx+8]            ; 0x2222 if rcx is 0, 0x1111 otherwise
+add rsp, 0x40
+ret
+
+global main_select
+main_select:    ; select address with a symbolic arm
+mov qword [rcx], 0x1111
+test rdx, rdx
+lea r8, [rcx+8]
+lea r9, [rcx]
+cmovz r8, r9
+mov qword [r8], 0x2222
+mov rax, [rcx]              ; 0x2222 if rdx is 0
+ret
+
+global main_alias
+main_alias:    ; two unrelated bases may still alias
+mov qword [rcx], 0x1111
+mov qword [rdx], 0x2222
+mov rax, [rcx]              ; 0x2222 if rcx == rdx
+ret